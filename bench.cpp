@@ -0,0 +1,1538 @@
+/**
+ * File:    bench.cpp
+ * Project: CMSC 341 Project 2 – The Fleet of Spaceships
+ *
+ * This file contains throughput benchmarks for the Fleet class
+ * Build with "make bench", which compiles with optimizations on
+ */
+
+#include "fleet.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
+using namespace std;
+
+const char BREAK[] = "*****************************************************************\n";
+const int SIZES[] = {1000, 10000, 50000, 90000};
+const int NUM_SIZES = sizeof(SIZES) / sizeof(SIZES[0]);
+const int NUM_LOOKUPS = 2000000;
+
+mt19937 rng(341);
+
+// Name:    nanosSince
+// Desc:    Measures the time elapsed since start
+// Precon:  None
+// Postcon: Returns the elapsed time in nanoseconds
+double nanosSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+}
+
+// Name:    randomId
+// Desc:    Draws an id in [MINID, MAXID], from two draws of gen when the range is wider than 32 bits
+// Precon:  None
+// Postcon: Returns the id
+ShipId randomId(mt19937& gen = rng)
+{
+    const uint64_t range = (uint64_t) (MAXID - MINID) + 1;
+    uint64_t value = gen();
+    if(range > 0xFFFFFFFFULL)
+    {
+        value = value << 32 | gen();
+    }
+    return MINID + (ShipId) (value % range);
+}
+
+// Name:    uniqueIds
+// Desc:    Creates size distinct ids in [MINID, MAXID], in random order
+//          Small ranges are shuffled whole, while ranges far larger than size, as with wide ids, are sampled
+// Precon:  size <= MAXID - MINID + 1
+// Postcon: Returns the ids
+vector<ShipId> uniqueIds(int size, mt19937& gen = rng)
+{
+    const uint64_t range = (uint64_t) (MAXID - MINID) + 1;
+    vector<ShipId> ids;
+    if(range <= 4 * (uint64_t) size + (1 << 20))
+    {
+        ids.resize(range);
+        for(int i = 0; i < (int) ids.size(); i++)
+        {
+            ids[i] = MINID + i;
+        }
+        shuffle(ids.begin(), ids.end(), gen);
+        ids.resize(size);
+        return ids;
+    }
+    // Draw ids until there are size distinct ones, then put them back in random order
+    ids.reserve(size);
+    while((int) ids.size() < size)
+    {
+        while((int) ids.size() < size)
+        {
+            ids.push_back(randomId(gen));
+        }
+        sort(ids.begin(), ids.end());
+        ids.erase(unique(ids.begin(), ids.end()), ids.end());
+    }
+    shuffle(ids.begin(), ids.end(), gen);
+    return ids;
+}
+
+// Name:    fillFleet
+// Desc:    Inserts an ALIVE Ship of random type for each of the passed ids
+// Precon:  None
+// Postcon: fleet will contain every id
+void fillFleet(Fleet& fleet, const vector<ShipId>& ids)
+{
+    for(ShipId id : ids)
+    {
+        fleet.insert(Ship(id, static_cast<SHIPTYPE>(rng() % 5), ALIVE));
+    }
+}
+
+// Name:    lookupIds
+// Desc:    Picks count lookups, half of them ids in the Fleet and half random ids in range
+// Precon:  ids must not be empty
+// Postcon: Returns the lookups in random order
+vector<ShipId> lookupIds(const vector<ShipId>& ids, int count)
+{
+    vector<ShipId> lookups(count);
+    for(int i = 0; i < count; i++)
+    {
+        lookups[i] = (i % 2 == 0 ? ids[rng() % ids.size()] : randomId());
+    }
+    return lookups;
+}
+
+// Name:    benchFindShip
+// Desc:    Times findShip with and without the search layout over each Fleet size
+// Precon:  None
+// Postcon: Results are displayed to the user
+void benchFindShip()
+{
+    cout << BREAK << "findShip: tree vs. search layout (ns per lookup)\n" << BREAK;
+    for(int i = 0; i < NUM_SIZES; i++)
+    {
+        Fleet fleet;
+        vector<ShipId> ids = uniqueIds(SIZES[i]);
+        fillFleet(fleet, ids);
+        vector<ShipId> lookups = lookupIds(ids, NUM_LOOKUPS);
+        double times[2];
+        int found = 0;
+        // Time the tree first, then the layout
+        for(int layout = 0; layout < 2; layout++)
+        {
+            fleet.setSearchLayout(layout == 1);
+            fleet.findShip(MINID);
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            for(ShipId id : lookups)
+            {
+                found += fleet.findShip(id);
+            }
+            times[layout] = nanosSince(start) / NUM_LOOKUPS;
+        }
+        cout << "\t" << SIZES[i] << " Ships:\ttree " << times[0] << "\tlayout " << times[1]
+             << "\tspeedup " << times[0] / times[1] << "x\t(" << found << " found)\n";
+    }
+}
+
+// Name:    benchReadHeavy
+// Desc:    Times a workload of 100 findShip/setState calls per insert or remove, with and without the search layout
+// Precon:  None
+// Postcon: Results are displayed to the user
+void benchReadHeavy()
+{
+    const int readsPerWrite = 100;
+    cout << BREAK << "Read-heavy mix, " << readsPerWrite << " reads per write (ns per operation)\n" << BREAK;
+    for(int i = 0; i < NUM_SIZES; i++)
+    {
+        vector<ShipId> ids = uniqueIds(SIZES[i]);
+        vector<ShipId> lookups = lookupIds(ids, NUM_LOOKUPS);
+        double times[2];
+        for(int layout = 0; layout < 2; layout++)
+        {
+            Fleet fleet;
+            fillFleet(fleet, ids);
+            fleet.setSearchLayout(layout == 1);
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            for(int j = 0; j < NUM_LOOKUPS; j++)
+            {
+                // Every readsPerWrite operations, remove a Ship and put it back
+                if(j % readsPerWrite == 0)
+                {
+                    ShipId id = ids[(j / readsPerWrite) % ids.size()];
+                    fleet.remove(id);
+                    fleet.insert(Ship(id));
+                }
+                else if(j % 2 == 0)
+                {
+                    fleet.findShip(lookups[j]);
+                }
+                else
+                {
+                    fleet.setState(lookups[j], ALIVE);
+                }
+            }
+            times[layout] = nanosSince(start) / NUM_LOOKUPS;
+        }
+        cout << "\t" << SIZES[i] << " Ships:\ttree " << times[0] << "\tlayout " << times[1]
+             << "\tspeedup " << times[0] / times[1] << "x\n";
+    }
+}
+
+// Name:    benchFindMany
+// Desc:    Times findMany against calling findShip once per id, through the tree and the search layout
+// Precon:  None
+// Postcon: Results are displayed to the user
+void benchFindMany()
+{
+    const int batchSize = 4096;
+    cout << BREAK << "findMany in batches of " << batchSize << " vs. findShip (ns per lookup)\n" << BREAK;
+    for(int i = 0; i < NUM_SIZES; i++)
+    {
+        Fleet fleet;
+        vector<ShipId> ids = uniqueIds(SIZES[i]);
+        fillFleet(fleet, ids);
+        vector<ShipId> lookups = lookupIds(ids, NUM_LOOKUPS);
+        bool found[batchSize];
+        cout << "\t" << SIZES[i] << " Ships:";
+        for(int layout = 0; layout < 2; layout++)
+        {
+            fleet.setSearchLayout(layout == 1);
+            fleet.findMany(lookups.data(), batchSize, found);
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            int single = 0;
+            for(ShipId id : lookups)
+            {
+                single += fleet.findShip(id);
+            }
+            double singleTime = nanosSince(start) / NUM_LOOKUPS;
+            start = chrono::steady_clock::now();
+            int batched = 0;
+            for(int j = 0; j + batchSize <= NUM_LOOKUPS; j += batchSize)
+            {
+                batched += fleet.findMany(lookups.data() + j, batchSize, found);
+            }
+            double batchTime = nanosSince(start) / (NUM_LOOKUPS / batchSize * batchSize);
+            cout << (layout == 1 ? "\tlayout " : "\ttree ") << singleTime << " -> " << batchTime
+                 << " (" << singleTime / batchTime << "x)";
+        }
+        cout << "\n";
+    }
+}
+
+// Name:    benchMassLoss
+// Desc:    Times losing 500 Ships at once with setStates against one setState call per Ship, followed by removeLost
+// Precon:  None
+// Postcon: Results are displayed to the user
+void benchMassLoss()
+{
+    const int numLost = 500;
+    const int numTicks = 20;
+    cout << BREAK << "Losing " << numLost << " Ships then removeLost (us per tick)\n" << BREAK;
+    for(int i = 0; i < NUM_SIZES; i++)
+    {
+        vector<ShipId> ids = uniqueIds(SIZES[i]);
+        vector<STATE> states(numLost, LOST);
+        bool results[numLost];
+        double times[2][2] = {{0, 0}, {0, 0}};
+        for(int batched = 0; batched < 2; batched++)
+        {
+            for(int tick = 0; tick < numTicks; tick++)
+            {
+                Fleet fleet;
+                fillFleet(fleet, ids);
+                vector<ShipId> lost = lookupIds(ids, 2 * numLost);
+                // Keep only the ids that are in the Fleet
+                for(int j = 0; j < numLost; j++)
+                {
+                    lost[j] = lost[2 * j];
+                }
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                if(batched == 1)
+                {
+                    fleet.setStates(lost.data(), states.data(), numLost, results);
+                }
+                else
+                {
+                    for(int j = 0; j < numLost; j++)
+                    {
+                        fleet.setState(lost[j], LOST);
+                    }
+                }
+                times[batched][0] += nanosSince(start) / 1000 / numTicks;
+                start = chrono::steady_clock::now();
+                fleet.removeLost();
+                times[batched][1] += nanosSince(start) / 1000 / numTicks;
+            }
+        }
+        cout << "\t" << SIZES[i] << " Ships:\tsetState " << times[0][0] << "\tsetStates " << times[1][0]
+             << "\tremoveLost " << times[1][1] << "\n";
+    }
+}
+
+// Name:    benchBurstRemove
+// Desc:    Times removing a burst of a third of the Fleet with and without lazy removal
+// Precon:  None
+// Postcon: Results are displayed to the user
+void benchBurstRemove()
+{
+    cout << BREAK << "Removing a third of the Fleet in a burst (ns per removal)\n" << BREAK;
+    for(int i = 0; i < NUM_SIZES; i++)
+    {
+        vector<ShipId> ids = uniqueIds(SIZES[i]);
+        const int numRemoved = SIZES[i] / 3;
+        double times[2];
+        for(int lazy = 0; lazy < 2; lazy++)
+        {
+            Fleet fleet;
+            fillFleet(fleet, ids);
+            fleet.setLazyRemove(lazy == 1);
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            for(int j = 0; j < numRemoved; j++)
+            {
+                fleet.remove(ids[j]);
+            }
+            times[lazy] = nanosSince(start) / numRemoved;
+        }
+        cout << "\t" << SIZES[i] << " Ships:\teager " << times[0] << "\tlazy " << times[1]
+             << "\tspeedup " << times[0] / times[1] << "x\n";
+    }
+}
+
+// Name:    listNaive
+// Desc:    Lists the subtree the way listShips used to, building strings and flushing every line
+// Precon:  None
+// Postcon: Each Ship in the subtree is written to out
+void listNaive(Ship* aShip, ostream& out)
+{
+    if(aShip != nullptr)
+    {
+        listNaive(aShip->getLeft(), out);
+        out << aShip->getID() << ':' << aShip->getStateStr() << ':' << aShip->getTypeStr() << endl;
+        listNaive(aShip->getRight(), out);
+    }
+}
+
+// Name:    benchExport
+// Desc:    Times writing a full Fleet to a file in each format, against flushing every line
+// Precon:  None
+// Postcon: Results are displayed to the user
+void benchExport()
+{
+    const int size = SIZES[NUM_SIZES - 1];
+    const char* fileName = "bench_export.tmp";
+    cout << BREAK << "Exporting " << size << " Ships to a file (ms)\n" << BREAK;
+    Fleet fleet;
+    fillFleet(fleet, uniqueIds(size));
+    ofstream file(fileName, ios::binary);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    listNaive(fleet.getRoot(), file);
+    cout << "\tflush per line " << nanosSince(start) / 1e6;
+    const char* names[] = {"text", "json lines", "binary"};
+    for(int format = TEXT; format <= BINARY; format++)
+    {
+        start = chrono::steady_clock::now();
+        fleet.exportShips(file, static_cast<FORMAT>(format));
+        file.flush();
+        cout << "\t" << names[format] << " " << nanosSince(start) / 1e6;
+    }
+    start = chrono::steady_clock::now();
+    fleet.dumpTree(file);
+    file.flush();
+    cout << "\tdumpTree " << nanosSince(start) / 1e6 << "\n";
+    file.close();
+    std::remove(fileName);
+}
+
+// Name:    benchBuild
+// Desc:    Times building and destroying the largest Fleet by inserting one Ship at a time against build,
+//          on 1 thread and on every hardware thread
+// Precon:  None
+// Postcon: Results are displayed to the user
+void benchBuild()
+{
+    const int size = SIZES[NUM_SIZES - 1];
+    const int threads = max(1, (int) thread::hardware_concurrency());
+    cout << BREAK << "Building and destroying a Fleet of " << size << " (ms)\n" << BREAK;
+    vector<ShipId> ids = uniqueIds(size);
+    vector<Ship> ships(size);
+    for(int i = 0; i < size; i++)
+    {
+        ships[i] = Ship(ids[i], static_cast<SHIPTYPE>(rng() % 5), ALIVE);
+    }
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    {
+        Fleet fleet;
+        fleet.setThreads(1);
+        for(const Ship& ship : ships)
+        {
+            fleet.insert(ship);
+        }
+        cout << "\tinsert loop " << nanosSince(start) / 1e6;
+        start = chrono::steady_clock::now();
+    }
+    cout << "\tteardown " << nanosSince(start) / 1e6 << "\n";
+    for(int numThreads : {1, threads})
+    {
+        start = chrono::steady_clock::now();
+        {
+            Fleet fleet;
+            fleet.setThreads(numThreads);
+            fleet.build(ships.data(), size);
+            cout << "\tbuild, " << numThreads << " threads " << nanosSince(start) / 1e6;
+            start = chrono::steady_clock::now();
+        }
+        cout << "\tteardown " << nanosSince(start) / 1e6 << "\n";
+    }
+}
+
+// Name:    countTypes
+// Desc:    Counts the Ships of each type in the subtree by walking it with getLeft/getRight
+// Precon:  counts must hold 5 elements
+// Postcon: counts will be increased by each Ship's type
+void countTypes(Ship* aShip, long long counts[])
+{
+    if(aShip != nullptr)
+    {
+        countTypes(aShip->getLeft(), counts);
+        counts[aShip->getType()]++;
+        countTypes(aShip->getRight(), counts);
+    }
+}
+
+// Name:    benchAnalytics
+// Desc:    Times a type histogram of the largest Fleet by a serial walk and by parallelReduce
+// Precon:  None
+// Postcon: Results are displayed to the user
+void benchAnalytics()
+{
+    const int size = SIZES[NUM_SIZES - 1];
+    const int repeats = 50;
+    const int threads = max(1, (int) thread::hardware_concurrency());
+    typedef array<long long, 5> Counts;
+    cout << BREAK << "Type histogram of " << size << " Ships (us)\n" << BREAK;
+    Fleet fleet;
+    fillFleet(fleet, uniqueIds(size));
+    long long counts[5] = {};
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(int i = 0; i < repeats; i++)
+    {
+        countTypes(fleet.getRoot(), counts);
+    }
+    cout << "\tserial walk " << nanosSince(start) / 1000 / repeats;
+    for(int numThreads : {1, threads})
+    {
+        fleet.setThreads(numThreads);
+        start = chrono::steady_clock::now();
+        for(int i = 0; i < repeats; i++)
+        {
+            Counts total = fleet.parallelReduce(Counts(),
+                [](const Ship& ship) {Counts count = {}; count[ship.getType()] = 1; return count;},
+                [](Counts lhs, const Counts& rhs) {for(int j = 0; j < 5; j++) {lhs[j] += rhs[j];} return lhs;});
+            counts[0] += total[0];
+        }
+        cout << "\tparallelReduce, " << numThreads << " threads " << nanosSince(start) / 1000 / repeats;
+    }
+    cout << "\n";
+}
+
+// Name:    benchRemoveLost
+// Desc:    Times removeLost on the largest Fleet with a third of its Ships lost, on 1 thread and on every hardware thread
+// Precon:  None
+// Postcon: Results are displayed to the user
+void benchRemoveLost()
+{
+    const int size = SIZES[NUM_SIZES - 1];
+    const int threads = max(1, (int) thread::hardware_concurrency());
+    cout << BREAK << "removeLost with a third of " << size << " Ships lost (ms)\n" << BREAK;
+    vector<ShipId> ids = uniqueIds(size);
+    for(int numThreads : {1, threads})
+    {
+        Fleet fleet;
+        fleet.setThreads(numThreads);
+        fillFleet(fleet, ids);
+        for(int i = 0; i < size; i += 3)
+        {
+            fleet.setState(ids[i], LOST);
+        }
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        fleet.removeLost();
+        cout << "\t" << numThreads << " threads " << nanosSince(start) / 1e6;
+    }
+    cout << "\n";
+}
+
+// Name:    benchFinger
+// Desc:    Times walking every id in order with findShip and findShipNear, and inserting
+//          ascending ids with insert and insertNear
+// Precon:  None
+// Postcon: Results are displayed to the user
+void benchFinger()
+{
+    const int size = SIZES[NUM_SIZES - 1];
+    cout << BREAK << "Sequential ids over " << size << " Ships (ns per op)\n" << BREAK;
+    vector<ShipId> ids(size);
+    for(int i = 0; i < size; i++)
+    {
+        ids[i] = MINID + i;
+    }
+    for(int near = 0; near < 2; near++)
+    {
+        Fleet fleet;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for(ShipId id : ids)
+        {
+            if(near)
+            {
+                fleet.insertNear(Ship(id));
+            }
+            else
+            {
+                fleet.insert(Ship(id));
+            }
+        }
+        double insertTime = nanosSince(start) / size;
+        long long found = 0;
+        start = chrono::steady_clock::now();
+        for(int pass = 0; pass < 20; pass++)
+        {
+            for(ShipId id : ids)
+            {
+                found += (near ? fleet.findShipNear(id) : fleet.findShip(id));
+            }
+        }
+        double findTime = nanosSince(start) / (20.0 * size);
+        cout << (near ? "\tnear:  " : "\tplain: ") << "insert " << insertTime << "\tfind " << findTime << "\t(" << found << ")\n";
+    }
+}
+
+// Name:    benchCache
+// Desc:    Times findShip with and without the lookup cache when 90% of lookups go to 64 hot ids
+// Precon:  None
+// Postcon: Results are displayed to the user
+void benchCache()
+{
+    cout << BREAK << "findShip with 90% of lookups on 64 hot ids (ns per lookup)\n" << BREAK;
+    for(int s = 0; s < NUM_SIZES; s++)
+    {
+        vector<ShipId> ids = uniqueIds(SIZES[s]);
+        Fleet fleet;
+        fillFleet(fleet, ids);
+        vector<ShipId> lookups = lookupIds(ids, NUM_LOOKUPS);
+        for(int i = 0; i < NUM_LOOKUPS; i++)
+        {
+            if(rng() % 10 != 0)
+            {
+                lookups[i] = ids[rng() % 64];
+            }
+        }
+        cout << SIZES[s] << " Ships:";
+        for(int cache = 0; cache < 2; cache++)
+        {
+            fleet.setCache(cache);
+            long long found = 0;
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            for(ShipId id : lookups)
+            {
+                found += fleet.findShip(id);
+            }
+            cout << (cache ? "\tcached " : "\tplain ") << nanosSince(start) / NUM_LOOKUPS;
+            if(cache)
+            {
+                cout << "\thit rate " << (double) fleet.getCacheHits() / NUM_LOOKUPS;
+            }
+        }
+        cout << "\n";
+    }
+}
+
+// Name:    benchHandles
+// Desc:    Times setState by id against setState through handles kept from find
+// Precon:  None
+// Postcon: Results are displayed to the user
+void benchHandles()
+{
+    cout << BREAK << "setState by id and by handle (ns per call)\n" << BREAK;
+    for(int s = 0; s < NUM_SIZES; s++)
+    {
+        vector<ShipId> ids = uniqueIds(SIZES[s]);
+        Fleet fleet;
+        fillFleet(fleet, ids);
+        vector<int> order(NUM_LOOKUPS);
+        for(int& index : order)
+        {
+            index = rng() % ids.size();
+        }
+        vector<const Ship*> handles(ids.size());
+        for(int i = 0; i < (int) ids.size(); i++)
+        {
+            handles[i] = fleet.find(ids[i]);
+        }
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for(int i = 0; i < NUM_LOOKUPS; i++)
+        {
+            fleet.setState(ids[order[i]], static_cast<STATE>(i & 1));
+        }
+        cout << SIZES[s] << " Ships:\tid " << nanosSince(start) / NUM_LOOKUPS;
+        start = chrono::steady_clock::now();
+        for(int i = 0; i < NUM_LOOKUPS; i++)
+        {
+            fleet.setState(handles[order[i]], static_cast<STATE>(i & 1));
+        }
+        cout << "\thandle " << nanosSince(start) / NUM_LOOKUPS << "\n";
+    }
+}
+
+// Name:    printMemory
+// Desc:    Prints a Fleet's memory usage per Ship
+// Precon:  None
+// Postcon: Results are displayed to the user
+void printMemory(const string& mode, const Fleet& fleet, long long allocations)
+{
+    MemoryUsage usage = fleet.memoryUsage();
+    const double ships = max(1, fleet.getSize());
+    cout << mode << "\t" << usage.total() / ships << "\t(nodes " << usage.nodes / ships << ", overhead " << usage.overhead / ships
+        << ", indexes " << usage.indexes / ships << ", fragmentation " << usage.fragmentation / ships << ", allocations " << allocations << ")\n";
+}
+
+// Name:    benchMemory
+// Desc:    Prints bytes per Ship at the largest Fleet size for each way of filling and indexing the Fleet
+// Precon:  None
+// Postcon: Results are displayed to the user
+void benchMemory()
+{
+    const int size = SIZES[NUM_SIZES - 1];
+    cout << BREAK << "Memory of " << size << " Ships (bytes per Ship)\n" << BREAK;
+    vector<ShipId> ids = uniqueIds(size);
+    {
+        AllocationStats before = Ship::getAllocationStats();
+        Fleet fleet;
+        fillFleet(fleet, ids);
+        printMemory("pointer nodes, insert", fleet, Ship::getAllocationStats().allocations - before.allocations);
+        fleet.setSearchLayout(true);
+        for(int i = 0; i < size; i++)
+        {
+            fleet.findShip(ids[i]);
+        }
+        printMemory("  + search layout", fleet, 0);
+        fleet.setSearchLayout(false);
+        fleet.setLazyRemove(true, 1);
+        for(int i = 0; i < size / 4; i++)
+        {
+            fleet.remove(ids[i]);
+        }
+        printMemory("  + 25% lazily removed", fleet, 0);
+    }
+    {
+        vector<Ship> ships(size);
+        for(int i = 0; i < size; i++)
+        {
+            ships[i] = Ship(ids[i]);
+        }
+        AllocationStats before = Ship::getAllocationStats();
+        Fleet fleet;
+        fleet.build(ships.data(), size);
+        printMemory("pointer nodes, build", fleet, Ship::getAllocationStats().allocations - before.allocations);
+    }
+}
+
+// Name:    benchPlacement
+// Desc:    Times findShip at the largest Fleet size under each placement of the Ships, both when
+//          the Fleet is filled by insertion and after setPlacement has moved its Ships in order of id
+// Precon:  None
+// Postcon: Results are displayed to the user
+void benchPlacement()
+{
+    const int size = SIZES[NUM_SIZES - 1];
+    cout << BREAK << "findShip over " << size << " Ships by placement (ns per lookup)\n" << BREAK;
+    const struct {const char* name; PLACEMENT placement; NUMA_POLICY numa;} policies[] = {
+        {"heap", HEAP, NUMA_DEFAULT},
+        {"slabs", SLABS, NUMA_DEFAULT},
+        {"huge page slabs", HUGE_SLABS, NUMA_DEFAULT},
+        {"huge page slabs on node 0", HUGE_SLABS, NUMA_BIND},
+        {"slabs interleaved", SLABS, NUMA_INTERLEAVE}};
+    vector<ShipId> ids = uniqueIds(size);
+    vector<ShipId> lookups = lookupIds(ids, NUM_LOOKUPS);
+    for(const auto& policy : policies)
+    {
+        Fleet fleet;
+        fleet.setPlacement(policy.placement, policy.numa, 0);
+        fillFleet(fleet, ids);
+        cout << policy.name << ":";
+        for(int moved = 0; moved < 2; moved++)
+        {
+            if(moved)
+            {
+                fleet.setPlacement(policy.placement, policy.numa, 0);
+            }
+            long long found = 0;
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            for(ShipId id : lookups)
+            {
+                found += fleet.findShip(id);
+            }
+            cout << (moved ? "\tmoved " : "\tinserted ") << nanosSince(start) / NUM_LOOKUPS;
+        }
+        cout << "\n";
+    }
+}
+
+// Name:    benchShared
+// Desc:    Times findShip on a Fleet against findShip on a SharedFleet mapping of it, and the time to publish it
+// Precon:  None
+// Postcon: Results are displayed to the user
+void benchShared()
+{
+    cout << BREAK << "SharedFleet vs Fleet (ns per lookup, us per publish)\n" << BREAK;
+    cout << "size\tFleet\tshared\tpublish\n";
+    const string name = "/fleet-bench-" + to_string(getpid());
+    for(int s = 0; s < NUM_SIZES; s++)
+    {
+        const int size = SIZES[s];
+        vector<ShipId> ids = uniqueIds(size);
+        vector<ShipId> lookups = lookupIds(ids, NUM_LOOKUPS);
+        Fleet fleet;
+        fillFleet(fleet, ids);
+        SharedFleet writer(name, size);
+        SharedFleet reader(name);
+        const int publishes = 20;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for(int i = 0; i < publishes; i++)
+        {
+            writer.publish(fleet);
+        }
+        double publishNanos = nanosSince(start) / publishes;
+        long long found = 0;
+        start = chrono::steady_clock::now();
+        for(ShipId id : lookups)
+        {
+            found += fleet.findShip(id);
+        }
+        double fleetNanos = nanosSince(start) / NUM_LOOKUPS;
+        start = chrono::steady_clock::now();
+        for(ShipId id : lookups)
+        {
+            found += reader.findShip(id);
+        }
+        double sharedNanos = nanosSince(start) / NUM_LOOKUPS;
+        cout << size << "\t" << fleetNanos << "\t" << sharedNanos << "\t" << publishNanos / 1000 << "\n";
+    }
+}
+
+// Name:    benchHashing
+// Desc:    Times filling a Fleet with and without hashing, then compares two Fleets that differ in a few Ships
+//          by walking both in full, by sameShips, and by diff
+// Precon:  None
+// Postcon: Results are displayed to the user
+void benchHashing()
+{
+    cout << BREAK << "Hashing (ms to fill, us to compare two Fleets differing in d Ships)\n" << BREAK;
+    if(!SUBTREE_HASHES)
+    {
+        cout << "Ships have no subtree hashes in this build, see make hashbench\n";
+        return;
+    }
+    cout << "size\tfill\thashed\td\twalk\tsame\tdiff\n";
+    for(int s = 0; s < NUM_SIZES; s++)
+    {
+        const int size = SIZES[s];
+        vector<ShipId> ids = uniqueIds(size);
+        Fleet plain;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        fillFleet(plain, ids);
+        const double fillNanos = nanosSince(start);
+        Fleet hashed;
+        hashed.setHashing(true);
+        start = chrono::steady_clock::now();
+        fillFleet(hashed, ids);
+        const double hashedNanos = nanosSince(start);
+        Fleet other;
+        other.setHashing(true);
+        vector<Ship> ships(size);
+        for(int i = 0; i < size; i++)
+        {
+            ships[i] = Ship(ids[i], hashed.find(ids[i])->getType(), ALIVE);
+        }
+        other.build(ships.data(), size);
+        for(int d : {1, 100})
+        {
+            for(int i = 0; i < d; i++)
+            {
+                other.setState(ids[i * (size / d)], LOST);
+            }
+            vector<ShipId> found;
+            start = chrono::steady_clock::now();
+            hashed.setHashing(false);
+            hashed.diff(other, found);
+            const double walkNanos = nanosSince(start);
+            hashed.setHashing(true);
+            start = chrono::steady_clock::now();
+            const bool same = hashed.sameShips(other);
+            const double sameNanos = nanosSince(start);
+            found.clear();
+            start = chrono::steady_clock::now();
+            hashed.diff(other, found);
+            const double diffNanos = nanosSince(start);
+            cout << size << "\t" << fillNanos / 1e6 << "\t" << hashedNanos / 1e6 << "\t" << found.size()
+                 << "\t" << walkNanos / 1000 << "\t" << sameNanos / 1000 << (same ? " (equal)" : "") << "\t" << diffNanos / 1000 << "\n";
+            for(int i = 0; i < d; i++)
+            {
+                other.setState(ids[i * (size / d)], ALIVE);
+            }
+        }
+    }
+}
+
+// Sent ahead of each batch of changes from the primary to the replica in benchReplication
+struct BatchHeader
+{
+    double madeNanos;       // When the batch's first change was made, on the steady clock
+    uint64_t sequence;      // Sequence of a snapshot
+    int count;              // Changes in the batch, or -1 to stop
+    bool snapshot;
+};
+
+// Name:    writeAll
+// Desc:    Writes all size bytes to a pipe, however many writes it takes
+// Precon:  fd must be open for writing
+// Postcon: Returns true if every byte was written
+bool writeAll(int fd, const void* data, size_t size)
+{
+    const char* bytes = (const char*) data;
+    while(size > 0)
+    {
+        ssize_t written = write(fd, bytes, size);
+        if(written <= 0)
+        {
+            return false;
+        }
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+// Name:    readAll
+// Desc:    Reads exactly size bytes from a pipe, however many reads it takes
+// Precon:  fd must be open for reading
+// Postcon: Returns true if every byte was read
+bool readAll(int fd, void* data, size_t size)
+{
+    char* bytes = (char*) data;
+    while(size > 0)
+    {
+        ssize_t got = read(fd, bytes, size);
+        if(got <= 0)
+        {
+            return false;
+        }
+        bytes += got;
+        size -= got;
+    }
+    return true;
+}
+
+// Name:    runReplica
+// Desc:    Replica side of benchReplication: catches up from the snapshot, then applies each batch,
+//          measuring the lag from when a batch's first change was made to when the replica has applied it
+// Precon:  fd must be the read end of the primary's pipe
+// Postcon: Lag percentiles are displayed to the user
+void runReplica(int fd, int batch)
+{
+    Fleet replica;
+    vector<Change> changes;
+    vector<double> lags;
+    BatchHeader header;
+    long long applied = 0;
+    bool inSync = true;
+    while(readAll(fd, &header, sizeof(header))
+        && header.count >= 0)
+    {
+        changes.resize(header.count);
+        readAll(fd, changes.data(), changes.size() * sizeof(Change));
+        if(header.snapshot)
+        {
+            replica.restore(changes.data(), changes.size(), header.sequence);
+            continue;
+        }
+        inSync = inSync && replica.applyChanges(changes.data(), changes.size()) == header.count;
+        applied += header.count;
+        lags.push_back(nanosSince(chrono::steady_clock::time_point(chrono::nanoseconds((long long) header.madeNanos))));
+    }
+    sort(lags.begin(), lags.end());
+    double mean = 0;
+    for(double lag : lags)
+    {
+        mean += lag;
+    }
+    mean /= max((size_t) 1, lags.size());
+    cout << batch << "\t" << applied << "\t" << mean / 1000 << "\t" << lags[lags.size() / 2] / 1000
+         << "\t" << lags[lags.size() * 99 / 100] / 1000 << "\t" << lags.back() / 1000
+         << (inSync ? "" : "\tOUT OF SYNC") << "\n";
+}
+
+// Name:    benchReplication
+// Desc:    Streams the changes of a primary Fleet under a constant mix of inserts, removals and state
+//          changes through a pipe to a replica in a second process, and measures the replica's lag
+// Precon:  None
+// Postcon: Results are displayed to the user
+void benchReplication()
+{
+    const int size = SIZES[NUM_SIZES - 1] / 2;
+    const int numOps = 1000000;
+    cout << BREAK << "Replicating " << numOps << " changes to a Fleet of " << size << " to another process (lag in us)\n" << BREAK;
+    cout << "batch\tchanges\tmean\tp50\tp99\tmax\n";
+    const int batches[] = {64, 512, 4096};
+    for(int batch : batches)
+    {
+        int fds[2];
+        if(pipe(fds) != 0)
+        {
+            return;
+        }
+        cout.flush();
+        pid_t child = fork();
+        if(child == 0)
+        {
+            close(fds[1]);
+            runReplica(fds[0], batch);
+            cout.flush();
+            _exit(0);
+        }
+        close(fds[0]);
+        Fleet primary;
+        vector<ShipId> ids = uniqueIds((int) min<ShipId>(MAXID - MINID + 1, 4 * size));
+        fillFleet(primary, vector<ShipId>(ids.begin(), ids.begin() + size));
+        primary.setChangeStream(true);
+        // The replica catches up from a snapshot before the stream starts
+        vector<Change> changes;
+        BatchHeader header = {0, primary.snapshot(changes), (int) changes.size(), true};
+        writeAll(fds[1], &header, sizeof(header));
+        writeAll(fds[1], changes.data(), changes.size() * sizeof(Change));
+        // Each op either inserts a new id and removes an old one, or changes a state
+        int next = size;
+        for(int op = 0; op < numOps; )
+        {
+            header = {(double) chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count(), 0, 0, false};
+            for(int i = 0; i < batch && op < numOps; i++, op++)
+            {
+                if(op % 2 == 0)
+                {
+                    primary.insert(Ship(ids[next % ids.size()]));
+                    primary.remove(ids[(next - size) % ids.size()]);
+                    next++;
+                }
+                else
+                {
+                    primary.setState(ids[(next - 1 - (int) (rng() % size)) % ids.size()], static_cast<STATE>((op >> 1) & 1));
+                }
+            }
+            changes.clear();
+            header.count = primary.takeChanges(changes);
+            writeAll(fds[1], &header, sizeof(header));
+            writeAll(fds[1], changes.data(), changes.size() * sizeof(Change));
+        }
+        header = {0, 0, -1, false};
+        writeAll(fds[1], &header, sizeof(header));
+        close(fds[1]);
+        waitpid(child, nullptr, 0);
+    }
+}
+
+// Name:    sumNaive
+// Desc:    Recursively adds up the ids in the subtree, the way an in-order scan walked without links would
+// Precon:  None
+// Postcon: Returns the sum of the subtree's ids
+long long sumNaive(const Ship* aShip)
+{
+    return (aShip != nullptr ? sumNaive(aShip->getLeft()) + aShip->getID() + sumNaive(aShip->getRight()) : 0);
+}
+
+// Name:    benchThreading
+// Desc:    Times filling a Fleet with and without threading, then scanning it in order: recursively,
+//          by successor without threading, which searches from the root for each Ship, and by successor
+//          along the threaded list, and exporting it with and without threading
+//          Scans run on the Ships where they were inserted, then again once both Fleets are moved to slabs in order of id
+// Precon:  None
+// Postcon: Results are displayed to the user
+void benchThreading()
+{
+    cout << BREAK << "Threading (ms to fill and export, ns per Ship to scan)\n" << BREAK;
+    if(!THREADED_LINKS)
+    {
+        cout << "Ships have no links to their neighbours in this build, see make threadbench\n";
+        return;
+    }
+    cout << "size\tfill\tthreaded\tstorage\trecurse\tsearch\tlinks\texport\tthreaded\n";
+    for(int s = 0; s < NUM_SIZES; s++)
+    {
+        const int size = SIZES[s];
+        vector<ShipId> ids = uniqueIds(size);
+        Fleet plain;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        fillFleet(plain, ids);
+        const double fillNanos = nanosSince(start);
+        Fleet threaded;
+        threaded.setThreading(true);
+        start = chrono::steady_clock::now();
+        fillFleet(threaded, ids);
+        const double threadedNanos = nanosSince(start);
+        for(PLACEMENT placement : {HEAP, SLABS})
+        {
+            if(placement == SLABS)
+            {
+                plain.setPlacement(SLABS);
+                threaded.setPlacement(SLABS);
+            }
+            // Each scan adds up the ids, so that none of them can be skipped
+            long long sums[3] = {0, 0, 0};
+            start = chrono::steady_clock::now();
+            sums[0] = sumNaive(plain.getRoot());
+            const double recurseNanos = nanosSince(start);
+            start = chrono::steady_clock::now();
+            for(const Ship* ship = plain.first(); ship != nullptr; ship = plain.successor(ship))
+            {
+                sums[1] += ship->getID();
+            }
+            const double searchNanos = nanosSince(start);
+            start = chrono::steady_clock::now();
+            for(const Ship* ship = threaded.first(); ship != nullptr; ship = threaded.successor(ship))
+            {
+                sums[2] += ship->getID();
+            }
+            const double linksNanos = nanosSince(start);
+            if(sums[0] != sums[1]
+                || sums[0] != sums[2])
+            {
+                cout << "scans disagree\n";
+            }
+            ostringstream out;
+            start = chrono::steady_clock::now();
+            plain.exportShips(out, BINARY);
+            const double exportNanos = nanosSince(start);
+            out.str("");
+            start = chrono::steady_clock::now();
+            threaded.exportShips(out, BINARY);
+            const double threadedExportNanos = nanosSince(start);
+            cout << size << "\t" << fillNanos / 1e6 << "\t" << threadedNanos / 1e6 << "\t" << (placement == HEAP ? "heap" : "slabs")
+                 << "\t" << recurseNanos / size << "\t" << searchNanos / size << "\t" << linksNanos / size
+                 << "\t" << exportNanos / 1e6 << "\t" << threadedExportNanos / 1e6 << "\n";
+        }
+    }
+}
+
+// Name:    benchBalance
+// Desc:    Runs the same traces on this build's balancing scheme, to be compared against the other build's:
+//          inserting Ships in random order, finding them, replacing Ships one at a time, and removing them all
+//          Reports the average and largest number of Ships visited to find a Ship, rotations per change,
+//          and time per operation
+// Precon:  None
+// Postcon: Results are displayed to the user
+void benchBalance()
+{
+    cout << BREAK << "Balancing: " << BALANCE_NAME << " (ns per operation, rotations per change)\n" << BREAK;
+    cout << "size\tdepth\tmax\tinsert\trot\tfind\treplace\trot\tremove\trot\n";
+    // At most half of the ids are used, so that replacements always have new ids to insert
+    for(int size : {1000, 10000, 45000})
+    {
+        // Every build draws the same trace from its own generator
+        mt19937 trace(size);
+        vector<ShipId> ids = uniqueIds(2 * size, trace);
+        vector<ShipId> lookups(NUM_LOOKUPS);
+        for(ShipId& id : lookups)
+        {
+            id = ids[trace() % size];
+        }
+        Fleet fleet;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for(int i = 0; i < size; i++)
+        {
+            fleet.insert(Ship(ids[i]));
+        }
+        const double insertNanos = nanosSince(start) / size;
+        const double insertRotations = (double) fleet.getRotations() / size;
+        // Depth of every Ship, counting the root as 1
+        long long totalDepth = 0;
+        int maxDepth = 0;
+        vector<pair<Ship*, int>> stack = {{fleet.getRoot(), 1}};
+        while(!stack.empty())
+        {
+            pair<Ship*, int> visit = stack.back();
+            stack.pop_back();
+            if(visit.first != nullptr)
+            {
+                totalDepth += visit.second;
+                maxDepth = max(maxDepth, visit.second);
+                stack.push_back({visit.first->getLeft(), visit.second + 1});
+                stack.push_back({visit.first->getRight(), visit.second + 1});
+            }
+        }
+        long long found = 0;
+        start = chrono::steady_clock::now();
+        for(ShipId id : lookups)
+        {
+            found += fleet.findShip(id);
+        }
+        const double findNanos = nanosSince(start) / NUM_LOOKUPS;
+        // Replace a random Ship with one that isn't in the Fleet, keeping the size
+        long long rotations = fleet.getRotations();
+        start = chrono::steady_clock::now();
+        for(int i = 0; i < size; i++)
+        {
+            const int slot = trace() % size;
+            fleet.remove(ids[slot]);
+            fleet.insert(Ship(ids[size + i]));
+            ids[slot] = ids[size + i];
+        }
+        const double replaceNanos = nanosSince(start) / (2 * size);
+        const double replaceRotations = (double) (fleet.getRotations() - rotations) / (2 * size);
+        shuffle(ids.begin(), ids.begin() + size, trace);
+        rotations = fleet.getRotations();
+        start = chrono::steady_clock::now();
+        for(int i = 0; i < size; i++)
+        {
+            fleet.remove(ids[i]);
+        }
+        const double removeNanos = nanosSince(start) / size;
+        const double removeRotations = (double) (fleet.getRotations() - rotations) / size;
+        cout << size << "\t" << (double) totalDepth / size << "\t" << maxDepth << "\t" << insertNanos << "\t" << insertRotations
+             << "\t" << findNanos << "\t" << replaceNanos << "\t" << replaceRotations << "\t" << removeNanos << "\t" << removeRotations << "\n";
+    }
+}
+
+// Name:    benchWide
+// Desc:    Times building Fleets of millions of Ships whose ids are spread over the whole id range, then looking
+//          them up through the tree, the search layout and findMany, and replacing Ships one at a time
+//          Run as "bench.exe wide" in a build with wide ids, against a build with int ids over a wide range,
+//          to see what 64 bit ids cost; sizes the id range can't hold twice over are skipped
+// Precon:  None
+// Postcon: Results are displayed to the user
+void benchWide()
+{
+    const int numReplaces = 200000;
+    const int batchSize = 4096;
+    cout << BREAK << sizeof(ShipId) * 8 << " bit ids over [" << MINID << ", " << MAXID << "] (ms to build, ns per op)\n" << BREAK;
+    cout << "size\tbuild\tfind\tlayout\tmany\treplace\tbytes per Ship\n";
+    for(int size : {1000000, 10000000})
+    {
+        if((uint64_t) (MAXID - MINID) + 1 < 2 * (uint64_t) size)
+        {
+            continue;
+        }
+        // The second half of the ids are new ids for the replacements
+        vector<ShipId> ids = uniqueIds(2 * size);
+        vector<Ship> ships(size);
+        for(int i = 0; i < size; i++)
+        {
+            ships[i] = Ship(ids[i], static_cast<SHIPTYPE>(rng() % 5), ALIVE);
+        }
+        Fleet fleet;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        fleet.build(ships.data(), size);
+        const double buildNanos = nanosSince(start);
+        vector<Ship>().swap(ships);
+        vector<ShipId> lookups(NUM_LOOKUPS);
+        for(int i = 0; i < NUM_LOOKUPS; i++)
+        {
+            lookups[i] = (i % 2 == 0 ? ids[rng() % size] : randomId());
+        }
+        long long found = 0;
+        double times[2];
+        // Time the tree first, then the layout
+        for(int layout = 0; layout < 2; layout++)
+        {
+            fleet.setSearchLayout(layout == 1);
+            fleet.findShip(MINID);
+            start = chrono::steady_clock::now();
+            for(ShipId id : lookups)
+            {
+                found += fleet.findShip(id);
+            }
+            times[layout] = nanosSince(start) / NUM_LOOKUPS;
+        }
+        bool results[batchSize];
+        start = chrono::steady_clock::now();
+        for(int i = 0; i < NUM_LOOKUPS; i += batchSize)
+        {
+            found += fleet.findMany(lookups.data() + i, min(batchSize, NUM_LOOKUPS - i), results);
+        }
+        const double manyNanos = nanosSince(start) / NUM_LOOKUPS;
+        fleet.setSearchLayout(false);
+        start = chrono::steady_clock::now();
+        for(int i = 0; i < numReplaces; i++)
+        {
+            fleet.remove(ids[i]);
+            fleet.insert(Ship(ids[size + i]));
+        }
+        const double replaceNanos = nanosSince(start) / numReplaces;
+        cout << size << "\t" << buildNanos / 1e6 << "\t" << times[0] << "\t" << times[1] << "\t" << manyNanos
+             << "\t" << replaceNanos << "\t" << (double) fleet.memoryUsage().total() / fleet.getSize() << "\t(" << found << " found)\n";
+    }
+}
+
+// Name:    benchArchive
+// Desc:    Archives Fleets of each size, and of a million Ships where the id range holds them, and reports
+//          the archive's size against the binary export, the time to write it, and the time to load it
+//          whole and to load 1% of its id range, against building the same Fleet from an array of Ships
+// Precon:  None
+// Postcon: Results are displayed to the user
+void benchArchive()
+{
+    const int repeats = 5;
+    cout << BREAK << "Archives (bytes per Ship, ms to write, load and build, ns per Ship to load)\n" << BREAK;
+    cout << "size\tbinary\tarchive\tratio\twrite\tload\tns\tbuild\t1% load\n";
+    vector<int> sizes(SIZES, SIZES + NUM_SIZES);
+    if((uint64_t) (MAXID - MINID) + 1 >= 2000000)
+    {
+        sizes.push_back(1000000);
+    }
+    for(int size : sizes)
+    {
+        vector<ShipId> ids = uniqueIds(size);
+        vector<Ship> ships(size);
+        for(int i = 0; i < size; i++)
+        {
+            ships[i] = Ship(ids[i], static_cast<SHIPTYPE>(rng() % 5), static_cast<STATE>(rng() % 4 == 0));
+        }
+        Fleet fleet;
+        fleet.build(ships.data(), size);
+        ostringstream binary;
+        fleet.exportShips(binary, BINARY);
+        ostringstream archive;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        fleet.writeArchive(archive);
+        const double writeNanos = nanosSince(start);
+        const string bytes = archive.str();
+        double loadNanos = 0;
+        double buildNanos = 0;
+        double rangeNanos = 0;
+        for(int i = 0; i < repeats; i++)
+        {
+            Fleet loaded;
+            istringstream in(bytes);
+            start = chrono::steady_clock::now();
+            loaded.loadArchive(in);
+            loadNanos += nanosSince(start) / repeats;
+            Fleet built;
+            start = chrono::steady_clock::now();
+            built.build(ships.data(), size);
+            buildNanos += nanosSince(start) / repeats;
+            if(loaded.getSize() != built.getSize())
+            {
+                cout << "archive lost Ships\n";
+            }
+            // A random 1% of the id range
+            const ShipId span = (MAXID - MINID) / 100;
+            const ShipId low = MINID + (ShipId) (rng() % (uint64_t) (MAXID - MINID - span));
+            Fleet range;
+            istringstream rangeIn(bytes);
+            start = chrono::steady_clock::now();
+            range.loadArchive(rangeIn, low, low + span);
+            rangeNanos += nanosSince(start) / repeats;
+        }
+        cout << size << "\t" << (double) binary.str().size() / size << "\t" << (double) bytes.size() / size
+             << "\t" << (double) binary.str().size() / bytes.size() << "\t" << writeNanos / 1e6 << "\t" << loadNanos / 1e6
+             << "\t" << loadNanos / size << "\t" << buildNanos / 1e6 << "\t" << rangeNanos / 1e6 << "\n";
+    }
+}
+
+// Name:    benchDense
+// Desc:    Times a DenseFleet against a Fleet at several fill densities of the DenseFleet's id range:
+//          findShip and setState on random ids, exporting in order, counting a type, and removeLost
+//          with half the Ships lost, along with the bytes each takes per Ship
+//          Skipped in builds whose id range is wider than a DenseFleet holds
+// Precon:  None
+// Postcon: Results are displayed to the user
+void benchDense()
+{
+    const int repeats = 50;
+    cout << BREAK << "DenseFleet against Fleet (ns per lookup, ms to export and removeLost, us to count a type)\n" << BREAK;
+    if((uint64_t) (MAXID - MINID) + 1 > (uint64_t) DENSE_MAX_RANGE)
+    {
+        cout << "id range is wider than a DenseFleet holds, skipped\n";
+        return;
+    }
+    const int range = (int) (MAXID - MINID + 1);
+    cout << "fill	size	find	dense	set	dense	export	dense	count	dense	remove	dense	bytes	dense\n";
+    for(int percent : {1, 10, 50, 100})
+    {
+        const int size = (int) ((long long) range * percent / 100);
+        vector<ShipId> ids = uniqueIds(size);
+        vector<Ship> ships(size);
+        for(int i = 0; i < size; i++)
+        {
+            ships[i] = Ship(ids[i], static_cast<SHIPTYPE>(rng() % 5), ALIVE);
+        }
+        Fleet fleet;
+        fleet.build(ships.data(), size);
+        DenseFleet dense;
+        dense.build(ships.data(), size);
+        const double bytes[2] = {(double) fleet.memoryUsage().total() / size, (double) dense.memoryUsage().total() / size};
+        vector<ShipId> lookups = lookupIds(ids, NUM_LOOKUPS);
+        long long found = 0;
+        double findNanos[2], setNanos[2], exportNanos[2], countNanos[2], removeNanos[2];
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for(ShipId id : lookups)
+        {
+            found += fleet.findShip(id);
+        }
+        findNanos[0] = nanosSince(start) / NUM_LOOKUPS;
+        start = chrono::steady_clock::now();
+        for(ShipId id : lookups)
+        {
+            found += dense.findShip(id);
+        }
+        findNanos[1] = nanosSince(start) / NUM_LOOKUPS;
+        // Alternate states so that each setState writes
+        start = chrono::steady_clock::now();
+        for(int i = 0; i < NUM_LOOKUPS; i++)
+        {
+            found += fleet.setState(lookups[i], static_cast<STATE>(i & 1));
+        }
+        setNanos[0] = nanosSince(start) / NUM_LOOKUPS;
+        start = chrono::steady_clock::now();
+        for(int i = 0; i < NUM_LOOKUPS; i++)
+        {
+            found += dense.setState(lookups[i], static_cast<STATE>(i & 1));
+        }
+        setNanos[1] = nanosSince(start) / NUM_LOOKUPS;
+        ostringstream out;
+        start = chrono::steady_clock::now();
+        fleet.exportShips(out, BINARY);
+        exportNanos[0] = nanosSince(start);
+        const string fromFleet = out.str();
+        out.str("");
+        start = chrono::steady_clock::now();
+        dense.exportShips(out, BINARY);
+        exportNanos[1] = nanosSince(start);
+        if(out.str() != fromFleet)
+        {
+            cout << "exports disagree\n";
+        }
+        start = chrono::steady_clock::now();
+        for(int i = 0; i < repeats; i++)
+        {
+            found += fleet.parallelReduce(0, [](const Ship& ship) {return (int) (ship.getType() == FUELCARRIER);}, plus<int>());
+        }
+        countNanos[0] = nanosSince(start) / repeats;
+        start = chrono::steady_clock::now();
+        for(int i = 0; i < repeats; i++)
+        {
+            found += dense.countType(FUELCARRIER);
+        }
+        countNanos[1] = nanosSince(start) / repeats;
+        for(int i = 0; i < size; i++)
+        {
+            fleet.setState(ids[i], static_cast<STATE>(i & 1));
+            dense.setState(ids[i], static_cast<STATE>(i & 1));
+        }
+        start = chrono::steady_clock::now();
+        fleet.removeLost();
+        removeNanos[0] = nanosSince(start);
+        start = chrono::steady_clock::now();
+        dense.removeLost();
+        removeNanos[1] = nanosSince(start);
+        if(fleet.getSize() != dense.getSize())
+        {
+            cout << "removeLost disagrees\n";
+        }
+        cout << percent << "%\t" << size << "\t" << findNanos[0] << "\t" << findNanos[1] << "\t" << setNanos[0] << "\t" << setNanos[1]
+             << "\t" << exportNanos[0] / 1e6 << "\t" << exportNanos[1] / 1e6 << "\t" << countNanos[0] / 1000 << "\t" << countNanos[1] / 1000
+             << "\t" << removeNanos[0] / 1e6 << "\t" << removeNanos[1] / 1e6 << "\t" << bytes[0] << "\t" << bytes[1]
+             << "\t(" << found << " found)\n";
+    }
+}
+
+// Name:    benchHeartbeats
+// Desc:    Simulates the largest Fleet's Ships each sending a heartbeat once a second, at their own offset
+//          into the second, with 1% of them falling silent along the way, and times finding the silent Ships
+//          every 100 and every 10 ms: by scanning every Ship's last heartbeat and calling setState on the
+//          stale ones, against heartbeat and advance on the Fleet's timing wheel, by id and by handle
+//          Times are in ms, as a caller would count them
+// Precon:  None
+// Postcon: Results are displayed to the user
+void benchHeartbeats()
+{
+    const int size = SIZES[NUM_SIZES - 1];
+    const uint64_t second = 1000;
+    const uint64_t timeout = 3 * second;
+    const uint64_t duration = 30 * second;
+    cout << BREAK << "Heartbeat expiry, " << size << " Ships beating once a second for " << duration / second
+         << " s, lost after " << timeout / second << " s (ns per heartbeat, us per check)\n" << BREAK;
+    cout << "every\tmethod\tbeat\tcheck\tLOST\n";
+    vector<ShipId> ids = uniqueIds(size);
+    // Ships by the ms into each second that they beat, and when each falls silent, never for most
+    vector<vector<int>> beating(second);
+    vector<uint64_t> silent(size, numeric_limits<uint64_t>::max());
+    for(int i = 0; i < size; i++)
+    {
+        beating[rng() % second].push_back(i);
+        if(i % 100 == 0)
+        {
+            silent[i] = second + rng() % (duration - timeout - 2 * second);
+        }
+    }
+    for(uint64_t every : {100, 10})
+    {
+        for(int method = 0; method < 3; method++)
+        {
+            const bool wheel = method > 0;
+            Fleet fleet;
+            fillFleet(fleet, ids);
+            fleet.setHeartbeats(wheel, timeout);
+            vector<const Ship*> handles(size);
+            for(int i = 0; i < size; i++)
+            {
+                handles[i] = fleet.find(ids[i]);
+            }
+            vector<uint64_t> last(size, 0);
+            vector<bool> lost(size, false);
+            double beatNanos = 0;
+            double checkNanos = 0;
+            long long beats = 0;
+            int checks = 0;
+            int expired = 0;
+            for(uint64_t now = 0; now < duration; now++)
+            {
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                for(int i : beating[now % second])
+                {
+                    if(now < silent[i])
+                    {
+                        beats++;
+                        if(method == 1)
+                        {
+                            fleet.heartbeat(ids[i], now);
+                        }
+                        else if(method == 2)
+                        {
+                            fleet.heartbeat(handles[i], now);
+                        }
+                        else
+                        {
+                            last[i] = now;
+                        }
+                    }
+                }
+                beatNanos += nanosSince(start);
+                if(now % every == 0)
+                {
+                    checks++;
+                    start = chrono::steady_clock::now();
+                    if(wheel)
+                    {
+                        expired += fleet.advance(now);
+                    }
+                    else
+                    {
+                        // Ships only count once they have sent a heartbeat, as with the wheel
+                        for(int i = 0; i < size; i++)
+                        {
+                            if(!lost[i]
+                                && now >= silent[i]
+                                && now - last[i] >= timeout)
+                            {
+                                lost[i] = true;
+                                fleet.setState(ids[i], LOST);
+                                expired++;
+                            }
+                        }
+                    }
+                    checkNanos += nanosSince(start);
+                }
+            }
+            cout << every << " ms\t" << (method == 0 ? "scan" : (method == 1 ? "wheel" : "handles")) << "\t" << beatNanos / beats << "\t"
+                 << checkNanos / 1000 / checks << "\t" << expired << "\n";
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    // "balance" runs just the balancing traces, for comparing builds with different schemes
+    if(argc > 1
+        && string(argv[1]) == "balance")
+    {
+        benchBalance();
+        cout << BREAK;
+        return 0;
+    }
+    // "wide" runs just the sparse id benchmark, for comparing builds with different id widths
+    if(argc > 1
+        && string(argv[1]) == "wide")
+    {
+        benchWide();
+        cout << BREAK;
+        return 0;
+    }
+    // "archive" runs just the archive benchmark
+    if(argc > 1
+        && string(argv[1]) == "archive")
+    {
+        benchArchive();
+        cout << BREAK;
+        return 0;
+    }
+    // "dense" runs just the DenseFleet comparison
+    if(argc > 1
+        && string(argv[1]) == "dense")
+    {
+        benchDense();
+        cout << BREAK;
+        return 0;
+    }
+    // "hashing" runs just the hashing benchmark, for builds with subtree hashes
+    if(argc > 1
+        && string(argv[1]) == "hashing")
+    {
+        benchHashing();
+        cout << BREAK;
+        return 0;
+    }
+    // "threading" runs just the threading benchmark, for builds with threaded links
+    if(argc > 1
+        && string(argv[1]) == "threading")
+    {
+        benchThreading();
+        cout << BREAK;
+        return 0;
+    }
+    // "heartbeats" runs just the heartbeat expiry comparison
+    if(argc > 1
+        && string(argv[1]) == "heartbeats")
+    {
+        benchHeartbeats();
+        cout << BREAK;
+        return 0;
+    }
+    benchFindShip();
+    benchFindMany();
+    benchReadHeavy();
+    benchMassLoss();
+    benchBurstRemove();
+    benchExport();
+    benchArchive();
+    benchBuild();
+    benchAnalytics();
+    benchRemoveLost();
+    benchHeartbeats();
+    benchFinger();
+    benchCache();
+    benchHandles();
+    benchMemory();
+    benchPlacement();
+    benchShared();
+    benchHashing();
+    benchReplication();
+    benchThreading();
+    benchBalance();
+    benchDense();
+    cout << BREAK;
+}
@@ -11,12 +11,723 @@
  */
 
 #include "fleet.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <new>
+#include <string_view>
+#include <thread>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#endif
+#ifdef __unix__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Number of searches findMany keeps in flight at once
+const int FIND_GROUP = 16;
+// Fewest Ships worth handing to another thread
+const int PARALLEL_GRAIN = 4096;
+// Names of each enum's values, written without building a string per Ship
+const string_view STATE_NAMES[] = {"ALIVE", "LOST"};
+const string_view TYPE_NAMES[] = {"CARGO", "TELESCOPE", "COMMUNICATOR", "FUELCARRIER", "ROBOCARRIER"};
+const string_view COLOR_NAMES[] = {"RED", "BLACK", "DOUBLEBLACK"};
+// Wide builds use their own headers, since their ids take 8 bytes
+#ifdef FLEET_WIDE_IDS
+// Header of the binary export, followed by the number of Ships
+const char BINARY_MAGIC[4] = {'F', 'L', 'T', '8'};
+// Header of a SharedFleet's region
+const char SHARED_MAGIC[8] = {'F', 'L', 'T', 'S', 'Q', '8', '\0', '\0'};
+// Header of an archive
+const char ARCHIVE_MAGIC[4] = {'F', 'L', 'A', '8'};
+// Header of a trace
+const char TRACE_MAGIC[4] = {'F', 'T', 'R', '8'};
+#else
+// Header of the binary export, followed by the number of Ships
+const char BINARY_MAGIC[4] = {'F', 'L', 'T', '1'};
+// Header of a SharedFleet's region
+const char SHARED_MAGIC[8] = {'F', 'L', 'T', 'S', 'Q', '1', '\0', '\0'};
+// Header of an archive
+const char ARCHIVE_MAGIC[4] = {'F', 'L', 'A', '1'};
+// Header of a trace
+const char TRACE_MAGIC[4] = {'F', 'T', 'R', '1'};
+#endif
+// Bytes of encoded calls a trace collects before writing them out
+const size_t TRACE_BUFFER = 1 << 16;
+// Most problems validate lists before summarizing the rest
+const int MAX_PROBLEMS = 10;
+
+// Ship allocation counters, updated by every thread that allocates Ships
+atomic<long long> shipAllocations(0);
+atomic<long long> shipDeallocations(0);
+atomic<long long> shipBytes(0);
+// Held while a read rebuilds a search layout, shared by every Fleet since rebuilds are rare
+mutex layoutLock;
+
+// Output buffer for writing Ships to a stream
+// Output collects here and is written to the stream in large blocks, never flushed per line
+class ShipWriter
+{
+    public:
+        ShipWriter(ostream& out) : m_out(out), m_used(0){}
+        ~ShipWriter() {flush();}
+        void write(const char* data, int size)
+        {
+            if(m_used + size > BUFFER_SIZE)
+            {
+                flush();
+            }
+            memcpy(m_buffer + m_used, data, size);
+            m_used += size;
+        }
+        void write(string_view text) {write(text.data(), text.size());}
+        void write(char c) {write(&c, 1);}
+        void writeInt(long long value)
+        {
+            char digits[24];
+            write(digits, to_chars(digits, digits + sizeof(digits), value).ptr - digits);
+        }
+        void flush()
+        {
+            m_out.write(m_buffer, m_used);
+            m_used = 0;
+        }
+    private:
+        static const int BUFFER_SIZE = 1 << 16;
+        ostream& m_out;
+        char m_buffer[BUFFER_SIZE];
+        int m_used;
+};
+
+// Packs values of any width up to 64 bits into bytes, lowest bits first, for archives
+class BitPacker
+{
+    public:
+        BitPacker(vector<uint8_t>& bytes) : m_bytes(bytes), m_buffer(0), m_bits(0){}
+        // Appends the low bits bits of value
+        void put(uint64_t value, int bits)
+        {
+            if(bits > 32)
+            {
+                put(value & 0xFFFFFFFF, 32);
+                put(value >> 32, bits - 32);
+                return;
+            }
+            m_buffer |= (value & ((1ULL << bits) - 1)) << m_bits;
+            m_bits += bits;
+            while(m_bits >= 8)
+            {
+                m_bytes.push_back((uint8_t) m_buffer);
+                m_buffer >>= 8;
+                m_bits -= 8;
+            }
+        }
+        // Pads the last byte with zeros, so that the next column starts on a byte
+        void finish()
+        {
+            if(m_bits > 0)
+            {
+                m_bytes.push_back((uint8_t) m_buffer);
+            }
+            m_buffer = 0;
+            m_bits = 0;
+        }
+    private:
+        vector<uint8_t>& m_bytes;
+        uint64_t m_buffer;
+        int m_bits;
+};
+
+// Reads back values packed by BitPacker, refilling a word at a time while 8 bytes remain
+// Reading past the end gives zeros and marks the unpacker as overrun
+class BitUnpacker
+{
+    public:
+        BitUnpacker(const uint8_t* next, const uint8_t* end) : m_next(next), m_end(end), m_buffer(0), m_bits(0), m_overrun(false){}
+        uint64_t get(int bits)
+        {
+            if(bits > 32)
+            {
+                const uint64_t low = get(32);
+                return low | get(bits - 32) << 32;
+            }
+            if(m_bits < bits)
+            {
+                refill(bits);
+            }
+            const uint64_t value = m_buffer & ((1ULL << bits) - 1);
+            m_buffer >>= bits;
+            m_bits -= bits;
+            return value;
+        }
+        // Skips the padding after a column
+        void finish()
+        {
+            m_next -= m_bits / 8;
+            m_buffer = 0;
+            m_bits = 0;
+        }
+        bool overrun() const {return m_overrun;}
+    private:
+        const uint8_t* m_next;
+        const uint8_t* m_end;
+        uint64_t m_buffer;
+        int m_bits;
+        bool m_overrun;
+
+        // Loads 8 bytes while they remain, else loads a byte at a time until bits bits are held
+        // m_next always points to the byte that starts after the last bit held
+        void refill(int bits)
+        {
+            if(m_end - m_next >= 8)
+            {
+                uint64_t word;
+                memcpy(&word, m_next, sizeof(word));
+                m_buffer |= word << m_bits;
+                m_next += (63 - m_bits) / 8;
+                m_bits |= 56;
+            }
+            while(m_bits < bits)
+            {
+                if(m_next < m_end)
+                {
+                    m_buffer |= (uint64_t) *m_next++ << m_bits;
+                }
+                else
+                {
+                    m_overrun = true;
+                }
+                m_bits += 8;
+            }
+        }
+};
+
+// Storage for a Fleet's Ships in large slabs, placed as the Fleet's PLACEMENT and NUMA_POLICY ask
+// Freed Ships go on a free list to be reused, and memory is only returned when every Ship is released
+// Placement is best effort: if the kernel refuses huge pages or a NUMA policy, the slab is used as is
+class ShipSlabs
+{
+    public:
+        ShipSlabs(PLACEMENT placement, NUMA_POLICY numa, int node)
+            : m_placement(placement), m_numa(numa), m_node(node), m_next(nullptr), m_end(nullptr), m_free(nullptr), m_reserved(0){}
+        ~ShipSlabs() {release();}
+        // Returns memory for count Ships in a row
+        Ship* allocate(int count = 1)
+        {
+            lock_guard<mutex> guard(m_lock);
+            if(count == 1
+                && m_free != nullptr)
+            {
+                Ship* ship = m_free;
+                m_free = ship->m_left;
+                return ship;
+            }
+            const size_t bytes = count * sizeof(Ship);
+            // Start a new slab when the current one can't hold the Ships, the rest of it stays unused
+            if(m_next == nullptr
+                || (size_t) (m_end - m_next) < bytes)
+            {
+                const size_t size = (bytes + SLAB_SIZE - 1) / SLAB_SIZE * SLAB_SIZE;
+                m_next = mapSlab(size);
+                m_end = m_next + size;
+            }
+            Ship* ships = (Ship*) m_next;
+            m_next += bytes;
+            return ships;
+        }
+        // Puts a Ship's memory on the free list, linked through its m_left
+        void free(Ship* ship)
+        {
+            ship->~Ship();
+            lock_guard<mutex> guard(m_lock);
+            ship->m_left = m_free;
+            m_free = ship;
+        }
+        // Returns every slab, and with it every Ship
+        void release()
+        {
+            for(const pair<char*, size_t>& slab : m_slabs)
+            {
+                unmapSlab(slab.first, slab.second);
+            }
+            m_slabs.clear();
+            m_next = m_end = nullptr;
+            m_free = nullptr;
+            m_reserved = 0;
+        }
+        long long getReserved() const {return m_reserved;}
+        PLACEMENT getPlacement() const {return m_placement;}
+    private:
+        // Slabs are a multiple of the usual huge page size
+        static const size_t SLAB_SIZE = 2 << 20;
+        PLACEMENT m_placement;
+        NUMA_POLICY m_numa;
+        int m_node;
+        vector<pair<char*, size_t>> m_slabs;
+        char* m_next;
+        char* m_end;
+        Ship* m_free;
+        long long m_reserved;
+        mutex m_lock;
+
+        // Maps a slab of size bytes, aligned to SLAB_SIZE so that it can be backed by huge pages
+        char* mapSlab(size_t size)
+        {
+            char* slab;
+#ifdef __linux__
+            // Over-map by one slab, then trim both ends down to an aligned range
+            char* mapped = (char*) mmap(nullptr, size + SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if(mapped == MAP_FAILED)
+            {
+                throw bad_alloc();
+            }
+            slab = (char*) (((uintptr_t) mapped + SLAB_SIZE - 1) & ~(uintptr_t) (SLAB_SIZE - 1));
+            if(slab != mapped)
+            {
+                munmap(mapped, slab - mapped);
+            }
+            munmap(slab + size, mapped + SLAB_SIZE - slab);
+            if(m_placement == HUGE_SLABS)
+            {
+                madvise(slab, size, MADV_HUGEPAGE);
+            }
+            // The policy has to be set before the pages are first touched
+            if(m_numa != NUMA_DEFAULT)
+            {
+                vector<unsigned long> mask = onlineNodes();
+                const size_t bits = sizeof(unsigned long) * 8;
+                // Only bind to a node that is online, else the slab is left wherever it's first touched
+                const bool online = m_node >= 0
+                    && (size_t) m_node / bits < mask.size()
+                    && (mask[m_node / bits] >> (m_node % bits) & 1);
+                if(m_numa == NUMA_BIND
+                    && online)
+                {
+                    mask.assign(mask.size(), 0);
+                    mask[m_node / bits] = 1UL << (m_node % bits);
+                }
+                if(m_numa == NUMA_INTERLEAVE
+                    || online)
+                {
+                    // The kernel reads one bit less than the count it's passed
+                    syscall(SYS_mbind, slab, size, (m_numa == NUMA_BIND ? MPOL_BIND : MPOL_INTERLEAVE), mask.data(), mask.size() * bits + 1, 0);
+                }
+            }
+#else
+            slab = (char*) ::operator new(size, align_val_t(SLAB_SIZE));
+#endif
+            m_slabs.emplace_back(slab, size);
+            m_reserved += size;
+            return slab;
+        }
+        void unmapSlab(char* slab, size_t size)
+        {
+#ifdef __linux__
+            munmap(slab, size);
+#else
+            ::operator delete(slab, align_val_t(SLAB_SIZE));
+#endif
+        }
+#ifdef __linux__
+        // Reads the NUMA nodes that are online as a bit mask, one word per 64 nodes, or node 0 alone if they can't be read
+        static vector<unsigned long> onlineNodes()
+        {
+            const size_t bits = sizeof(unsigned long) * 8;
+            vector<unsigned long> mask;
+            ifstream file("/sys/devices/system/node/online");
+            int first, last;
+            char separator;
+            while(file >> first)
+            {
+                last = first;
+                if(file.peek() == '-')
+                {
+                    file >> separator >> last;
+                }
+                if(first < 0
+                    || last < first)
+                {
+                    break;
+                }
+                if(mask.size() <= (size_t) last / bits)
+                {
+                    mask.resize(last / bits + 1, 0);
+                }
+                for(int node = first; node <= last; node++)
+                {
+                    mask[node / bits] |= 1UL << (node % bits);
+                }
+                file >> separator;
+            }
+            if(mask.empty())
+            {
+                mask.push_back(1);
+            }
+            return mask;
+        }
+#endif
+};
+
+// Heartbeat deadlines of a Fleet's Ships in a hierarchical timing wheel
+// Level k has SLOTS slots of SLOTS^k ticks each, and a deadline sits on the level of the highest digit, in base SLOTS,
+// in which it differs from the wheel's time, in the slot of its own digit there
+// Level 0 then holds the deadlines due within the current SLOTS ticks, and each level above holds later ones, so
+// the next due slot is the first occupied one at or past the current digit on the lowest level that has one
+// Once time reaches a slot above level 0, its deadlines are either due or move down to a lower level
+// Deadlines are kept in one array, linked both ways through their slots, so moving or dropping one takes constant time
+class HeartbeatWheel
+{
+    public:
+        HeartbeatWheel(uint64_t timeout) : m_timeout(timeout), m_now(0), m_free(NO_DEADLINE), m_count(0) {reset();}
+        // Drops every deadline without touching the Ships, for when they have all been deallocated
+        void reset()
+        {
+            fill(&m_heads[0][0], &m_heads[0][0] + LEVELS * SLOTS, NO_DEADLINE);
+            fill(m_occupied, m_occupied + LEVELS, 0);
+            m_timers.clear();
+            m_free = NO_DEADLINE;
+            m_count = 0;
+        }
+        // Drops every deadline, marking each Ship as having none
+        void forget()
+        {
+            for(Timer& timer : m_timers)
+            {
+                if(timer.ship != nullptr)
+                {
+                    timer.ship->m_timer = NO_DEADLINE;
+                }
+            }
+            reset();
+        }
+        // Sets the Ship's deadline to the timeout after now, replacing any deadline it had
+        // A deadline already behind the wheel's time is due at the next advance
+        void schedule(Ship* ship, uint64_t now)
+        {
+            uint32_t index = ship->m_timer;
+            // With no other deadlines to pass, the wheel can skip straight to now
+            if(m_count == (index != NO_DEADLINE ? 1 : 0))
+            {
+                m_now = max(m_now, now);
+            }
+            const uint64_t deadline = max(m_now, (now > numeric_limits<uint64_t>::max() - m_timeout ? numeric_limits<uint64_t>::max() : now + m_timeout));
+            if(index != NO_DEADLINE)
+            {
+                // A deadline that stays in its slot only needs its new time
+                Timer& timer = m_timers[index];
+                if(levelOf(deadline) == timer.level
+                    && (deadline ^ timer.deadline) >> (timer.level * SLOT_BITS) == 0)
+                {
+                    timer.deadline = deadline;
+                    return;
+                }
+                unlink(index);
+            }
+            else
+            {
+                if(m_free != NO_DEADLINE)
+                {
+                    index = m_free;
+                    m_free = m_timers[index].next;
+                }
+                else
+                {
+                    index = m_timers.size();
+                    m_timers.emplace_back();
+                }
+                m_timers[index].ship = ship;
+                ship->m_timer = index;
+                m_count++;
+            }
+            m_timers[index].deadline = deadline;
+            link(index);
+        }
+        // Drops the Ship's deadline
+        void unschedule(Ship* ship)
+        {
+            unlink(ship->m_timer);
+            release(ship->m_timer);
+            ship->m_timer = NO_DEADLINE;
+        }
+        // Moves the wheel's time up to now, appending the Ships whose deadlines have passed to due
+        // Their deadlines are dropped, and only deadlines within the slots reached are touched
+        void advance(uint64_t now, vector<Ship*>& due)
+        {
+            while(true)
+            {
+                // Find the first occupied slot at or past the current digit, on the lowest level with one
+                int level = 0;
+                uint64_t pending = 0;
+                for(; level < LEVELS && pending == 0; level++)
+                {
+                    pending = m_occupied[level] & (~0ULL << ((m_now >> (level * SLOT_BITS)) & (SLOTS - 1)));
+                }
+                if(pending == 0)
+                {
+                    break;
+                }
+                level--;
+                const int slot = __builtin_ctzll(pending);
+                const int shift = level * SLOT_BITS;
+                const int above = shift + SLOT_BITS;
+                const uint64_t start = (above < 64 ? m_now >> above << above : 0) | (uint64_t) slot << shift;
+                if(start > now)
+                {
+                    break;
+                }
+                m_now = start;
+                uint32_t index = m_heads[level][slot];
+                m_heads[level][slot] = NO_DEADLINE;
+                m_occupied[level] &= ~(1ULL << slot);
+                while(index != NO_DEADLINE)
+                {
+                    Timer& timer = m_timers[index];
+                    const uint32_t next = timer.next;
+                    if(timer.deadline <= now)
+                    {
+                        due.push_back(timer.ship);
+                        timer.ship->m_timer = NO_DEADLINE;
+                        release(index);
+                    }
+                    else
+                    {
+                        link(index);
+                    }
+                    index = next;
+                }
+            }
+            m_now = max(m_now, now);
+        }
+        // Points the Ship's deadline at the Ship after it has been moved to new storage
+        void moved(Ship* ship) {m_timers[ship->m_timer].ship = ship;}
+        // Whether the Ship's deadline is one the wheel holds for it
+        bool holds(const Ship* ship) const {return ship->m_timer < m_timers.size() && m_timers[ship->m_timer].ship == ship;}
+        void setTimeout(uint64_t timeout) {m_timeout = timeout;}
+        int getCount() const {return m_count;}
+        long long getBytes() const {return sizeof(HeartbeatWheel) + m_timers.capacity() * sizeof(Timer);}
+    private:
+        static const int SLOT_BITS = 6;
+        static const int SLOTS = 1 << SLOT_BITS;
+        static const int LEVELS = (64 + SLOT_BITS - 1) / SLOT_BITS;
+        // A Ship's deadline, linked into its slot, or into the free list through next once dropped
+        struct Timer
+        {
+            uint64_t deadline;
+            Ship* ship;
+            uint32_t prev;
+            uint32_t next;
+            uint8_t level;
+        };
+        uint64_t m_timeout;
+        uint64_t m_now;
+        vector<Timer> m_timers;
+        uint32_t m_free;
+        int m_count;
+        uint32_t m_heads[LEVELS][SLOTS];
+        // Bit s of level k is set while slot s of level k holds a deadline
+        uint64_t m_occupied[LEVELS];
+
+        // Finds the level a deadline at or past the wheel's time belongs on
+        int levelOf(uint64_t deadline) const
+        {
+            const uint64_t differ = deadline ^ m_now;
+            return (differ == 0 ? 0 : (63 - __builtin_clzll(differ)) / SLOT_BITS);
+        }
+        // Links a deadline into its slot, which must be at or past the wheel's time
+        void link(uint32_t index)
+        {
+            Timer& timer = m_timers[index];
+            timer.level = levelOf(timer.deadline);
+            const int slot = (timer.deadline >> (timer.level * SLOT_BITS)) & (SLOTS - 1);
+            timer.prev = NO_DEADLINE;
+            timer.next = m_heads[timer.level][slot];
+            if(timer.next != NO_DEADLINE)
+            {
+                m_timers[timer.next].prev = index;
+            }
+            m_heads[timer.level][slot] = index;
+            m_occupied[timer.level] |= 1ULL << slot;
+        }
+        // Unlinks a deadline from its slot
+        void unlink(uint32_t index)
+        {
+            Timer& timer = m_timers[index];
+            const int slot = (timer.deadline >> (timer.level * SLOT_BITS)) & (SLOTS - 1);
+            if(timer.prev != NO_DEADLINE)
+            {
+                m_timers[timer.prev].next = timer.next;
+            }
+            else if((m_heads[timer.level][slot] = timer.next) == NO_DEADLINE)
+            {
+                m_occupied[timer.level] &= ~(1ULL << slot);
+            }
+            if(timer.next != NO_DEADLINE)
+            {
+                m_timers[timer.next].prev = timer.prev;
+            }
+        }
+        // Puts an unlinked deadline on the free list
+        void release(uint32_t index)
+        {
+            m_timers[index].ship = nullptr;
+            m_timers[index].next = m_free;
+            m_free = index;
+            m_count--;
+        }
+};
+
+// Name:    nameOf
+// Desc:    Looks up the name of an enum value
+// Precon:  names must hold count names
+// Postcon: Returns the name of value, or "UNKNOWN" if it is out of range
+string_view nameOf(const string_view names[], int count, int value)
+{
+    return (value >= 0 && value < count ? names[value] : "UNKNOWN");
+}
+
+// Name:    parallelSort
+// Desc:    Sorts the pairs, splitting the work in half splits times and merging the halves
+// Precon:  None
+// Postcon: [begin, end) will be sorted
+void parallelSort(pair<ShipId, int>* begin, pair<ShipId, int>* end, int splits)
+{
+    if(splits == 0)
+    {
+        sort(begin, end);
+    }
+    else
+    {
+        pair<ShipId, int>* middle = begin + (end - begin) / 2;
+        thread left(parallelSort, begin, middle, splits - 1);
+        parallelSort(middle, end, splits - 1);
+        left.join();
+        inplace_merge(begin, middle, end);
+    }
+}
+
+// Name:    traceNanos
+// Desc:    Reads the clock traces are timed by
+// Precon:  None
+// Postcon: Returns the time in nanoseconds since an arbitrary starting point
+uint64_t traceNanos()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Name:    putVarint
+// Desc:    Appends value to bytes 7 bits at a time, lowest first, with the top bit of each byte set if more follow
+// Precon:  None
+// Postcon: bytes will end with value, in 1 to 10 bytes
+void putVarint(vector<uint8_t>& bytes, uint64_t value)
+{
+    while(value >= 0x80)
+    {
+        bytes.push_back((uint8_t) (value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back((uint8_t) value);
+}
+
+// Name:    getVarint
+// Desc:    Reads back a value written by putVarint, moving next past it
+// Precon:  [next, end) must be readable
+// Postcon: If the value ends before end and fits in 64 bits, sets value and returns true
+//          Else returns false
+bool getVarint(const uint8_t*& next, const uint8_t* end, uint64_t& value)
+{
+    value = 0;
+    for(int shift = 0; next < end && shift < 64; shift += 7)
+    {
+        const uint8_t byte = *next++;
+        value |= (uint64_t) (byte & 0x7F) << shift;
+        if(byte < 0x80)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Name:    Ship::operator new
+// Desc:    Allocates a Ship, counting the allocation
+// Precon:  None
+// Postcon: Returns memory for a Ship
+void* Ship::operator new(size_t size)
+{
+    shipAllocations.fetch_add(1, memory_order_relaxed);
+    shipBytes.fetch_add(size, memory_order_relaxed);
+    return ::operator new(size);
+}
+
+// Name:    Ship::operator delete
+// Desc:    Deallocates a Ship, counting the deallocation
+// Precon:  ship must have been allocated by Ship::operator new
+// Postcon: ship will be deallocated
+void Ship::operator delete(void* ship, size_t size)
+{
+    shipDeallocations.fetch_add(1, memory_order_relaxed);
+    shipBytes.fetch_sub(size, memory_order_relaxed);
+    ::operator delete(ship);
+}
+
+// Name:    Ship::getAllocationStats
+// Desc:    Reads the Ship allocation counters
+//          The counters are never reset, so compare two readings to measure an operation
+// Precon:  None
+// Postcon: Returns the Ships allocated and deallocated so far, and the bytes still allocated
+AllocationStats Ship::getAllocationStats()
+{
+    return {shipAllocations.load(), shipDeallocations.load(), shipBytes.load()};
+}
+
+// Name:    allocatorOverhead
+// Desc:    Finds how many bytes the allocator adds around each Ship
+//          With glibc this is measured once from a block's usable size plus its size_t header,
+//          elsewhere a size_t header and rounding up to 16 bytes are assumed
+// Precon:  None
+// Postcon: Returns the bytes added to each Ship
+long long allocatorOverhead()
+{
+#ifdef __GLIBC__
+    static const long long overhead = []()
+    {
+        void* block = malloc(sizeof(Ship));
+        long long usable = malloc_usable_size(block);
+        free(block);
+        return usable + (long long) sizeof(size_t) - (long long) sizeof(Ship);
+    }();
+    return overhead;
+#else
+    return ((sizeof(Ship) + sizeof(size_t) + 15) & ~15) - sizeof(Ship);
+#endif
+}
 
 // Name:    Fleet::Fleet (Default Constructor)
 // Desc:    Default constructor for Fleet
 // Precon:  None
 // Postcon: An empty Fleet with no Ships will be created
-Fleet::Fleet() : m_root(nullptr){}
+Fleet::Fleet() : m_root(nullptr), m_size(0), m_lazyRemove(false), m_compactThreshold(.25), m_tombstones(0), m_threads(max(1, (int) thread::hardware_concurrency())), m_searchLayout(false), m_layoutDirty(true), m_readsSinceChange(0), m_fingerDepth(0), m_cache(false), m_cacheHits(0), m_cacheMisses(0), m_slabs(nullptr), m_changeStream(false), m_sequence(0), m_hashing(false), m_rotations(0), m_threading(false), m_first(nullptr), m_last(nullptr), m_trace(nullptr), m_traceLast(0), m_traceId(DEFAULT_ID), m_wheel(nullptr)
+{
+    clearCache();
+}
 
 // Name:    Fleet::~Fleet (Destructor)
 // Desc:    Destructor for Fleet
@@ -24,49 +735,178 @@ Fleet::Fleet() : m_root(nullptr){}
 // Postcon: All dynamically allocated memory will be deallocated
 Fleet::~Fleet()
 {
-    deleteShip(m_root);
+    setTrace(nullptr);
+    deleteAll();
+    delete m_slabs;
+    delete m_wheel;
 }
 
 // Name:    Fleet::deleteShip
 // Desc:    Recursively iterates through the subtree, deleting all Ships
+//          While splits is positive, the left subtree is deleted on another thread
 // Precon:  None
 // Postcon: The subtree aShip will be deleted
-void Fleet::deleteShip(Ship* aShip)
+void Fleet::deleteShip(Ship* aShip, int splits)
 {
     if(aShip != nullptr)
     {
-        // Delete the left subtree
-        deleteShip(aShip->m_left);
-        // Delete the right subtree
-        deleteShip(aShip->m_right);
+        // Delete the left subtree on another thread
+        if(splits > 0)
+        {
+            thread left(&Fleet::deleteShip, this, aShip->m_left, splits - 1);
+            deleteShip(aShip->m_right, splits - 1);
+            left.join();
+        }
+        else
+        {
+            // Delete the left subtree
+            deleteShip(aShip->m_left);
+            // Delete the right subtree
+            deleteShip(aShip->m_right);
+        }
         // Delete this Ship
         delete aShip;
     }
 }
 
+// Name:    Fleet::deleteAll
+// Desc:    Deallocates every Ship, all at once if they are stored in slabs
+// Precon:  None
+// Postcon: Every Ship will be deallocated, m_root is left dangling
+void Fleet::deleteAll()
+{
+    if(m_slabs != nullptr)
+    {
+        m_slabs->release();
+    }
+    else
+    {
+        deleteShip(m_root, getSplits(m_size + m_tombstones));
+    }
+}
+
+// Name:    Fleet::makeShip
+// Desc:    Allocates a copy of the passed Ship wherever the Fleet stores its Ships
+// Precon:  None
+// Postcon: Returns the new RED Ship with no children
+Ship* Fleet::makeShip(const Ship& ship)
+{
+    if(m_slabs != nullptr)
+    {
+        return new (m_slabs->allocate()) Ship(ship.m_id, ship.m_type, ship.m_state);
+    }
+    return new Ship(ship.m_id, ship.m_type, ship.m_state);
+}
+
+// Name:    Fleet::freeShip
+// Desc:    Deallocates a Ship allocated by makeShip
+// Precon:  ship must not be linked into the tree
+// Postcon: ship will be deallocated
+void Fleet::freeShip(Ship* ship)
+{
+    if(m_slabs != nullptr)
+    {
+        m_slabs->free(ship);
+    }
+    else
+    {
+        delete ship;
+    }
+}
+
+// Name:    Fleet::setThreads
+// Desc:    Sets the most threads that build, clear and the destructor may use
+// Precon:  None
+// Postcon: Bulk operations will use at most threads threads, and at least 1
+void Fleet::setThreads(int threads)
+{
+    m_threads = max(1, threads);
+}
+
+// Name:    Fleet::getSplits
+// Desc:    Finds how many times work on size Ships should be split in half
+// Precon:  None
+// Postcon: Returns enough splits to give each thread a share, without any share
+//          falling below PARALLEL_GRAIN Ships
+int Fleet::getSplits(int size) const
+{
+    int splits = 0;
+    while((1 << splits) < m_threads
+        && (size >> (splits + 1)) >= PARALLEL_GRAIN)
+    {
+        splits++;
+    }
+    return splits;
+}
+
 // Name:    Fleet::clear
-// Desc:    Deallocates all memory and reinitializes member variable
+// Desc:    Deallocates all Ships and empties the Fleet
+//          Settings such as the search layout are kept
 // Precon:  None
-// Postcon: this will be a default Fleet
+// Postcon: this will be an empty Fleet
 void Fleet::clear()
 {
-    this->~Fleet();
-    new (this) Fleet();
+    record(CLEARED, nullptr);
+    deleteAll();
+    m_root = nullptr;
+    m_first = nullptr;
+    m_last = nullptr;
+    m_size = 0;
+    m_tombstones = 0;
+    if(m_wheel != nullptr)
+    {
+        m_wheel->reset();
+    }
+    treeChanged();
+    clearCache();
+    verify();
 }
 
 // Name:    Fleet::insert
 // Desc:    Inserts a Ship into the Fleet
+//          If a lazily removed Ship has the same id, it is reused instead
 // Precon:  The Ship's id must be within [MINID, MAXID] and cannot already exist in the Fleet
 //          Else does nothing
 // Postcon: Fleet will be balanced and contain the new Ship
 void Fleet::insert(const Ship& ship)
 {
+    trace(TRACE_INSERT, ship.m_id, ship.m_type, ship.m_state);
+    Ship* existing = findNode(ship.m_id);
+    // Special case: The id was lazily removed, bring its Ship back
+    if(existing != nullptr
+        && existing->m_removed)
+    {
+        existing->m_type = ship.m_type;
+        existing->m_state = ship.m_state;
+        existing->m_removed = false;
+        m_tombstones--;
+        m_size++;
+        if(m_hashing)
+        {
+            addHash(ship.m_id, shipHash(existing));
+        }
+        record(INSERTED, existing);
+    }
     // Check that the id to be inserted is valid
-    if(ship.m_id >= MINID
+    else if(ship.m_id >= MINID
         && ship.m_id <= MAXID
-        && !findShip(ship.m_id))
+        && existing == nullptr)
     {
-        Ship* newShip = new Ship(ship.m_id, ship.m_type, ship.m_state);
+        Ship* newShip = makeShip(ship);
+        // Add the new Ship's hash along its path before any rotations
+        if(m_hashing)
+        {
+            setSubtreeHash(newShip, shipHash(newShip));
+            addHash(ship.m_id, subtreeHash(newShip));
+        }
+        // Thread the new Ship in next to the Ship it will hang from, rotations then leave the order as is
+        if(m_threading)
+        {
+            linkNeighbours(newShip, findParent(ship.m_id));
+        }
+#ifdef FLEET_AVL
+        m_root = avlInsert(m_root, newShip);
+#else
         // Special case: Inserting at the root
         if(m_root == nullptr)
         {
@@ -84,6 +924,67 @@ void Fleet::insert(const Ship& ship)
         }
         // Make sure the root is still BLACK (it might be RED)
         m_root->m_color = BLACK;
+#endif
+        m_size++;
+        treeChanged();
+        record(INSERTED, newShip);
+    }
+    verify();
+}
+
+// Name:    Fleet::build
+// Desc:    Replaces the Fleet's Ships with the passed Ships, in linear time after sorting
+//          The ids are sorted, the Ships allocated and the tree linked on up to m_threads threads
+// Precon:  ships must hold size Ships
+//          Ships whose ids are out of range are skipped, as are repeats of an id after its first
+// Postcon: Fleet will be balanced and contain exactly the valid passed Ships
+void Fleet::build(const Ship ships[], int size)
+{
+    clear();
+    // Pair each valid id with its position, so that sorting puts the first of any repeated id first
+    vector<pair<ShipId, int>> order;
+    order.reserve(size);
+    for(int i = 0; i < size; i++)
+    {
+        if(ships[i].m_id >= MINID
+            && ships[i].m_id <= MAXID)
+        {
+            order.emplace_back(ships[i].m_id, i);
+        }
+    }
+    parallelSort(order.data(), order.data() + order.size(), getSplits(order.size()));
+    order.erase(unique(order.begin(), order.end(),
+        [](const pair<ShipId, int>& lhs, const pair<ShipId, int>& rhs) {return lhs.first == rhs.first;}), order.end());
+    // Allocate the Ships, giving each thread an even share
+    // With slabs, the Ships are carved out of one run of memory in order of id
+    vector<Ship*> nodes(order.size());
+    Ship* block = (m_slabs != nullptr && !nodes.empty() ? m_slabs->allocate(nodes.size()) : nullptr);
+    const int numThreads = 1 << getSplits(order.size());
+    vector<thread> threads;
+    for(int t = 0; t < numThreads; t++)
+    {
+        const int start = (long long) nodes.size() * t / numThreads;
+        const int end = (long long) nodes.size() * (t + 1) / numThreads;
+        threads.emplace_back([&, start, end]()
+        {
+            for(int i = start; i < end; i++)
+            {
+                const Ship& ship = ships[order[i].second];
+                nodes[i] = (block != nullptr ? new (block + i) Ship(ship.m_id, ship.m_type, ship.m_state) : new Ship(ship.m_id, ship.m_type, ship.m_state));
+            }
+        });
+    }
+    for(thread& t : threads)
+    {
+        t.join();
+    }
+    relink(nodes.data(), nodes.size());
+    if(m_changeStream)
+    {
+        for(Ship* node : nodes)
+        {
+            record(INSERTED, node);
+        }
     }
 }
 
@@ -152,40 +1053,93 @@ Ship* Fleet::insertRebalance(Ship* grandparent, bool outerLeft, bool innerLeft)
 
 // Name:    Fleet::remove
 // Desc:    Removes a Ship whose id is passed in
+//          With lazy removal on, the Ship is only flagged as removed and the tree is left as is
 // Precon:  There must exist Ship with the passed id
 //          Else does nothing
 // Postcon: The Fleet will be balanced and will not contain the Ship with the passed id
-void Fleet::remove(int id)
+void Fleet::remove(ShipId id)
 {
-    if(findShip(id))
+    trace(TRACE_REMOVE, id);
+    Ship* ship = findNode(id);
+    // Lazy removal, flag the Ship and compact once there are too many flagged Ships
+    if(m_lazyRemove)
+    {
+        if(ship != nullptr
+            && !ship->m_removed)
+        {
+            uncache(id);
+            record(REMOVED, ship);
+            if(m_hashing)
+            {
+                addHash(id, -shipHash(ship));
+            }
+            if(ship->m_timer != NO_DEADLINE)
+            {
+                m_wheel->unschedule(ship);
+            }
+            ship->m_removed = true;
+            m_tombstones++;
+            m_size--;
+            if(m_tombstones > m_compactThreshold * (m_size + m_tombstones))
+            {
+                compact();
+            }
+        }
+    }
+    else if(ship != nullptr)
     {
+        record(REMOVED, ship);
+        // Take the Ship's hash out along its path, the Ship then only carries its subtree's hash until it is deleted
+        if(m_hashing)
+        {
+            addHash(id, -shipHash(ship));
+        }
+        if(m_threading)
+        {
+            unlinkNeighbours(ship);
+        }
+        if(ship->m_timer != NO_DEADLINE)
+        {
+            m_wheel->unschedule(ship);
+        }
+        m_size--;
+        treeChanged();
+        uncache(id);
+#ifdef FLEET_AVL
+        m_root = avlRemove(m_root, id);
+#else
         // Normal removal
         if(m_root->m_id != id)
         {
             m_root = recursRemove(m_root, id, id < m_root->m_id);
         }
-        // Special case: Removing root with a left child, replace the root with its largest left child and remove that child
+        // Special case: Removing root with a left child, swap the root with its largest left child and remove it from there
         else if(m_root->m_left != nullptr)
         {
-            m_root = recursRemove(m_root, replaceWithLargest(m_root), true);
+            replaceWithLargest(m_root);
+            m_root = recursRemove(m_root, id, true);
         }
         // Special case: Removing root with only one child, replace root with child
         else if(m_root->m_right != nullptr)
         {
             Ship* temp = m_root;
             m_root = m_root->m_right;
-            delete temp;
+            freeShip(temp);
         }
         // Special case: Removing root with no children, delete root
         else
         {
-            delete m_root;
+            freeShip(m_root);
             m_root = nullptr;
-            return;
         }
         // Make sure the root is still BLACK (it might be DOUBLEBLACK)
-        m_root->m_color = BLACK;
+        if(m_root != nullptr)
+        {
+            m_root->m_color = BLACK;
+        }
+#endif
     }
+    verify();
 }
 
 // Name:    Fleet::recursRemove
@@ -194,7 +1148,7 @@ void Fleet::remove(int id)
 // Precon:  There must exist Ship with the passed id in the subtrees of the passed Ship
 // Postcon: Subtree whose root is aShip will be balanced and will not contain the Ship with the passed id
 //          Returns the root of the current subtree
-Ship* Fleet::recursRemove(Ship*& aShip, int id, bool left)
+Ship* Fleet::recursRemove(Ship*& aShip, ShipId id, bool left)
 {
     Ship*& possibility = (left ? aShip->m_left : aShip->m_right);
     bool nextLeft = true;
@@ -206,37 +1160,37 @@ Ship* Fleet::recursRemove(Ship*& aShip, int id, bool left)
     // Found the Ship, check if it is a leaf
     else if(id == possibility->m_id)
     {
-        // Ship is not a leaf, replace it with its largest left child
+        // Ship is not a leaf, swap it with its largest left child
         if(possibility->m_left != nullptr)
         {
-            id = replaceWithLargest(possibility);
+            replaceWithLargest(possibility);
         }
-        // Ship is not a leaf, replace it with its smallest right child
+        // Ship is not a leaf, swap it with its smallest right child
         else if(possibility->m_right != nullptr)
         {
             possibility->m_left = possibility->m_right;
             possibility->m_right = nullptr;
-            id = replaceWithLargest(possibility);
+            replaceWithLargest(possibility);
         }
         // Base case, possibility is the BLACK leaf Node to be deleted, make it DOUBLEBLACK and remove it
         else if(possibility->m_color == BLACK)
         {
             possibility->m_color = DOUBLEBLACK;
             Ship* toBeDeleted = possibility;
+            // Rotations while rebalancing only move parent, toBeDeleted stays its child
+            Ship* parent = aShip;
             // Rebalance the new DOUBLEBLACK
             Ship* temp = removeRebalance(aShip, left);
-            // Get toBeDeleted's new parent
-            Ship* parent = getParent(toBeDeleted);
             // Remove toBeDeleted from the tree
             (toBeDeleted == parent->m_left ? parent->m_left : parent->m_right) = nullptr;
             // Delete toBeDeleted
-            delete toBeDeleted;
+            freeShip(toBeDeleted);
             return temp;
         }
         // Base case, possibility is the RED leaf Node to be deleted, remove it
         else
         {
-            delete possibility;
+            freeShip(possibility);
             possibility = nullptr;
             return aShip;
         }
@@ -245,36 +1199,50 @@ Ship* Fleet::recursRemove(Ship*& aShip, int id, bool left)
     return removeRebalance(aShip, left);
 }
 
-// Name:    Fleet::findLargest
-// Desc:    Replaces the Ship's data with the data of its largest left child
-// Precon:  aShip and its left child must not be nullptr
-// Postcon: Ship's data will instead be that of its largest left child
-//          Returns the Ship's new id
-int Fleet::replaceWithLargest(Ship* aShip)
-{
-    Ship* replacement = findLargest(aShip->m_left);
-    // Replace the Ship's data with its replacement's data
-    aShip->m_state = replacement->m_state;
-    aShip->m_type = replacement->m_type;
-    return aShip->m_id = replacement->m_id;
-}
-
-// Name:    Fleet::findLargest
-// Desc:    Recursively iterates through the subtree, looking for the Ship with largest id
-// Precon:  aShip must not be nullptr
-// Postcon: Returns the Ship with largest id in the passed subtree
-Ship* Fleet::findLargest(Ship* aShip) const
+// Name:    Fleet::replaceWithLargest
+// Desc:    Swaps the Ship with its largest left child, relinking both Ships along with their colors
+//          Ships are never copied, so a Ship keeps its id for as long as it is in the Fleet
+// Precon:  aShip must be the link to the Ship, and the Ship's left child must not be nullptr
+// Postcon: aShip will link to the largest left child, and the Ship will be the largest Ship of the new left subtree
+void Fleet::replaceWithLargest(Ship*& aShip)
 {
-    // Base case, aShip has the largest id
-    if(aShip->m_right == nullptr)
+    Ship* ship = aShip;
+    // Find the largest left child along with the link that points to it
+    Ship** link = &ship->m_left;
+    while((*link)->m_right != nullptr)
+    {
+        link = &(*link)->m_right;
+    }
+    Ship* largest = *link;
+    // largest moves up to the Ship's place, so the Ships in between lose its hash, and the Ship,
+    // whose own hash is already out of the tree, takes over largest's left subtree
+    if(m_hashing)
+    {
+        const uint64_t moved = shipHash(largest);
+        for(Ship* between = ship->m_left; between != largest; between = between->m_right)
+        {
+            setSubtreeHash(between, subtreeHash(between) - moved);
+        }
+        setSubtreeHash(largest, subtreeHash(ship));
+        setSubtreeHash(ship, subtreeHash(largest->m_left));
+    }
+    // Colors are bit fields, which swap can't bind to
+    const COLOR color = ship->m_color;
+    ship->m_color = largest->m_color;
+    largest->m_color = color;
+    swap(ship->m_right, largest->m_right);
+    // Special case: largest is ship's own left child
+    if(largest == ship->m_left)
     {
-        return aShip;
+        ship->m_left = largest->m_left;
+        largest->m_left = ship;
     }
-    // Keep searching for the largest id
     else
     {
-        return findLargest(aShip->m_right);
+        swap(ship->m_left, largest->m_left);
+        *link = ship;
     }
+    aShip = largest;
 }
 
 // Name:    Fleet::removeRebalance
@@ -367,24 +1335,6 @@ Ship* Fleet::removeRebalance(Ship* parent, bool left)
     return parent;
 }
 
-// Name:    Fleet::getParent
-// Desc:    Searches for the parent of the passed Ship
-// Precon:  Ship must be in the Fleet but not the root
-// Postcon: Returns a pointer to the Ship's parent
-Ship* Fleet::getParent(Ship* aShip) const
-{
-    // Iterate through the tree
-    for(Ship* iter = m_root; true; iter = (iter->m_id >= aShip->m_id ? iter->m_left : iter->m_right))
-    {
-        // iter is aShip's parent, return it
-        if(iter->m_left == aShip
-            || iter->m_right == aShip)
-        {
-            return iter;
-        }
-    }
-}
-
 // Name:    Fleet::lRotation
 // Desc:    Performs a left rotation around the passed Ship
 // Precon:  aShip must not be nullptr
@@ -395,6 +1345,17 @@ Ship* Fleet::lRotation(Ship* aShip)
     Ship* temp = aShip->m_right;
     aShip->m_right = temp->m_left;
     temp->m_left = aShip;
+    m_rotations++;
+#ifdef FLEET_AVL
+    updateHeight(aShip);
+    updateHeight(temp);
+#endif
+    // The subtree holds the same Ships, only aShip's changed
+    if(m_hashing)
+    {
+        setSubtreeHash(temp, subtreeHash(aShip));
+        setSubtreeHash(aShip, shipHash(aShip) + subtreeHash(aShip->m_left) + subtreeHash(aShip->m_right));
+    }
     return temp;
 }
 
@@ -408,6 +1369,17 @@ Ship* Fleet::rRotation(Ship* aShip)
     Ship* temp = aShip->m_left;
     aShip->m_left = temp->m_right;
     temp->m_right = aShip;
+    m_rotations++;
+#ifdef FLEET_AVL
+    updateHeight(aShip);
+    updateHeight(temp);
+#endif
+    // The subtree holds the same Ships, only aShip's changed
+    if(m_hashing)
+    {
+        setSubtreeHash(temp, subtreeHash(aShip));
+        setSubtreeHash(aShip, shipHash(aShip) + subtreeHash(aShip->m_left) + subtreeHash(aShip->m_right));
+    }
     return temp;
 }
 
@@ -422,31 +1394,142 @@ void Fleet::recolor(Ship* aShip)
     aShip->m_right->m_color = BLACK;
 }
 
+// Name:    Fleet::avlInsert
+// Desc:    Recursively inserts newShip into the AVL subtree, rebalancing on the way back
+// Precon:  newShip must not be nullptr, and its id must not be in the subtree
+// Postcon: Returns the root of the balanced subtree containing newShip
+Ship* Fleet::avlInsert(Ship* aShip, Ship* newShip)
+{
+    // Base case, newShip's proper location found
+    if(aShip == nullptr)
+    {
+        return newShip;
+    }
+    if(newShip->m_id < aShip->m_id)
+    {
+        aShip->m_left = avlInsert(aShip->m_left, newShip);
+    }
+    else
+    {
+        aShip->m_right = avlInsert(aShip->m_right, newShip);
+    }
+    return avlBalance(aShip);
+}
+
+// Name:    Fleet::avlRemove
+// Desc:    Recursively removes the Ship with the passed id from the AVL subtree, rebalancing on the way back
+//          A Ship with two children is replaced by its largest left child, relinked into its place
+// Precon:  The id must be in the subtree, and its Ship's hash must already be taken out of the path to it
+// Postcon: Returns the root of the balanced subtree without the Ship, which is deallocated
+Ship* Fleet::avlRemove(Ship* aShip, ShipId id)
+{
+    if(id < aShip->m_id)
+    {
+        aShip->m_left = avlRemove(aShip->m_left, id);
+    }
+    else if(id > aShip->m_id)
+    {
+        aShip->m_right = avlRemove(aShip->m_right, id);
+    }
+    // Found the Ship, with at most one child its child takes its place
+    else if(aShip->m_left == nullptr
+        || aShip->m_right == nullptr)
+    {
+        Ship* child = (aShip->m_left != nullptr ? aShip->m_left : aShip->m_right);
+        freeShip(aShip);
+        return child;
+    }
+    // Found the Ship, its largest left child takes its place
+    else
+    {
+        Ship* largest = nullptr;
+        Ship* left = avlRemoveLargest(aShip->m_left, largest);
+        largest->m_left = left;
+        largest->m_right = aShip->m_right;
+        setSubtreeHash(largest, subtreeHash(aShip));
+        freeShip(aShip);
+        aShip = largest;
+    }
+    return avlBalance(aShip);
+}
+
+// Name:    Fleet::avlRemoveLargest
+// Desc:    Recursively unlinks the largest Ship of the AVL subtree, rebalancing on the way back
+// Precon:  aShip must not be nullptr
+// Postcon: largest will be the unlinked Ship
+//          Returns the root of the balanced subtree without it
+Ship* Fleet::avlRemoveLargest(Ship* aShip, Ship*& largest)
+{
+    if(aShip->m_right == nullptr)
+    {
+        largest = aShip;
+        return aShip->m_left;
+    }
+    aShip->m_right = avlRemoveLargest(aShip->m_right, largest);
+    if(m_hashing)
+    {
+        setSubtreeHash(aShip, subtreeHash(aShip) - shipHash(largest));
+    }
+    return avlBalance(aShip);
+}
+
+// Name:    Fleet::avlBalance
+// Desc:    Updates the Ship's height, then rotates it if its subtrees' heights differ by 2
+// Precon:  aShip must not be nullptr, and both its subtrees must be balanced AVL trees
+// Postcon: Returns the root of the balanced subtree
+Ship* Fleet::avlBalance(Ship* aShip)
+{
+    updateHeight(aShip);
+    const int balance = heightOf(aShip->m_left) - heightOf(aShip->m_right);
+    if(balance > 1)
+    {
+        // Left-Right case, rotate the left child's right child up first
+        if(heightOf(aShip->m_left->m_left) < heightOf(aShip->m_left->m_right))
+        {
+            aShip->m_left = lRotation(aShip->m_left);
+        }
+        return rRotation(aShip);
+    }
+    if(balance < -1)
+    {
+        // Right-Left case, rotate the right child's left child up first
+        if(heightOf(aShip->m_right->m_right) < heightOf(aShip->m_right->m_left))
+        {
+            aShip->m_right = rRotation(aShip->m_right);
+        }
+        return lRotation(aShip);
+    }
+    return aShip;
+}
+
 // Name:    Fleet::dumpTree
 // Desc:    Outputs an inorder visualization of the Fleet
 // Precon:  None
-// Postcon: Visualization of Fleet displayed to user
-void Fleet::dumpTree() const
+// Postcon: Visualization of Fleet written to out
+void Fleet::dumpTree(ostream& out) const
 {
-    dump(m_root);
+    ShipWriter writer(out);
+    dump(m_root, writer);
 }
 
 // Name:    Fleet::dump
 // Desc:    Recursively outputs an inorder visualization of the subtree whose root is aShip
 // Precon:  None
-// Postcon: Visualization of subtree whose root is aShip is displayed to user
-void Fleet::dump(Ship* aShip) const
+// Postcon: Visualization of subtree whose root is aShip is written to out
+void Fleet::dump(Ship* aShip, ShipWriter& out) const
 {
     if(aShip != nullptr)
     {
-        cout << "(";
+        out.write('(');
         // Dump the left child
-        dump(aShip->m_left);
+        dump(aShip->m_left, out);
         // Dump this Ship
-        cout << aShip->m_id << ":" << aShip->getColorStr();
+        out.writeInt(aShip->m_id);
+        out.write(':');
+        out.write(nameOf(COLOR_NAMES, 3, aShip->m_color));
         // Dump the right child
-        dump(aShip->m_right);
-        cout << ")";
+        dump(aShip->m_right, out);
+        out.write(')');
     }
 }
 
@@ -454,27 +1537,304 @@ void Fleet::dump(Ship* aShip) const
 // Desc:    Outputs an inorder visualization of the Fleet
 //          Shows each ship's m_id, m_state, and m_type
 // Precon:  None
-// Postcon: Visualization of Fleet displayed to user
-void Fleet::listShips() const
+// Postcon: Visualization of Fleet written to out
+void Fleet::listShips(ostream& out) const
 {
-    recursList(m_root);
+    exportShips(out, TEXT);
 }
 
-// Name:    Fleet::recursList
-// Desc:    Recursively outputs an inorder visualization of the subtree whose root is aShip
+// Name:    Fleet::exportShips
+// Desc:    Writes every Ship to out in order of id, in the passed format
+//          TEXT:       one "id:STATE:TYPE" line per Ship, as listShips
+//          JSONLINES:  one {"id":id,"state":"STATE","type":"TYPE"} object per line
+//          BINARY:     "FLT1", the number of Ships as a 4 byte integer, then per Ship
+//                      its id as a 4 byte integer, its type and its state as 1 byte each
+//                      Wide builds write "FLT8" and 8 byte ids instead
+//                      Integers are written in the machine's byte order
+// Precon:  out should be opened in binary mode for BINARY
+// Postcon: Every Ship will be written to out
+void Fleet::exportShips(ostream& out, FORMAT format) const
+{
+    ShipWriter writer(out);
+    if(format == BINARY)
+    {
+        const int size = m_size;
+        writer.write(BINARY_MAGIC, sizeof(BINARY_MAGIC));
+        writer.write((const char*) &size, sizeof(size));
+    }
+    // Threaded, walk the list instead, without a stack and without passing through the Ships above each leaf again
+    if(m_threading)
+    {
+        for(Ship* ship = m_first; ship != nullptr; ship = nextOf(ship))
+        {
+            if(!ship->m_removed)
+            {
+                writeShip(ship, writer, format);
+            }
+        }
+    }
+    else
+    {
+        recursExport(m_root, writer, format);
+    }
+}
+
+// Name:    Fleet::recursExport
+// Desc:    Recursively writes each Ship in the subtree whose root is aShip, in order of id
 // Precon:  None
-// Postcon: Visualization of subtree whose root is aShip is displayed to user
-void Fleet::recursList(Ship* aShip) const
+// Postcon: Each Ship in the subtree that hasn't been lazily removed is written to out
+void Fleet::recursExport(Ship* aShip, ShipWriter& out, FORMAT format) const
 {
     if(aShip != nullptr)
     {
-        // List the left child
-        recursList(aShip->m_left);
-        // List this Ship
-        cout << aShip->m_id << ':' << aShip->getStateStr() << ':' << aShip->getTypeStr() << endl;
-        // List the right child
-        recursList(aShip->m_right);
+        // Write the left child
+        recursExport(aShip->m_left, out, format);
+        // Write this Ship, unless it was lazily removed
+        if(!aShip->m_removed)
+        {
+            writeShip(aShip, out, format);
+        }
+        // Write the right child
+        recursExport(aShip->m_right, out, format);
+    }
+}
+
+// Name:    Fleet::writeShip
+// Desc:    Writes one Ship to out in the passed format, as exportShips describes
+// Precon:  None
+// Postcon: The Ship is written to out
+void Fleet::writeShip(const Ship* aShip, ShipWriter& out, FORMAT format)
+{
+    if(format == BINARY)
+    {
+        const char attributes[2] = {(char) aShip->m_type, (char) aShip->m_state};
+        out.write((const char*) &aShip->m_id, sizeof(aShip->m_id));
+        out.write(attributes, sizeof(attributes));
+    }
+    else if(format == JSONLINES)
+    {
+        out.write("{\"id\":");
+        out.writeInt(aShip->m_id);
+        out.write(",\"state\":\"");
+        out.write(nameOf(STATE_NAMES, 2, aShip->m_state));
+        out.write("\",\"type\":\"");
+        out.write(nameOf(TYPE_NAMES, 5, aShip->m_type));
+        out.write("\"}\n");
+    }
+    else
+    {
+        out.writeInt(aShip->m_id);
+        out.write(':');
+        out.write(nameOf(STATE_NAMES, 2, aShip->m_state));
+        out.write(':');
+        out.write(nameOf(TYPE_NAMES, 5, aShip->m_type));
+        out.write('\n');
+    }
+}
+
+// Name:    Fleet::writeArchive
+// Desc:    Writes every Ship to out in a compact archive, to be read back by loadArchive
+//          The Ships are split into blocks of blockSize in order of id, and each block packs three columns:
+//          the gaps between its ids in the fewest bits that hold the largest one, then each type in 3 bits,
+//          then each state in 1 bit, each column padded to a byte; a Fleet filling its range uses 0 bits per gap
+//          Layout: "FLA1", the number of Ships, blockSize and the number of blocks as 4 byte integers, the size
+//                  of the blocks in bytes as an 8 byte integer, then the index: each block's first id, then
+//                  each block's offset into the blocks as an 8 byte integer, and then the blocks themselves
+//                  A block is the width of its gaps as 1 byte, followed by its packed columns
+//                  Wide builds write "FLA8" and 8 byte ids
+//                  Integers are written in the machine's byte order
+// Precon:  blockSize must be positive
+//          out should be opened in binary mode
+// Postcon: Every Ship will be written to out
+void Fleet::writeArchive(ostream& out, int blockSize) const
+{
+    vector<Ship*> ships;
+    ships.reserve(m_size + m_tombstones);
+    collectShips(m_root, ships);
+    ships.erase(remove_if(ships.begin(), ships.end(), [](const Ship* ship) {return ship->m_removed;}), ships.end());
+    const int count = ships.size();
+    const int numBlocks = (count + blockSize - 1) / blockSize;
+    vector<ShipId> firstIds(numBlocks);
+    vector<uint64_t> offsets(numBlocks);
+    vector<uint8_t> blocks;
+    BitPacker packer(blocks);
+    for(int block = 0; block < numBlocks; block++)
+    {
+        const int start = block * blockSize;
+        const int end = min(count, start + blockSize);
+        firstIds[block] = ships[start]->m_id;
+        offsets[block] = blocks.size();
+        // Ids are unique, so each gap is stored less one and consecutive ids cost nothing
+        uint64_t largest = 0;
+        for(int i = start + 1; i < end; i++)
+        {
+            largest = max(largest, (uint64_t) (ships[i]->m_id - ships[i - 1]->m_id - 1));
+        }
+        int width = 0;
+        while(width < 64
+            && (largest >> width) != 0)
+        {
+            width++;
+        }
+        blocks.push_back(width);
+        for(int i = start + 1; i < end; i++)
+        {
+            packer.put(ships[i]->m_id - ships[i - 1]->m_id - 1, width);
+        }
+        packer.finish();
+        for(int i = start; i < end; i++)
+        {
+            packer.put(ships[i]->m_type, 3);
+        }
+        packer.finish();
+        for(int i = start; i < end; i++)
+        {
+            packer.put(ships[i]->m_state, 1);
+        }
+        packer.finish();
+    }
+    const uint64_t blockBytes = blocks.size();
+    out.write(ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+    out.write((const char*) &count, sizeof(count));
+    out.write((const char*) &blockSize, sizeof(blockSize));
+    out.write((const char*) &numBlocks, sizeof(numBlocks));
+    out.write((const char*) &blockBytes, sizeof(blockBytes));
+    out.write((const char*) firstIds.data(), firstIds.size() * sizeof(ShipId));
+    out.write((const char*) offsets.data(), offsets.size() * sizeof(uint64_t));
+    out.write((const char*) blocks.data(), blocks.size());
+}
+
+// Name:    Fleet::loadArchive
+// Desc:    Replaces the Fleet's Ships with the Ships in [low, high] of an archive written by writeArchive
+//          Each block is decoded straight into newly allocated Ships, which are already in order,
+//          so they are linked into a balanced tree in linear time without sorting
+//          Blocks that end before low are read past without being decoded, and reading stops at the first
+//          block that starts after high, so loading a small range reads little more than the index
+// Precon:  in should be opened in binary mode
+// Postcon: If the archive is complete and every id in it is valid and in order, the Fleet will contain
+//          exactly its Ships with ids in [low, high] and returns true
+//          Else the Fleet will be empty and returns false
+bool Fleet::loadArchive(istream& in, ShipId low, ShipId high)
+{
+    clear();
+    char magic[sizeof(ARCHIVE_MAGIC)];
+    int count = 0;
+    int blockSize = 0;
+    int numBlocks = 0;
+    uint64_t blockBytes = 0;
+    in.read(magic, sizeof(magic));
+    in.read((char*) &count, sizeof(count));
+    in.read((char*) &blockSize, sizeof(blockSize));
+    in.read((char*) &numBlocks, sizeof(numBlocks));
+    in.read((char*) &blockBytes, sizeof(blockBytes));
+    if(!in
+        || memcmp(magic, ARCHIVE_MAGIC, sizeof(magic)) != 0
+        || count < 0
+        || blockSize <= 0
+        || numBlocks != ((long long) count + blockSize - 1) / blockSize)
+    {
+        return false;
+    }
+    vector<ShipId> firstIds(numBlocks);
+    vector<uint64_t> offsets(numBlocks + 1);
+    in.read((char*) firstIds.data(), firstIds.size() * sizeof(ShipId));
+    in.read((char*) offsets.data(), numBlocks * sizeof(uint64_t));
+    offsets[numBlocks] = blockBytes;
+    if(!in
+        || (numBlocks > 0 && offsets[0] != 0))
+    {
+        return false;
+    }
+    // Start at the last block whose first id is at most low, which is the only one before it that can hold low
+    int block = max(0, (int) (upper_bound(firstIds.begin(), firstIds.end(), low) - firstIds.begin()) - 1);
+    if(offsets[block] > blockBytes)
+    {
+        return false;
+    }
+    in.ignore(offsets[block]);
+    vector<Ship*> nodes;
+    vector<uint8_t> bytes;
+    vector<ShipId> ids(min(count, blockSize));
+    ShipId previous = MINID - 1;
+    bool valid = true;
+    for(; valid && block < numBlocks && firstIds[block] <= high; block++)
+    {
+        const int size = min(blockSize, count - block * blockSize);
+        // A block can't be bigger than 64 bits per gap and 4 bits per Ship, and offsets only go up
+        const uint64_t largest = 1 + ((uint64_t) size * 64 + 7) / 8 + ((uint64_t) size * 3 + 7) / 8 + (size + 7) / 8;
+        if(offsets[block + 1] < offsets[block]
+            || offsets[block + 1] - offsets[block] > largest
+            || offsets[block + 1] - offsets[block] == 0
+            || firstIds[block] <= previous)
+        {
+            valid = false;
+            break;
+        }
+        bytes.resize(offsets[block + 1] - offsets[block]);
+        in.read((char*) bytes.data(), bytes.size());
+        const int width = bytes[0];
+        BitUnpacker unpacker(bytes.data() + 1, bytes.data() + bytes.size());
+        // Each id must stay in range, and the block's first must follow the last block's last
+        ids[0] = firstIds[block];
+        valid = in && width <= 64 && ids[0] >= MINID && ids[0] <= MAXID;
+        for(int i = 1; valid && i < size; i++)
+        {
+            const uint64_t gap = unpacker.get(width);
+            valid = gap < (uint64_t) (MAXID - ids[i - 1]);
+            ids[i] = ids[i - 1] + (ShipId) gap + 1;
+        }
+        unpacker.finish();
+        if(!valid)
+        {
+            break;
+        }
+        previous = ids[size - 1];
+        // Only the Ships in [low, high] are allocated, in one run when the Fleet uses slabs
+        const int from = lower_bound(ids.begin(), ids.begin() + size, low) - ids.begin();
+        const int to = upper_bound(ids.begin(), ids.begin() + size, high) - ids.begin();
+        const int kept = nodes.size();
+        Ship* run = (m_slabs != nullptr && from < to ? m_slabs->allocate(to - from) : nullptr);
+        for(int i = from; i < to; i++)
+        {
+            nodes.push_back(run != nullptr ? new (run + i - from) Ship(ids[i]) : new Ship(ids[i]));
+        }
+        for(int i = 0; i < size; i++)
+        {
+            const uint64_t type = unpacker.get(3);
+            valid = valid && type <= ROBOCARRIER;
+            if(i >= from && i < to)
+            {
+                nodes[kept + i - from]->m_type = (SHIPTYPE) type;
+            }
+        }
+        unpacker.finish();
+        for(int i = 0; i < size; i++)
+        {
+            const uint64_t state = unpacker.get(1);
+            if(i >= from && i < to)
+            {
+                nodes[kept + i - from]->m_state = (STATE) state;
+            }
+        }
+        valid = valid && !unpacker.overrun();
+    }
+    if(!valid)
+    {
+        for(Ship* node : nodes)
+        {
+            freeShip(node);
+        }
+        return false;
+    }
+    relink(nodes.data(), nodes.size());
+    if(m_changeStream)
+    {
+        for(Ship* node : nodes)
+        {
+            record(INSERTED, node);
+        }
     }
+    return true;
 }
 
 // Name:    Fleet::setState
@@ -483,72 +1843,2555 @@ void Fleet::recursList(Ship* aShip) const
 //          Else does nothing and returns false
 // Postcon: Ship with the passed id will have m_state state
 //          Returns true
-bool Fleet::setState(int id, STATE state)
+bool Fleet::setState(ShipId id, STATE state)
 {
-    // Iterate through the tree
-    for(Ship* iter = m_root; iter != nullptr; iter = (iter->m_id > id ? iter->m_left : iter->m_right))
+    trace(TRACE_SET_STATE, id, DEFAULT_TYPE, state);
+    Ship* ship = lookup(id);
+    // Found the Ship
+    if(ship != nullptr)
     {
-        // Found the Ship
-        if(iter->m_id == id)
-        {
-            iter->m_state = state;
-            return true;
-        }
+        changeState(ship, state);
+        return true;
     }
     // The Ship was never found
     return false;
 }
 
+// Name:    Fleet::setState (Handle)
+// Desc:    Changes the state of a Ship found earlier with find, without searching for it again
+// Precon:  ship must be nullptr or a handle from find whose Ship hasn't since been removed
+// Postcon: If the Ship is in the Fleet, changes its state and returns true
+//          Else returns false
+bool Fleet::setState(const Ship* ship, STATE state)
+{
+    trace(TRACE_SET_STATE, (ship != nullptr ? ship->m_id : DEFAULT_ID), DEFAULT_TYPE, state);
+    if(ship != nullptr
+        && !ship->m_removed)
+    {
+        // Handles are read-only to callers, only the Fleet changes the Ship behind one
+        changeState(const_cast<Ship*>(ship), state);
+        return true;
+    }
+    return false;
+}
+
+// Name:    Fleet::setStates
+// Desc:    Sets the state of each Ship with an id in ids to the matching state in states
+//          Through the search layout, each id is looked up directly
+//          Otherwise the ids are searched for in interleaved groups, as in findMany
+// Precon:  ids, states and results must all hold count elements
+//          If an id appears more than once, its last state is the one kept
+// Postcon: Each Ship with an id in ids will have the matching state
+//          results[i] will be whether there is a Ship with id ids[i]
+//          Returns the number of states set
+int Fleet::setStates(const ShipId ids[], const STATE states[], int count, bool results[])
+{
+    for(int i = 0; i < count && m_trace != nullptr; i++)
+    {
+        trace(TRACE_SET_STATE, ids[i], DEFAULT_TYPE, states[i]);
+    }
+    const bool layout = m_searchLayout && layoutReady(count);
+    Ship* ships[FIND_GROUP];
+    int numSet = 0;
+    for(int start = 0; start < count; start += FIND_GROUP)
+    {
+        const int size = min(FIND_GROUP, count - start);
+        if(layout)
+        {
+            for(int i = 0; i < size; i++)
+            {
+                ships[i] = lookup(ids[start + i]);
+            }
+        }
+        else
+        {
+            treeFindGroup(ids + start, size, ships);
+        }
+        // Apply the states in the order they were passed
+        for(int i = 0; i < size; i++)
+        {
+            if(ships[i] != nullptr)
+            {
+                changeState(ships[i], states[start + i]);
+            }
+            numSet += results[start + i] = ships[i] != nullptr;
+        }
+    }
+    return numSet;
+}
+
 // Name:    Fleet::removeLost
 // Desc:    Removes all Ships whose m_state is LOST
+//          The remaining Ships are rebuilt into a balanced tree, which takes linear time
 // Precon:  None
 // Postcon: Fleet will be balanced and will not contain any Ships with m_state LOST
 void Fleet::removeLost()
 {
-    while(recursRemoveLost(m_root));
+    trace(TRACE_REMOVE_LOST, DEFAULT_ID);
+    // Record the removals before the LOST Ships are deleted
+    if(m_changeStream)
+    {
+        vector<Ship*> ships;
+        collectShips(m_root, ships);
+        for(Ship* ship : ships)
+        {
+            if(!ship->m_removed
+                && ship->m_state == LOST)
+            {
+                record(REMOVED, ship);
+            }
+        }
+    }
+    rebuild(true);
+}
+
+// Name:    Fleet::setLazyRemove
+// Desc:    Turns lazy removal on or off
+//          While on, remove flags Ships instead of rebalancing, and the tree is compacted
+//          once flagged Ships make up more than threshold of it
+// Precon:  threshold should be in (0, 1]
+// Postcon: Lazy removal will be on if enabled is true
+//          If it is turned off, any flagged Ships are compacted away
+void Fleet::setLazyRemove(bool enabled, double threshold)
+{
+    m_lazyRemove = enabled;
+    m_compactThreshold = threshold;
+    if(!enabled
+        && m_tombstones > 0)
+    {
+        compact();
+    }
+}
+
+// Name:    Fleet::compact
+// Desc:    Deletes every lazily removed Ship and rebuilds the rest into a balanced tree
+// Precon:  None
+// Postcon: Fleet will be balanced and contain no lazily removed Ships
+void Fleet::compact()
+{
+    rebuild(false);
 }
 
-// Name:    Fleet::recursRemoveLost
-// Desc:    Recursively removes each LOST Ship
+// Name:    Fleet::rebuild
+// Desc:    Deletes every lazily removed Ship, and every LOST Ship if removeLost is true
+//          The tree is split near the root and each part filtered on its own thread, then
+//          the remaining Ships are relinked into a balanced tree in linear time
 // Precon:  None
-// Postcon: If the subtree aShip has any LOST Ships, removes that Ship and returns true
-//          Else returns false
-bool Fleet::recursRemoveLost(Ship* aShip)
+// Postcon: Fleet will be balanced and will only contain the kept Ships
+//          If no Ships were deleted, the tree is left unchanged
+void Fleet::rebuild(bool removeLost)
+{
+    vector<Ship*> ships;
+    ships.reserve(m_size);
+    // Nothing was deleted, the tree is already balanced
+    if(filterShips(m_root, ships, removeLost, getSplits(m_size + m_tombstones)) == 0)
+    {
+        return;
+    }
+    relink(ships.data(), ships.size());
+}
+
+// Name:    Fleet::filterShips
+// Desc:    Recursively appends each kept Ship in the subtree to kept, in order, and deletes the rest
+//          Lazily removed Ships are deleted, as are LOST Ships if removeLost is true
+//          While splits is positive, the left subtree is filtered on another thread
+// Precon:  None
+// Postcon: kept will end with the subtree's kept Ships sorted by id
+//          Returns the number of Ships deleted
+int Fleet::filterShips(Ship* aShip, vector<Ship*>& kept, bool removeLost, int splits)
 {
-    // No lost Ships found
     if(aShip == nullptr)
     {
-        return false;
+        return 0;
     }
-    // Lost Ship found, remove it
-    else if(aShip->m_state == LOST)
+    // aShip may be deleted below, so read its children first
+    Ship* leftChild = aShip->m_left;
+    Ship* right = aShip->m_right;
+    // Filter the left subtree on another thread into its own list, to be put in front of the rest
+    vector<Ship*> left;
+    int leftDeleted = 0;
+    thread leftThread;
+    if(splits > 0)
     {
-        remove(aShip->m_id);
-        return true;
+        leftThread = thread([&]() {leftDeleted = filterShips(leftChild, left, removeLost, splits - 1);});
+    }
+    else
+    {
+        leftDeleted = filterShips(leftChild, kept, removeLost, 0);
+    }
+    vector<Ship*> rest;
+    vector<Ship*>& after = (splits > 0 ? rest : kept);
+    int deleted = 0;
+    // Keep or delete this Ship
+    if(aShip->m_removed
+        || (removeLost && aShip->m_state == LOST))
+    {
+        freeShip(aShip);
+        deleted++;
+    }
+    else
+    {
+        after.push_back(aShip);
+    }
+    deleted += filterShips(right, after, removeLost, max(0, splits - 1));
+    // Join the left list and the rest
+    if(splits > 0)
+    {
+        leftThread.join();
+        kept.insert(kept.end(), left.begin(), left.end());
+        kept.insert(kept.end(), rest.begin(), rest.end());
+    }
+    return leftDeleted + deleted;
+}
+
+// Name:    Fleet::relink
+// Desc:    Links the sorted Ships into a balanced tree, which becomes the Fleet
+// Precon:  ships must hold size Ships sorted by id, none lazily removed
+//          The Fleet must not contain any other Ships
+// Postcon: Fleet will be balanced and contain exactly the passed Ships
+void Fleet::relink(Ship* ships[], int size)
+{
+    // Every Ship is BLACK except for those on the deepest level, which are RED
+    int redDepth = 0;
+    while((2 << redDepth) <= size)
+    {
+        redDepth++;
+    }
+    m_root = buildTree(ships, 0, size, 0, redDepth, getSplits(size));
+    if(m_root != nullptr)
+    {
+        m_root->m_color = BLACK;
+    }
+    if(m_threading)
+    {
+        threadShips(ships, size);
+    }
+    m_size = size;
+    m_tombstones = 0;
+    treeChanged();
+    clearCache();
+    verify();
+}
+
+// Name:    Fleet::buildTree
+// Desc:    Recursively links the sorted Ships in ships[start, end) into a balanced subtree
+//          Splitting at the middle puts every null child on one of the two deepest levels,
+//          so coloring just the deepest level RED gives every path the same number of BLACK Ships
+//          While splits is positive, the left subtree is built on another thread
+// Precon:  ships[start, end) must be sorted by id
+//          redDepth must be the depth of the deepest level of the whole tree
+// Postcon: Returns the root of the subtree
+Ship* Fleet::buildTree(Ship* ships[], int start, int end, int depth, int redDepth, int splits)
+{
+    if(start >= end)
+    {
+        return nullptr;
+    }
+    int middle = start + (end - start) / 2;
+    Ship* aShip = ships[middle];
+    // Build the left subtree on another thread
+    if(splits > 0)
+    {
+        thread left([=]() {aShip->m_left = buildTree(ships, start, middle, depth + 1, redDepth, splits - 1);});
+        aShip->m_right = buildTree(ships, middle + 1, end, depth + 1, redDepth, splits - 1);
+        left.join();
     }
-    // Look for lost Ships in the subtrees
     else
     {
-        return recursRemoveLost(aShip->m_left) || recursRemoveLost(aShip->m_right);
+        aShip->m_left = buildTree(ships, start, middle, depth + 1, redDepth, 0);
+        aShip->m_right = buildTree(ships, middle + 1, end, depth + 1, redDepth, 0);
     }
+    aShip->m_color = (depth == redDepth ? RED : BLACK);
+#ifdef FLEET_AVL
+    updateHeight(aShip);
+#endif
+    if(m_hashing)
+    {
+        setSubtreeHash(aShip, shipHash(aShip) + subtreeHash(aShip->m_left) + subtreeHash(aShip->m_right));
+    }
+    return aShip;
 }
 
 // Name:    Fleet::findShip
 // Desc:    Searches for a Ship with the passed id
+//          Lookups, with find and findMany, may run on several threads at once while nothing changes the Fleet,
+//          search layout and all, but not while the cache or tracing is on, as every lookup then writes to them
 // Precon:  None
 // Postcon: If there is a Ship with the passed id, returns true
 //          Else returns false
-bool Fleet::findShip(int id) const
+bool Fleet::findShip(ShipId id) const
 {
-    // Iterate through the tree
-    for(Ship* iter = m_root; iter != nullptr; iter = (iter->m_id > id ? iter->m_left : iter->m_right))
+    trace(TRACE_FIND, id);
+    return lookup(id) != nullptr;
+}
+
+// Name:    Fleet::find
+// Desc:    Searches for a Ship with the passed id and returns a read-only handle to it
+//          Changes go through the Fleet, with setState and heartbeat, which keep the hashes, deadlines,
+//          change stream and cache in step with the Ship
+//          Removal relinks Ships instead of copying them, so the handle keeps pointing to the same Ship
+//          until that Ship is removed, whether by remove, removeLost or advance with removeLost,
+//          or the Fleet is cleared, rebuilt with build or moved with setPlacement; after that it dangles
+// Precon:  None
+// Postcon: If there is a Ship with the passed id, returns it
+//          Else returns nullptr
+const Ship* Fleet::find(ShipId id) const
+{
+    trace(TRACE_FIND, id);
+    return lookup(id);
+}
+
+// Name:    Fleet::lookup
+// Desc:    Searches for a Ship with the passed id, through the search layout if it is on
+// Precon:  None
+// Postcon: If there is a Ship with the passed id that hasn't been lazily removed, returns it
+//          Else returns nullptr
+Ship* Fleet::lookup(ShipId id) const
+{
+    if(m_cache)
     {
-        // Found the Ship
-        if(iter->m_id == id)
+        // Empty slots hold DEFAULT_ID, which must not match a lookup of DEFAULT_ID itself
+        const int slot = id & (CACHE_SIZE - 1);
+        if(m_cacheIds[slot] == id
+            && id != DEFAULT_ID)
         {
-            return true;
+            m_cacheHits++;
+            return m_cacheShips[slot];
         }
+        m_cacheMisses++;
     }
-    // The Ship was never found
-    return false;
-}
\ No newline at end of file
+    Ship* ship = (m_searchLayout ? layoutFind(id) : findNode(id));
+    if(ship == nullptr
+        || ship->m_removed)
+    {
+        return nullptr;
+    }
+    // Keep the Ship for next time, replacing whatever was in its slot
+    if(m_cache)
+    {
+        m_cacheIds[id & (CACHE_SIZE - 1)] = id;
+        m_cacheShips[id & (CACHE_SIZE - 1)] = ship;
+    }
+    return ship;
+}
+
+// Name:    Fleet::findMany
+// Desc:    Searches for each of the passed ids at once
+//          The searches are interleaved so that their memory accesses overlap instead of
+//          each one waiting on the last
+//          Like findShip, it may run on several threads at once while nothing changes the Fleet
+// Precon:  ids and found must both hold count elements
+// Postcon: found[i] will be whether there is a Ship with id ids[i]
+//          Returns the number of ids found
+int Fleet::findMany(const ShipId ids[], int count, bool found[]) const
+{
+    for(int i = 0; i < count && m_trace != nullptr; i++)
+    {
+        trace(TRACE_FIND, ids[i]);
+    }
+    if(m_searchLayout && layoutReady(count))
+    {
+        layoutFindMany(ids, count, found);
+    }
+    else
+    {
+        treeFindMany(ids, count, found);
+    }
+    int numFound = 0;
+    for(int i = 0; i < count; i++)
+    {
+        numFound += found[i];
+    }
+    return numFound;
+}
+
+// Name:    Fleet::treeFindMany
+// Desc:    Searches the tree for each of the passed ids, a group at a time
+// Precon:  ids and found must both hold count elements
+// Postcon: found[i] will be whether there is a Ship with id ids[i]
+void Fleet::treeFindMany(const ShipId ids[], int count, bool found[]) const
+{
+    Ship* ships[FIND_GROUP];
+    for(int start = 0; start < count; start += FIND_GROUP)
+    {
+        const int size = min(FIND_GROUP, count - start);
+        treeFindGroup(ids + start, size, ships);
+        for(int i = 0; i < size; i++)
+        {
+            found[start + i] = ships[i] != nullptr;
+        }
+    }
+}
+
+// Name:    Fleet::treeFindGroup
+// Desc:    Searches the tree for a group of ids, moving every search in the group down one level per pass
+//          Each search prefetches its next Ship, which loads while the rest of the group is compared
+// Precon:  ids and ships must both hold size elements
+//          size must be at most FIND_GROUP
+// Postcon: ships[i] will be the Ship with id ids[i], or nullptr if there is none
+void Fleet::treeFindGroup(const ShipId ids[], int size, Ship* ships[]) const
+{
+    Ship* iters[FIND_GROUP];
+    for(int i = 0; i < size; i++)
+    {
+        iters[i] = m_root;
+        ships[i] = nullptr;
+    }
+    // Keep passing over the group until every search has finished
+    for(bool searching = true; searching; )
+    {
+        searching = false;
+        for(int i = 0; i < size; i++)
+        {
+            Ship* iter = iters[i];
+            if(iter != nullptr)
+            {
+                // Found the Ship, this search is finished
+                if(iter->m_id == ids[i])
+                {
+                    ships[i] = (iter->m_removed ? nullptr : iter);
+                    iter = nullptr;
+                }
+                else
+                {
+                    iter = (iter->m_id > ids[i] ? iter->m_left : iter->m_right);
+                    if(iter != nullptr)
+                    {
+                        __builtin_prefetch(iter);
+                        searching = true;
+                    }
+                }
+                iters[i] = iter;
+            }
+        }
+    }
+}
+
+// Name:    Fleet::layoutFindMany
+// Desc:    Searches the search layout for groups of ids, moving every search in the group down one level per pass
+//          With AVX2, 8 searches are compared per instruction and their loads are gathered together
+// Precon:  ids and found must both hold count elements
+//          The search layout must be up to date
+// Postcon: found[i] will be whether there is a Ship with id ids[i]
+void Fleet::layoutFindMany(const ShipId ids[], int count, bool found[]) const
+{
+    const int size = m_layoutIds.size() - 1;
+    const ShipId* layout = m_layoutIds.data();
+    // A descent takes at most one pass per level
+    int levels = 0;
+    while((1 << levels) <= size)
+    {
+        levels++;
+    }
+    int indexes[FIND_GROUP];
+    for(int start = 0; start < count; start += FIND_GROUP)
+    {
+        const int groupSize = min(FIND_GROUP, count - start);
+        int i = 0;
+#if defined(__AVX2__) && defined(FLEET_WIDE_IDS)
+        // Wide ids fill a register four at a time, the indexes stay 32 bits wide
+        const __m128i last = _mm_set1_epi32(size);
+        const __m256i evens = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+        for(; i + 4 <= groupSize; i += 4)
+        {
+            const __m256i targets = _mm256_loadu_si256((const __m256i*) (ids + start + i));
+            __m128i index = _mm_set1_epi32(1);
+            for(int level = 0; level < levels; level++)
+            {
+                const __m128i active = _mm_xor_si128(_mm_cmpgt_epi32(index, last), _mm_set1_epi32(-1));
+                const __m256i keys = _mm256_mask_i32gather_epi64(_mm256_setzero_si256(), (const long long*) layout, index, _mm256_cvtepi32_epi64(active), 8);
+                // Narrow the 64 bit comparisons back down to the indexes' lanes
+                const __m128i less = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(_mm256_cmpgt_epi64(targets, keys), evens));
+                const __m128i next = _mm_sub_epi32(_mm_add_epi32(index, index), less);
+                index = _mm_blendv_epi8(index, next, active);
+            }
+            _mm_storeu_si128((__m128i*) (indexes + i), index);
+        }
+#elif defined(__AVX2__)
+        const __m256i last = _mm256_set1_epi32(size);
+        for(; i + 8 <= groupSize; i += 8)
+        {
+            const __m256i targets = _mm256_loadu_si256((const __m256i*) (ids + start + i));
+            __m256i index = _mm256_set1_epi32(1);
+            for(int level = 0; level < levels; level++)
+            {
+                // Searches whose index passed the end of the layout stay where they are
+                const __m256i active = _mm256_xor_si256(_mm256_cmpgt_epi32(index, last), _mm256_set1_epi32(-1));
+                const __m256i keys = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), layout, index, active, 4);
+                // index = 2 * index + (keys < targets), the comparison gives -1 for true
+                const __m256i next = _mm256_sub_epi32(_mm256_add_epi32(index, index), _mm256_cmpgt_epi32(targets, keys));
+                index = _mm256_blendv_epi8(index, next, active);
+            }
+            _mm256_storeu_si256((__m256i*) (indexes + i), index);
+        }
+#endif
+        // Any searches left over are moved down together one level per pass
+        for(int j = i; j < groupSize; j++)
+        {
+            indexes[j] = 1;
+        }
+        for(int level = 0; level < levels; level++)
+        {
+            for(int j = i; j < groupSize; j++)
+            {
+                if(indexes[j] <= size)
+                {
+                    indexes[j] = 2 * indexes[j] + (layout[indexes[j]] < ids[start + j]);
+                    if(16 * indexes[j] <= size)
+                    {
+                        __builtin_prefetch(layout + 16 * indexes[j]);
+#ifdef FLEET_WIDE_IDS
+                        __builtin_prefetch(layout + 16 * indexes[j] + 8);
+#endif
+                    }
+                }
+            }
+        }
+        // Undo the right turns taken after each search's last left turn, as in layoutFind
+        for(int j = 0; j < groupSize; j++)
+        {
+            const int index = indexes[j] >> __builtin_ffs(~indexes[j]);
+            found[start + j] = index != 0 && layout[index] == ids[start + j] && !m_layoutShips[index]->m_removed;
+        }
+    }
+}
+
+// Name:    Fleet::findShipNear
+// Desc:    Searches for a Ship with the passed id, starting from the last Ship reached by a *Near call
+//          Reaching an id d places away takes about O(log d), so walking ids in order costs O(1) per id
+//          Each call moves the finger, so *Near calls must not run on several threads at once
+// Precon:  None
+// Postcon: If there is a Ship with the passed id, returns true
+//          Else returns false
+bool Fleet::findShipNear(ShipId id) const
+{
+    trace(TRACE_FIND, id, DEFAULT_TYPE, DEFAULT_STATE, true);
+    Ship* ship = fingerSeek(id);
+    return ship != nullptr && !ship->m_removed;
+}
+
+// Name:    Fleet::setStateNear
+// Desc:    Sets the state of the Ship with the passed id, finding it as findShipNear does
+// Precon:  Ship with the passed id must be in the Fleet
+//          Else does nothing and returns false
+// Postcon: Ship with the passed id will have m_state state
+//          Returns true
+bool Fleet::setStateNear(ShipId id, STATE state)
+{
+    trace(TRACE_SET_STATE, id, DEFAULT_TYPE, state, true);
+    Ship* ship = fingerSeek(id);
+    // Found the Ship
+    if(ship != nullptr
+        && !ship->m_removed)
+    {
+        changeState(ship, state);
+        return true;
+    }
+    // The Ship was never found
+    return false;
+}
+
+// Name:    Fleet::insertNear
+// Desc:    Inserts a Ship, finding its position as findShipNear does and rebalancing upwards along the finger
+//          Inserting ids in order costs amortized O(1) per Ship
+// Precon:  The Ship's id must be within [MINID, MAXID] and cannot already exist in the Fleet
+//          Else does nothing
+// Postcon: Fleet will be balanced and contain the new Ship
+//          The finger will be on the new Ship
+void Fleet::insertNear(const Ship& ship)
+{
+    if(ship.m_id < MINID
+        || ship.m_id > MAXID)
+    {
+        trace(TRACE_INSERT, ship.m_id, ship.m_type, ship.m_state, true);
+        return;
+    }
+    Ship* existing = fingerSeek(ship.m_id);
+    // The id was lazily removed or already exists, insert handles both without changing the tree
+    // Calls that go on to insert are traced by insert
+    if(existing != nullptr)
+    {
+        insert(ship);
+        return;
+    }
+#ifdef FLEET_AVL
+    // Rebalancing along the finger is red-black only, so AVL builds insert from the root and move the finger after
+    insert(ship);
+    fingerSeek(ship.m_id);
+#else
+    trace(TRACE_INSERT, ship.m_id, ship.m_type, ship.m_state, true);
+    Ship* newShip = makeShip(ship);
+    if(m_hashing)
+    {
+        setSubtreeHash(newShip, shipHash(newShip));
+        addHash(ship.m_id, subtreeHash(newShip));
+    }
+    int depth = m_fingerDepth;
+    if(m_threading)
+    {
+        linkNeighbours(newShip, (depth > 0 ? m_fingerPath[depth - 1] : nullptr));
+    }
+    // The finger ends on newShip's parent, or is empty if the Fleet is
+    if(depth == 0)
+    {
+        m_root = newShip;
+    }
+    else
+    {
+        (ship.m_id < m_fingerPath[depth - 1]->m_id ? m_fingerPath[depth - 1]->m_left : m_fingerPath[depth - 1]->m_right) = newShip;
+    }
+    m_fingerPath[depth++] = newShip;
+    // Number of Ships at the top of the finger left in place by the rebalancing, newShip's bounds aren't recorded
+    int kept = depth - 1;
+    // Walk up the finger while there is a double RED
+    for(int child = depth - 1; child > 0 && m_fingerPath[child - 1]->m_color == RED; )
+    {
+        // A RED parent is never the root, so the grandparent exists
+        Ship* parent = m_fingerPath[child - 1];
+        Ship* grandparent = m_fingerPath[child - 2];
+        bool parentLeft = grandparent->m_left == parent;
+        Ship* uncle = (parentLeft ? grandparent->m_right : grandparent->m_left);
+        // uncle is RED, recoloring pushes the double RED up to the grandparent
+        if(uncle != nullptr
+            && uncle->m_color == RED)
+        {
+            recolor(grandparent);
+            child -= 2;
+        }
+        // uncle is BLACK or doesn't exist, rotation ends the rebalancing
+        else
+        {
+            // A double rotation is necessary
+            if((parent->m_left == m_fingerPath[child]) != parentLeft)
+            {
+                parent = (parentLeft ? grandparent->m_left : grandparent->m_right) = (parentLeft ? lRotation(parent) : rRotation(parent));
+            }
+            grandparent->m_color = RED;
+            parent->m_color = BLACK;
+            Ship* top = (parentLeft ? rRotation(grandparent) : lRotation(grandparent));
+            // Link the rotated subtree to the great grandparent, or make it the root
+            if(child == 2)
+            {
+                m_root = top;
+            }
+            else
+            {
+                (m_fingerPath[child - 3]->m_left == grandparent ? m_fingerPath[child - 3]->m_left : m_fingerPath[child - 3]->m_right) = top;
+            }
+            kept = child - 2;
+            break;
+        }
+    }
+    m_root->m_color = BLACK;
+    m_size++;
+    treeChanged();
+    record(INSERTED, newShip);
+    // Ships above the rotation kept their places, so the finger only has to be rebuilt below them
+    m_fingerDepth = kept;
+    fingerSeek(ship.m_id);
+    verify();
+#endif
+}
+
+// Name:    Fleet::fingerSeek
+// Desc:    Moves the finger to the Ship with the passed id
+//          Climbs the finger to the lowest Ship whose subtree can hold the id, then searches down from there
+// Precon:  None
+// Postcon: If there is a Ship with the passed id, returns it and the finger ends on it
+//          Else returns nullptr and the finger ends on the Ship that would be its parent
+Ship* Fleet::fingerSeek(ShipId id) const
+{
+    if(m_root == nullptr)
+    {
+        m_fingerDepth = 0;
+        return nullptr;
+    }
+    // Climb to the lowest Ship whose subtree can hold id
+    while(m_fingerDepth > 0
+        && (id < m_fingerLow[m_fingerDepth - 1] || id > m_fingerHigh[m_fingerDepth - 1]))
+    {
+        m_fingerDepth--;
+    }
+    // Start again from the root
+    if(m_fingerDepth == 0)
+    {
+        m_fingerPath[0] = m_root;
+        m_fingerLow[0] = numeric_limits<ShipId>::min();
+        m_fingerHigh[0] = numeric_limits<ShipId>::max();
+        m_fingerDepth = 1;
+    }
+    // Search down, recording the path
+    for(Ship* iter = m_fingerPath[m_fingerDepth - 1]; iter->m_id != id; )
+    {
+        bool left = id < iter->m_id;
+        Ship* next = (left ? iter->m_left : iter->m_right);
+        // The Ship was never found
+        if(next == nullptr)
+        {
+            return nullptr;
+        }
+        m_fingerPath[m_fingerDepth] = next;
+        m_fingerLow[m_fingerDepth] = (left ? m_fingerLow[m_fingerDepth - 1] : iter->m_id + 1);
+        m_fingerHigh[m_fingerDepth] = (left ? iter->m_id - 1 : m_fingerHigh[m_fingerDepth - 1]);
+        m_fingerDepth++;
+        iter = next;
+    }
+    return m_fingerPath[m_fingerDepth - 1];
+}
+
+// Name:    Fleet::findNode
+// Desc:    Searches the tree for a Ship with the passed id
+// Precon:  None
+// Postcon: If there is a Ship with the passed id, returns it
+//          Else returns nullptr
+Ship* Fleet::findNode(ShipId id) const
+{
+    // Iterate through the tree
+    for(Ship* iter = m_root; iter != nullptr; iter = (iter->m_id > id ? iter->m_left : iter->m_right))
+    {
+        // Found the Ship
+        if(iter->m_id == id)
+        {
+            return iter;
+        }
+    }
+    // The Ship was never found
+    return nullptr;
+}
+
+// Name:    Fleet::setPlacement
+// Desc:    Chooses where the Fleet stores its Ships, and moves every Ship there
+//          Slabs are mapped in 2MB runs, with huge pages for HUGE_SLABS, and bound to NUMA node
+//          node or interleaved across all nodes as numa asks; both are best effort
+//          Binding to a node that isn't online leaves the slabs wherever they're first touched, as NUMA_DEFAULT does
+//          Moving the Ships invalidates handles from find, and drops lazily removed Ships
+// Precon:  numa is ignored for HEAP
+// Postcon: Every Ship will be stored as placement and numa ask, in a balanced tree
+void Fleet::setPlacement(PLACEMENT placement, NUMA_POLICY numa, int node)
+{
+    vector<Ship*> ships;
+    ships.reserve(m_size + m_tombstones);
+    collectShips(m_root, ships);
+    ships.erase(remove_if(ships.begin(), ships.end(), [](Ship* ship) {return ship->m_removed;}), ships.end());
+    // Copy the Ships in order of id into the new storage, then release the old storage
+    ShipSlabs* slabs = (placement == HEAP ? nullptr : new ShipSlabs(placement, numa, node));
+    Ship* block = (slabs != nullptr && !ships.empty() ? slabs->allocate(ships.size()) : nullptr);
+    vector<Ship*> moved(ships.size());
+    for(int i = 0; i < (int) ships.size(); i++)
+    {
+        moved[i] = (block != nullptr ? new (block + i) Ship(*ships[i]) : new Ship(*ships[i]));
+        if(moved[i]->m_timer != NO_DEADLINE)
+        {
+            m_wheel->moved(moved[i]);
+        }
+    }
+    deleteAll();
+    delete m_slabs;
+    m_slabs = slabs;
+    relink(moved.data(), moved.size());
+}
+
+// Name:    Fleet::getPlacement
+// Desc:    Gets where the Fleet stores its Ships
+// Precon:  None
+// Postcon: Returns the Fleet's PLACEMENT
+PLACEMENT Fleet::getPlacement() const
+{
+    return (m_slabs != nullptr ? m_slabs->getPlacement() : HEAP);
+}
+
+// Name:    Fleet::setSearchLayout
+// Desc:    Turns the read-optimized search layout on or off
+//          While on, findShip and setState search a copy of the ids stored in BFS (Eytzinger) order
+//          Each cache line then holds 16 ids spread over 4 levels, or 8 wide ids over 3, so a lookup touches far fewer lines
+// Precon:  None
+// Postcon: Lookups will use the search layout if enabled is true, else the tree
+void Fleet::setSearchLayout(bool enabled)
+{
+    m_searchLayout = enabled;
+    treeChanged();
+    // Release the layout's memory when it is no longer used
+    if(!enabled)
+    {
+        vector<ShipId>().swap(m_layoutIds);
+        vector<Ship*>().swap(m_layoutShips);
+    }
+}
+
+// Name:    Fleet::validate
+// Desc:    Walks the whole tree without recursion, checking every Red-Black Tree invariant:
+//          ids within [MINID, MAXID] and in BST order, a BLACK root, no RED Ship with a RED child,
+//          the same number of BLACK Ships on every path to null, no DOUBLEBLACK left over,
+//          or in AVL builds, heights that are up to date and differ by at most 1 between siblings,
+//          Ship counts that match m_size and m_tombstones, subtree hashes that add up while hashing is on,
+//          while threaded, a list that holds the same Ships in order with its links both ways intact,
+//          and heartbeat deadlines only on ALIVE Ships, each one held by the wheel
+// Precon:  None
+// Postcon: Returns an empty string if the Fleet is valid
+//          Else returns a report with one problem per line
+string Fleet::validate() const
+{
+    // A Ship to visit, the smallest and largest id its subtree may hold, and the BLACK Ships above it
+    struct Visit
+    {
+        Ship* ship;
+        ShipId low;
+        ShipId high;
+        int blacks;
+    };
+    string report;
+    int problems = 0;
+    auto problem = [&](const string& text)
+    {
+        if(problems++ < MAX_PROBLEMS)
+        {
+            report += text + "\n";
+        }
+    };
+#ifndef FLEET_AVL
+    if(m_root != nullptr
+        && m_root->m_color != BLACK)
+    {
+        problem("root " + to_string(m_root->m_id) + " is not BLACK");
+    }
+#endif
+#ifndef FLEET_AVL
+    int blackHeight = -1;
+    bool heightsDiffer = false;
+#endif
+    bool linkedTwice = false;
+    int ships = 0;
+    int tombstones = 0;
+    int timed = 0;
+    vector<Visit> stack = {{m_root, MINID, MAXID, 0}};
+    while(!stack.empty())
+    {
+        Visit visit = stack.back();
+        stack.pop_back();
+        Ship* ship = visit.ship;
+        // Null path, compare its BLACK Ships against the first null path found
+        if(ship == nullptr)
+        {
+#ifndef FLEET_AVL
+            if(blackHeight == -1)
+            {
+                blackHeight = visit.blacks;
+            }
+            // Only the first differing path is reported, the rest of its subtree would repeat it
+            else if(visit.blacks != blackHeight
+                && !heightsDiffer)
+            {
+                heightsDiffer = true;
+                problem("a path to null has " + to_string(visit.blacks) + " BLACK Ships instead of " + to_string(blackHeight));
+            }
+#endif
+            continue;
+        }
+        // More Ships than the Fleet holds means a Ship is linked twice, stop before looping forever
+        if(++ships > m_size + m_tombstones)
+        {
+            linkedTwice = true;
+            break;
+        }
+        const string id = to_string(ship->m_id);
+        // A misplaced Ship passes its position's bounds on to its children, so that they aren't all reported too
+        bool misplaced = true;
+        if(ship->m_id < MINID
+            || ship->m_id > MAXID)
+        {
+            problem("Ship " + id + " is outside [" + to_string(MINID) + ", " + to_string(MAXID) + "]");
+        }
+        else if(ship->m_id < visit.low
+            || ship->m_id > visit.high)
+        {
+            problem("Ship " + id + " breaks BST order, its position holds [" + to_string(visit.low) + ", " + to_string(visit.high) + "]");
+        }
+        else
+        {
+            misplaced = false;
+        }
+#ifdef FLEET_AVL
+        const int leftHeight = heightOf(ship->m_left);
+        const int rightHeight = heightOf(ship->m_right);
+        if(ship->m_height != 1 + max(leftHeight, rightHeight))
+        {
+            problem("Ship " + id + " has height " + to_string(ship->m_height) + " but its subtrees give it " + to_string(1 + max(leftHeight, rightHeight)));
+        }
+        else if(abs(leftHeight - rightHeight) > 1)
+        {
+            problem("Ship " + id + " has subtrees whose heights differ by " + to_string(abs(leftHeight - rightHeight)));
+        }
+#else
+        if(ship->m_color == DOUBLEBLACK)
+        {
+            problem("Ship " + id + " is DOUBLEBLACK");
+        }
+        else if(ship->m_color == RED
+            && ((ship->m_left != nullptr && ship->m_left->m_color == RED)
+            || (ship->m_right != nullptr && ship->m_right->m_color == RED)))
+        {
+            problem("RED Ship " + id + " has a RED child");
+        }
+#endif
+        if(m_hashing
+            && subtreeHash(ship) != shipHash(ship) + subtreeHash(ship->m_left) + subtreeHash(ship->m_right))
+        {
+            problem("Ship " + id + " has a stale subtree hash");
+        }
+        if(ship->m_timer != NO_DEADLINE)
+        {
+            timed++;
+            if(m_wheel == nullptr
+                || !m_wheel->holds(ship))
+            {
+                problem("Ship " + id + " has a heartbeat deadline the Fleet doesn't hold");
+            }
+            else if(ship->m_removed
+                || ship->m_state == LOST)
+            {
+                problem("Ship " + id + " is " + (ship->m_removed ? "lazily removed" : "LOST") + " but still has a heartbeat deadline");
+            }
+        }
+        tombstones += ship->m_removed;
+        const int blacks = visit.blacks + (ship->m_color != RED);
+        stack.push_back({ship->m_right, (misplaced ? visit.low : ship->m_id + 1), visit.high, blacks});
+        stack.push_back({ship->m_left, visit.low, (misplaced ? visit.high : ship->m_id - 1), blacks});
+    }
+    // The walk stopped early, so the counts below would be meaningless
+    if(linkedTwice)
+    {
+        report.insert(0, "more Ships are linked than the Fleet holds, a Ship is linked twice\n");
+    }
+    else
+    {
+        if(ships - tombstones != m_size)
+        {
+            problem(to_string(ships - tombstones) + " Ships are linked but the size is " + to_string(m_size));
+        }
+        if(tombstones != m_tombstones)
+        {
+            problem(to_string(tombstones) + " lazily removed Ships are linked but " + to_string(m_tombstones) + " are counted");
+        }
+        if(m_wheel != nullptr
+            && timed != m_wheel->getCount())
+        {
+            problem(to_string(timed) + " linked Ships have heartbeat deadlines but the wheel holds " + to_string(m_wheel->getCount()));
+        }
+        // Walk the threaded list, stopping once it holds more Ships than the tree in case it loops
+        if(m_threading)
+        {
+            int threaded = 0;
+            const Ship* previous = nullptr;
+            for(const Ship* ship = m_first; ship != nullptr && threaded <= ships; ship = nextOf(ship))
+            {
+                if(prevOf(ship) != previous)
+                {
+                    problem("threaded Ship " + to_string(ship->m_id) + " does not link back to the Ship before it");
+                }
+                if(previous != nullptr
+                    && ship->m_id <= previous->m_id)
+                {
+                    problem("threaded Ship " + to_string(ship->m_id) + " comes after Ship " + to_string(previous->m_id));
+                }
+                previous = ship;
+                threaded++;
+            }
+            if(previous != m_last)
+            {
+                problem("the threaded list does not end at its last Ship");
+            }
+            if(threaded != ships)
+            {
+                problem(to_string(threaded) + " Ships are threaded but " + to_string(ships) + " are linked");
+            }
+        }
+    }
+    if(problems > MAX_PROBLEMS)
+    {
+        report += "and " + to_string(problems - MAX_PROBLEMS) + " more problems\n";
+    }
+    return report;
+}
+
+// Name:    Fleet::memoryUsage
+// Desc:    Adds up the memory the Fleet takes up: its Ships, the allocator's overhead around them,
+//          the Fleet itself and its search layout, and memory held without being used
+// Precon:  None
+// Postcon: Returns the bytes used, by where they go
+MemoryUsage Fleet::memoryUsage() const
+{
+    const long long perShip = allocatorOverhead();
+    MemoryUsage usage;
+    usage.nodes = m_size * (long long) sizeof(Ship);
+    usage.overhead = m_size * perShip;
+    // Slabs have no per-Ship overhead, but any part of them not holding a live Ship is unused
+    if(m_slabs != nullptr)
+    {
+        usage.overhead = 0;
+    }
+    usage.indexes = sizeof(Fleet) + m_layoutIds.size() * sizeof(ShipId) + m_layoutShips.size() * sizeof(Ship*) + m_changes.size() * sizeof(Change)
+        + (m_wheel != nullptr ? m_wheel->getBytes() : 0);
+    usage.fragmentation = (m_slabs != nullptr ? m_slabs->getReserved() - usage.nodes : m_tombstones * (sizeof(Ship) + perShip))
+        + (m_layoutIds.capacity() - m_layoutIds.size()) * sizeof(ShipId)
+        + (m_layoutShips.capacity() - m_layoutShips.size()) * sizeof(Ship*)
+        + (m_changes.capacity() - m_changes.size()) * sizeof(Change);
+    return usage;
+}
+
+// Name:    Fleet::setChangeStream
+// Desc:    Turns the change stream on or off
+//          While on, every insertion, removal, state change and clear is recorded in order, to be taken
+//          with takeChanges and applied to replicas with applyChanges
+// Precon:  None
+// Postcon: Changes will be recorded if enabled is true
+//          Changes recorded but not yet taken are kept either way
+void Fleet::setChangeStream(bool enabled)
+{
+    m_changeStream = enabled;
+}
+
+// Name:    Fleet::takeChanges
+// Desc:    Moves the changes recorded since the last call to the end of changes
+//          Changes pile up until taken, so a streaming Fleet should be drained regularly
+// Precon:  None
+// Postcon: changes will end with the recorded changes in order of sequence
+//          Returns the number of changes taken
+int Fleet::takeChanges(vector<Change>& changes)
+{
+    const int count = m_changes.size();
+    changes.insert(changes.end(), m_changes.begin(), m_changes.end());
+    m_changes.clear();
+    return count;
+}
+
+// Name:    Fleet::applyChanges
+// Desc:    Applies a batch of another Fleet's changes to this replica, in order of sequence
+//          Changes the replica already has are skipped, so batches may overlap a snapshot or each other
+// Precon:  changes must hold count changes in order of sequence
+// Postcon: Applies changes up to the first one that doesn't follow the last change applied
+//          Returns the number of changes consumed, less than count if a change is missing
+int Fleet::applyChanges(const Change changes[], int count)
+{
+    int i = 0;
+    for(; i < count; i++)
+    {
+        const Change& change = changes[i];
+        // Already applied
+        if(change.sequence <= m_sequence)
+        {
+            continue;
+        }
+        // A change is missing, the replica has to catch up from a snapshot
+        if(change.sequence != m_sequence + 1)
+        {
+            break;
+        }
+        switch(change.kind)
+        {
+            case INSERTED:
+                insert(Ship(change.id, static_cast<SHIPTYPE>(change.type), static_cast<STATE>(change.state)));
+                break;
+            case REMOVED:
+                remove(change.id);
+                break;
+            case STATE_SET:
+                setState(change.id, static_cast<STATE>(change.state));
+                break;
+            case CLEARED:
+                clear();
+                break;
+        }
+        m_sequence = change.sequence;
+    }
+    return i;
+}
+
+// Name:    Fleet::snapshot
+// Desc:    Appends an INSERTED change for each Ship, all numbered with the current sequence
+//          Together with the changes taken after it, a snapshot lets a new replica catch up
+// Precon:  None
+// Postcon: changes will end with one change per Ship, in order of id
+//          Returns the sequence the snapshot was taken at
+uint64_t Fleet::snapshot(vector<Change>& changes) const
+{
+    vector<Ship*> ships;
+    ships.reserve(m_size + m_tombstones);
+    collectShips(m_root, ships);
+    for(Ship* ship : ships)
+    {
+        if(!ship->m_removed)
+        {
+            changes.push_back({m_sequence, ship->m_id, INSERTED, (uint8_t) ship->m_type, (uint8_t) ship->m_state});
+        }
+    }
+    return m_sequence;
+}
+
+// Name:    Fleet::restore
+// Desc:    Replaces the Ships with those in a snapshot, without recording any changes
+// Precon:  changes must hold count changes from snapshot, taken at sequence
+// Postcon: Fleet will contain exactly the snapshot's Ships, and will apply changes after sequence next
+void Fleet::restore(const Change changes[], int count, uint64_t sequence)
+{
+    vector<Ship> ships;
+    ships.reserve(count);
+    for(int i = 0; i < count; i++)
+    {
+        ships.emplace_back(changes[i].id, static_cast<SHIPTYPE>(changes[i].type), static_cast<STATE>(changes[i].state));
+    }
+    const bool streaming = m_changeStream;
+    m_changeStream = false;
+    build(ships.data(), ships.size());
+    m_changeStream = streaming;
+    m_sequence = sequence;
+}
+
+// Name:    Fleet::record
+// Desc:    Appends a change to the change stream, if it is on
+// Precon:  ship must be the changed Ship, or nullptr for CLEARED
+// Postcon: If the change stream is on, the change will be recorded with the next sequence
+void Fleet::record(CHANGE kind, const Ship* ship)
+{
+    if(m_changeStream)
+    {
+        m_changes.push_back({++m_sequence, (ship != nullptr ? ship->m_id : DEFAULT_ID), (uint8_t) kind,
+            (uint8_t) (ship != nullptr ? ship->m_type : DEFAULT_TYPE), (uint8_t) (ship != nullptr ? ship->m_state : DEFAULT_STATE)});
+    }
+}
+
+// Name:    Fleet::changeState
+// Desc:    Sets a Ship's state, keeping the subtree hashes and the change stream up to date
+//          A LOST Ship's heartbeat deadline is dropped until its next heartbeat
+// Precon:  ship must be in the Fleet and not lazily removed
+// Postcon: ship will have m_state state
+void Fleet::changeState(Ship* ship, STATE state)
+{
+    const uint64_t before = (m_hashing ? shipHash(ship) : 0);
+    ship->m_state = state;
+    if(state == LOST
+        && ship->m_timer != NO_DEADLINE)
+    {
+        m_wheel->unschedule(ship);
+    }
+    if(m_hashing)
+    {
+        addHash(ship->m_id, shipHash(ship) - before);
+    }
+    record(STATE_SET, ship);
+}
+
+// Name:    Fleet::setHashing
+// Desc:    Turns hashing on or off
+//          While on, each Ship keeps the hash of its subtree's contents through every change and rotation,
+//          which costs one more walk down the tree per change
+//          Only builds with SUBTREE_HASHES have room for the hashes, in others hashing stays off
+// Precon:  None
+// Postcon: If enabled is true and the build has SUBTREE_HASHES, every subtree hash will be up to date
+void Fleet::setHashing(bool enabled)
+{
+    enabled = enabled && SUBTREE_HASHES;
+    if(enabled
+        && !m_hashing)
+    {
+        rehash(m_root);
+    }
+    m_hashing = enabled;
+}
+
+// Name:    Fleet::getHash
+// Desc:    Gets the hash of the Fleet's contents, the sum of the hashes of its Ships' ids, types and states
+//          Fleets with the same Ships have the same hash whatever the shape of their trees
+// Precon:  None
+// Postcon: Returns the hash, in constant time while hashing is on and linear time otherwise
+uint64_t Fleet::getHash() const
+{
+    if(m_hashing)
+    {
+        return subtreeHash(m_root);
+    }
+    vector<Ship*> ships;
+    ships.reserve(m_size + m_tombstones);
+    collectShips(m_root, ships);
+    uint64_t hash = 0;
+    for(Ship* ship : ships)
+    {
+        hash += shipHash(ship);
+    }
+    return hash;
+}
+
+// Name:    Fleet::sameShips
+// Desc:    Compares the contents of two Fleets by their hashes
+//          Different contents collide with a chance of about 1 in 2^64
+// Precon:  None
+// Postcon: Returns true if the Fleets hold the same Ships
+//          Else returns false
+bool Fleet::sameShips(const Fleet& other) const
+{
+    return m_size == other.m_size
+        && getHash() == other.getHash();
+}
+
+// Name:    Fleet::diff
+// Desc:    Finds the ids whose Ships differ between two Fleets: in only one of them, or with a different type or state
+//          With both Fleets hashing, only subtrees whose hash differs from the same id range of the other Fleet
+//          are searched, which takes O(d log^2 n) for d differences, otherwise both Fleets are walked in full
+// Precon:  None
+// Postcon: ids will end with the differing ids in order
+//          Returns the number of differing ids
+int Fleet::diff(const Fleet& other, vector<ShipId>& ids) const
+{
+    const int start = ids.size();
+    if(m_hashing
+        && other.m_hashing)
+    {
+        diffRange(m_root, MINID, MAXID, other, ids);
+        return ids.size() - start;
+    }
+    // Merge the two Fleets' Ships in order
+    vector<Ship*> mine, theirs;
+    collectShips(m_root, mine);
+    other.collectShips(other.m_root, theirs);
+    auto live = [](const vector<Ship*>& ships, size_t i) {return i < ships.size() && !ships[i]->m_removed;};
+    size_t i = 0;
+    size_t j = 0;
+    while(i < mine.size()
+        || j < theirs.size())
+    {
+        // Skip lazily removed Ships
+        if(i < mine.size() && !live(mine, i))
+        {
+            i++;
+        }
+        else if(j < theirs.size() && !live(theirs, j))
+        {
+            j++;
+        }
+        else if(j == theirs.size()
+            || (i < mine.size() && mine[i]->m_id < theirs[j]->m_id))
+        {
+            ids.push_back(mine[i++]->m_id);
+        }
+        else if(i == mine.size()
+            || theirs[j]->m_id < mine[i]->m_id)
+        {
+            ids.push_back(theirs[j++]->m_id);
+        }
+        else
+        {
+            if(mine[i]->m_type != theirs[j]->m_type
+                || mine[i]->m_state != theirs[j]->m_state)
+            {
+                ids.push_back(mine[i]->m_id);
+            }
+            i++;
+            j++;
+        }
+    }
+    return ids.size() - start;
+}
+
+// Name:    Fleet::shipHash
+// Desc:    Hashes a Ship's id, type and state by mixing them into 64 bits
+// Precon:  ship must not be nullptr
+// Postcon: Returns the hash, or 0 if the Ship was lazily removed
+uint64_t Fleet::shipHash(const Ship* ship)
+{
+    if(ship->m_removed)
+    {
+        return 0;
+    }
+    // Rotating the id keeps all of a wide id's bits, and leaves an int id shifted clear of the type and state
+    const uint64_t id = (uint64_t) ship->m_id;
+    uint64_t hash = ((id << 16 | id >> 48) ^ ((uint64_t) ship->m_type << 8 | (uint64_t) ship->m_state)) + 0x9E3779B97F4A7C15ULL;
+    hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+    return hash ^ (hash >> 31);
+}
+
+// Name:    Fleet::rehash
+// Desc:    Recursively recomputes the hash of every Ship in the subtree
+// Precon:  None
+// Postcon: Returns the subtree's hash
+uint64_t Fleet::rehash(Ship* aShip)
+{
+    if(aShip == nullptr)
+    {
+        return 0;
+    }
+    setSubtreeHash(aShip, shipHash(aShip) + rehash(aShip->m_left) + rehash(aShip->m_right));
+    return subtreeHash(aShip);
+}
+
+// Name:    Fleet::addHash
+// Desc:    Adds delta to the hash of each Ship on the path from the root to the passed id
+// Precon:  None
+// Postcon: Every Ship whose subtree holds or would hold the id will have delta added
+void Fleet::addHash(ShipId id, uint64_t delta)
+{
+    Ship* aShip = m_root;
+    while(aShip != nullptr)
+    {
+        setSubtreeHash(aShip, subtreeHash(aShip) + delta);
+        if(id == aShip->m_id)
+        {
+            return;
+        }
+        aShip = (id < aShip->m_id ? aShip->m_left : aShip->m_right);
+    }
+}
+
+// Name:    Fleet::prefixHash
+// Desc:    Adds up the hashes of the Ships with ids up to the passed id, walking down one path
+// Precon:  Hashing must be on
+// Postcon: Returns the sum
+uint64_t Fleet::prefixHash(ShipId id) const
+{
+    uint64_t hash = 0;
+    Ship* aShip = m_root;
+    while(aShip != nullptr)
+    {
+        if(aShip->m_id <= id)
+        {
+            hash += shipHash(aShip) + subtreeHash(aShip->m_left);
+            aShip = aShip->m_right;
+        }
+        else
+        {
+            aShip = aShip->m_left;
+        }
+    }
+    return hash;
+}
+
+// Name:    Fleet::diffRange
+// Desc:    Recursively finds the differing ids in [low, high], which aShip's subtree covers in this Fleet
+//          The subtree is skipped when its hash matches the sum of the other Fleet's hashes over the same range
+// Precon:  Both Fleets must be hashing
+// Postcon: ids will end with the differing ids in [low, high] in order
+void Fleet::diffRange(const Ship* aShip, ShipId low, ShipId high, const Fleet& other, vector<ShipId>& ids) const
+{
+    if(low > high
+        || subtreeHash(aShip) == other.prefixHash(high) - other.prefixHash(low - 1))
+    {
+        return;
+    }
+    // Every Ship the other Fleet has in the range differs
+    if(aShip == nullptr)
+    {
+        other.collectRange(other.m_root, low, high, ids);
+        return;
+    }
+    diffRange(aShip->m_left, low, aShip->m_id - 1, other, ids);
+    Ship* match = other.findNode(aShip->m_id);
+    if(shipHash(aShip) != (match != nullptr ? shipHash(match) : 0))
+    {
+        ids.push_back(aShip->m_id);
+    }
+    diffRange(aShip->m_right, aShip->m_id + 1, high, other, ids);
+}
+
+// Name:    Fleet::collectRange
+// Desc:    Recursively appends the id of each Ship in the subtree with an id in [low, high]
+// Precon:  None
+// Postcon: ids will end with the ids in order, lazily removed Ships are skipped
+void Fleet::collectRange(const Ship* aShip, ShipId low, ShipId high, vector<ShipId>& ids) const
+{
+    if(aShip != nullptr)
+    {
+        if(aShip->m_id > low)
+        {
+            collectRange(aShip->m_left, low, high, ids);
+        }
+        if(aShip->m_id >= low
+            && aShip->m_id <= high
+            && !aShip->m_removed)
+        {
+            ids.push_back(aShip->m_id);
+        }
+        if(aShip->m_id < high)
+        {
+            collectRange(aShip->m_right, low, high, ids);
+        }
+    }
+}
+
+// Name:    Fleet::setThreading
+// Desc:    Turns threading on or off
+//          While on, every Ship is also kept in a list in order of id, so that successor and predecessor take O(1),
+//          first and last are read off the ends of the list, and exportShips walks the list without a stack
+//          Each insertion and removal relinks its neighbours, and an insertion costs one more walk down the tree
+//          Only builds with THREADED_LINKS have room for the links, in others threading stays off
+// Precon:  None
+// Postcon: If enabled is true and the build has THREADED_LINKS, the list will hold every Ship in order
+void Fleet::setThreading(bool enabled)
+{
+    enabled = enabled && THREADED_LINKS;
+    if(enabled
+        && !m_threading)
+    {
+        vector<Ship*> ships;
+        ships.reserve(m_size + m_tombstones);
+        collectShips(m_root, ships);
+        threadShips(ships.data(), ships.size());
+    }
+    m_threading = enabled;
+}
+
+// Name:    Fleet::first
+// Desc:    Finds the Ship with the smallest id
+// Precon:  None
+// Postcon: Returns the Ship, in constant time while threaded, or nullptr if the Fleet is empty
+const Ship* Fleet::first() const
+{
+    if(m_threading)
+    {
+        return (m_first != nullptr && m_first->m_removed ? successor(m_first) : m_first);
+    }
+    return neighbour(numeric_limits<ShipId>::min(), true);
+}
+
+// Name:    Fleet::last
+// Desc:    Finds the Ship with the largest id
+// Precon:  None
+// Postcon: Returns the Ship, in constant time while threaded, or nullptr if the Fleet is empty
+const Ship* Fleet::last() const
+{
+    if(m_threading)
+    {
+        return (m_last != nullptr && m_last->m_removed ? predecessor(m_last) : m_last);
+    }
+    return neighbour(numeric_limits<ShipId>::max(), false);
+}
+
+// Name:    Fleet::successor
+// Desc:    Finds the Ship with the next larger id, skipping lazily removed Ships
+//          Takes O(1) while threaded, apart from any lazily removed Ships passed over, and O(log n) otherwise
+// Precon:  ship must be a handle to a Ship in the Fleet, from find, first, last, successor or predecessor
+// Postcon: Returns the next Ship, or nullptr if ship is the last
+const Ship* Fleet::successor(const Ship* ship) const
+{
+    if(!m_threading)
+    {
+        return neighbour(ship->m_id, true);
+    }
+    Ship* next = nextOf(ship);
+    while(next != nullptr
+        && next->m_removed)
+    {
+        next = nextOf(next);
+    }
+    return next;
+}
+
+// Name:    Fleet::predecessor
+// Desc:    Finds the Ship with the next smaller id, skipping lazily removed Ships
+//          Takes O(1) while threaded, apart from any lazily removed Ships passed over, and O(log n) otherwise
+// Precon:  ship must be a handle to a Ship in the Fleet, from find, first, last, successor or predecessor
+// Postcon: Returns the previous Ship, or nullptr if ship is the first
+const Ship* Fleet::predecessor(const Ship* ship) const
+{
+    if(!m_threading)
+    {
+        return neighbour(ship->m_id, false);
+    }
+    Ship* prev = prevOf(ship);
+    while(prev != nullptr
+        && prev->m_removed)
+    {
+        prev = prevOf(prev);
+    }
+    return prev;
+}
+
+// Name:    Fleet::findParent
+// Desc:    Finds the Ship that a new Ship with the passed id would be linked under, before any rebalancing
+// Precon:  No Ship with the passed id may be in the tree
+// Postcon: Returns the parent, or nullptr if the Fleet is empty
+Ship* Fleet::findParent(ShipId id) const
+{
+    Ship* parent = nullptr;
+    for(Ship* iter = m_root; iter != nullptr; iter = (id < iter->m_id ? iter->m_left : iter->m_right))
+    {
+        parent = iter;
+    }
+    return parent;
+}
+
+// Name:    Fleet::neighbour
+// Desc:    Searches the tree for the Ship with the closest id after the passed id if next is true, or before it if not,
+//          searching again past any lazily removed Ships
+// Precon:  None
+// Postcon: Returns the Ship, or nullptr if there is none
+Ship* Fleet::neighbour(ShipId id, bool next) const
+{
+    Ship* closest = nullptr;
+    do
+    {
+        closest = nullptr;
+        // Each Ship past id is closer than the last one found, then look for one closer still on its near side
+        for(Ship* iter = m_root; iter != nullptr; )
+        {
+            if(next ? iter->m_id > id : iter->m_id < id)
+            {
+                closest = iter;
+                iter = (next ? iter->m_left : iter->m_right);
+            }
+            else
+            {
+                iter = (next ? iter->m_right : iter->m_left);
+            }
+        }
+        if(closest != nullptr)
+        {
+            id = closest->m_id;
+        }
+    } while(closest != nullptr
+        && closest->m_removed);
+    return closest;
+}
+
+// Name:    Fleet::linkNeighbours
+// Desc:    Threads a new Ship into the list, given the Ship it will be linked under
+//          A new leaf comes right before its parent if it is a left child, and right after it if not
+// Precon:  ship must not be in the list, and parent must be its parent before rebalancing, or nullptr for an empty Fleet
+// Postcon: ship will be in the list between the Ships with the closest ids on either side
+void Fleet::linkNeighbours(Ship* ship, Ship* parent)
+{
+    Ship* prev = nullptr;
+    Ship* next = nullptr;
+    if(parent != nullptr)
+    {
+        prev = (ship->m_id < parent->m_id ? prevOf(parent) : parent);
+        next = (ship->m_id < parent->m_id ? parent : nextOf(parent));
+    }
+    joinNeighbours(prev, ship);
+    joinNeighbours(ship, next);
+}
+
+// Name:    Fleet::unlinkNeighbours
+// Desc:    Takes a Ship out of the list, joining the Ships on either side of it
+// Precon:  ship must be in the list
+// Postcon: ship will no longer be in the list, though its own links are left as they were
+void Fleet::unlinkNeighbours(Ship* ship)
+{
+    joinNeighbours(prevOf(ship), nextOf(ship));
+}
+
+// Name:    Fleet::joinNeighbours
+// Desc:    Links two Ships next to each other in the list
+// Precon:  None
+// Postcon: next will follow prev, or be m_first if prev is nullptr, and prev will be m_last if next is nullptr
+void Fleet::joinNeighbours(Ship* prev, Ship* next)
+{
+    if(prev != nullptr)
+    {
+        setNext(prev, next);
+    }
+    else
+    {
+        m_first = next;
+    }
+    if(next != nullptr)
+    {
+        setPrev(next, prev);
+    }
+    else
+    {
+        m_last = prev;
+    }
+}
+
+// Name:    Fleet::threadShips
+// Desc:    Links the sorted Ships into the list, replacing whatever it held
+// Precon:  ships must hold size Ships sorted by id
+// Postcon: The list will hold exactly the passed Ships, in order
+void Fleet::threadShips(Ship* ships[], int size)
+{
+    for(int i = 0; i <= size; i++)
+    {
+        joinNeighbours((i > 0 ? ships[i - 1] : nullptr), (i < size ? ships[i] : nullptr));
+    }
+}
+
+// Name:    Fleet::setTrace
+// Desc:    Starts tracing calls to out, or stops tracing if out is nullptr
+//          A trace starts with "FTR1" ("FTR8" in wide builds) and an archive of the Fleet's Ships as writeArchive
+//          writes it, so that a replay starts from the same Ships; the traced calls follow, each as:
+//              1 byte:     the TRACE_OP in bits 0-2, the type in bits 3-5, the state in bit 6 and near in bit 7
+//              varint:     nanoseconds since the last call, or since tracing started
+//              varint:     the id less the last call's id, zigzag encoded, left out for removeLost
+//          Calls are collected in memory and written out in blocks of about 64KB, and when tracing stops
+//          Tracing covers insert, remove, setState, removeLost, findShip and find, with their *Near and batch variants
+// Precon:  out must stay open until tracing stops, and should be opened in binary mode
+// Postcon: Calls will be traced to out while it isn't nullptr
+//          Any calls collected for the last stream are written to it
+void Fleet::setTrace(ostream* out)
+{
+    if(m_trace != nullptr)
+    {
+        flushTrace();
+        m_trace->flush();
+    }
+    m_trace = out;
+    if(m_trace != nullptr)
+    {
+        m_trace->write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+        writeArchive(*m_trace);
+        m_traceLast = traceNanos();
+        m_traceId = DEFAULT_ID;
+    }
+}
+
+// Name:    Fleet::writeTrace
+// Desc:    Encodes one call into the trace buffer, as setTrace describes, writing the buffer out once it fills
+// Precon:  The Fleet must be tracing
+// Postcon: The call will be added to the trace
+void Fleet::writeTrace(TRACE_OP op, ShipId id, SHIPTYPE type, STATE state, bool near) const
+{
+    const uint64_t now = traceNanos();
+    m_traceBuffer.push_back(op | type << 3 | state << 6 | near << 7);
+    putVarint(m_traceBuffer, now - m_traceLast);
+    m_traceLast = now;
+    if(op != TRACE_REMOVE_LOST)
+    {
+        // Zigzag encoding interleaves steps down with steps up, so that a small step either way takes a byte
+        const uint64_t step = (uint64_t) id - (uint64_t) m_traceId;
+        putVarint(m_traceBuffer, step << 1 ^ (uint64_t) ((int64_t) step >> 63));
+        m_traceId = id;
+    }
+    if(m_traceBuffer.size() >= TRACE_BUFFER)
+    {
+        flushTrace();
+    }
+}
+
+// Name:    Fleet::flushTrace
+// Desc:    Writes the calls collected in the trace buffer out to the trace
+// Precon:  The Fleet must be tracing
+// Postcon: The trace buffer will be empty
+void Fleet::flushTrace() const
+{
+    m_trace->write((const char*) m_traceBuffer.data(), m_traceBuffer.size());
+    m_traceBuffer.clear();
+}
+
+// Name:    Fleet::readTrace
+// Desc:    Reads a trace written by a Fleet with setTrace, loading the Ships it started with into fleet
+//          and decoding the calls made after
+// Precon:  in should be opened in binary mode
+// Postcon: If the trace is whole, fleet will hold the Ships the trace started from, records will hold
+//          every traced call in order, and returns true
+//          Else returns false, and records will hold the calls read before the trace was cut short or corrupt
+bool Fleet::readTrace(istream& in, Fleet& fleet, vector<TraceRecord>& records)
+{
+    records.clear();
+    char magic[sizeof(TRACE_MAGIC)];
+    in.read(magic, sizeof(magic));
+    if(!in
+        || memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0
+        || !fleet.loadArchive(in))
+    {
+        return false;
+    }
+    const string bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    const uint8_t* next = (const uint8_t*) bytes.data();
+    const uint8_t* end = next + bytes.size();
+    uint64_t nanos = 0;
+    uint64_t id = DEFAULT_ID;
+    while(next < end)
+    {
+        const uint8_t code = *next++;
+        TraceRecord record;
+        record.op = (TRACE_OP) (code & 7);
+        record.type = (SHIPTYPE) (code >> 3 & 7);
+        record.state = (STATE) (code >> 6 & 1);
+        record.near = code >> 7;
+        uint64_t delta = 0;
+        if(record.op > TRACE_FIND
+            || record.type > ROBOCARRIER
+            || !getVarint(next, end, delta))
+        {
+            return false;
+        }
+        nanos += delta;
+        record.nanos = nanos;
+        record.id = DEFAULT_ID;
+        if(record.op != TRACE_REMOVE_LOST)
+        {
+            uint64_t zigzag = 0;
+            if(!getVarint(next, end, zigzag))
+            {
+                return false;
+            }
+            id += zigzag >> 1 ^ (0 - (zigzag & 1));
+            // Ids from a wider build may not fit
+            if((int64_t) id < numeric_limits<ShipId>::min()
+                || (int64_t) id > numeric_limits<ShipId>::max())
+            {
+                return false;
+            }
+            record.id = (ShipId) (int64_t) id;
+        }
+        records.push_back(record);
+    }
+    return true;
+}
+
+// Name:    Fleet::replay
+// Desc:    Makes the call a trace record describes
+// Precon:  None
+// Postcon: The call will have been made
+//          Returns what findShip and setState, or their *Near variants, returned, or true for any other call
+bool Fleet::replay(const TraceRecord& record)
+{
+    switch(record.op)
+    {
+        case TRACE_INSERT:
+            if(record.near)
+            {
+                insertNear(Ship(record.id, record.type, record.state));
+            }
+            else
+            {
+                insert(Ship(record.id, record.type, record.state));
+            }
+            return true;
+        case TRACE_REMOVE:
+            remove(record.id);
+            return true;
+        case TRACE_SET_STATE:
+            return (record.near ? setStateNear(record.id, record.state) : setState(record.id, record.state));
+        case TRACE_REMOVE_LOST:
+            removeLost();
+            return true;
+        case TRACE_FIND:
+            return (record.near ? findShipNear(record.id) : findShip(record.id));
+    }
+    return false;
+}
+
+// Name:    Fleet::setHeartbeats
+// Desc:    Turns heartbeat expiry on or off
+//          While on, each heartbeat gives its Ship a deadline timeout after it, and advance marks the Ships
+//          whose deadlines pass LOST; times are in whatever unit the caller counts in
+//          Turning it on again only changes the timeout given by later heartbeats
+// Precon:  timeout should be positive
+// Postcon: Heartbeats will be kept if enabled is true
+//          If they are turned off, every deadline is dropped
+void Fleet::setHeartbeats(bool enabled, uint64_t timeout)
+{
+    if(!enabled)
+    {
+        if(m_wheel != nullptr)
+        {
+            m_wheel->forget();
+        }
+        delete m_wheel;
+        m_wheel = nullptr;
+    }
+    else if(m_wheel == nullptr)
+    {
+        m_wheel = new HeartbeatWheel(timeout);
+    }
+    else
+    {
+        m_wheel->setTimeout(timeout);
+    }
+}
+
+// Name:    Fleet::heartbeat
+// Desc:    Records a heartbeat from a Ship at time now, moving its deadline to the timeout after now
+//          A LOST Ship that sends a heartbeat is ALIVE again
+//          Until its first heartbeat, a Ship has no deadline and never expires
+// Precon:  Heartbeats must be on, else does nothing and returns false
+//          Heartbeats should be sent in order of time, a deadline that has already passed expires at the next advance
+// Postcon: If there is a Ship with the passed id, it will be ALIVE with a new deadline and true is returned
+//          Else returns false
+bool Fleet::heartbeat(ShipId id, uint64_t now)
+{
+    return heartbeat((m_wheel != nullptr ? lookup(id) : nullptr), now);
+}
+
+// Name:    Fleet::heartbeat (Handle)
+// Desc:    Records a heartbeat from a Ship found earlier with find, without searching for it again
+// Precon:  handle must be nullptr or a handle from find whose Ship hasn't since been removed
+//          Heartbeats must be on, else does nothing and returns false
+// Postcon: If the Ship is in the Fleet, it will be ALIVE with a new deadline and true is returned
+//          Else returns false
+bool Fleet::heartbeat(const Ship* handle, uint64_t now)
+{
+    // Handles are read-only to callers, only the Fleet changes the Ship behind one
+    Ship* ship = const_cast<Ship*>(handle);
+    if(m_wheel == nullptr
+        || ship == nullptr
+        || ship->m_removed)
+    {
+        return false;
+    }
+    if(ship->m_state == LOST)
+    {
+        trace(TRACE_SET_STATE, ship->m_id, DEFAULT_TYPE, ALIVE);
+        changeState(ship, ALIVE);
+    }
+    m_wheel->schedule(ship, now);
+    return true;
+}
+
+// Name:    Fleet::advance
+// Desc:    Moves the heartbeat wheel's time up to now, and marks every Ship whose deadline has passed LOST,
+//          or removes it if removeLost is true
+//          Only the deadlines due by now are visited, plus the few that move down a level of the wheel,
+//          so the cost grows with the Ships that expire rather than with the Fleet
+//          Traces and the change stream see the expiries as the setState or remove calls they amount to
+// Precon:  Heartbeats must be on, else does nothing and returns 0
+//          A now behind the wheel's time expires nothing
+// Postcon: No Ship will have a deadline at or before now
+//          Returns the number of Ships that expired
+int Fleet::advance(uint64_t now, bool removeLost)
+{
+    if(m_wheel == nullptr)
+    {
+        return 0;
+    }
+    vector<Ship*> due;
+    m_wheel->advance(now, due);
+    for(Ship* ship : due)
+    {
+        if(removeLost)
+        {
+            remove(ship->m_id);
+        }
+        else
+        {
+            trace(TRACE_SET_STATE, ship->m_id, DEFAULT_TYPE, LOST);
+            changeState(ship, LOST);
+        }
+    }
+    return due.size();
+}
+
+// Name:    Fleet::verify
+// Desc:    In builds with FLEET_VERIFY defined, validates the Fleet after each change to its tree
+//          Otherwise does nothing
+// Precon:  None
+// Postcon: If the Fleet is invalid, prints the report and aborts
+void Fleet::verify() const
+{
+#ifdef FLEET_VERIFY
+    string report = validate();
+    if(!report.empty())
+    {
+        cerr << "Fleet failed validation:\n" << report;
+        abort();
+    }
+#endif
+}
+
+// Name:    Fleet::treeChanged
+// Desc:    Marks the search layout out of date and drops the finger after Ships are inserted or removed
+// Precon:  None
+// Postcon: The layout will be rebuilt once it has been read from enough times
+//          The next *Near search will start from the root
+void Fleet::treeChanged()
+{
+    m_layoutDirty = true;
+    m_readsSinceChange = 0;
+    m_fingerDepth = 0;
+}
+
+// Name:    Fleet::setCache
+// Desc:    Turns the lookup cache in front of findShip and setState on or off
+//          Turning it on or off empties it and resets its hit and miss counts
+//          Every lookup updates the cache, so while it is on lookups must not run on several threads at once
+// Precon:  None
+// Postcon: Lookups will go through the cache while it is on
+void Fleet::setCache(bool enabled)
+{
+    m_cache = enabled;
+    m_cacheHits = 0;
+    m_cacheMisses = 0;
+    clearCache();
+}
+
+// Name:    Fleet::clearCache
+// Desc:    Empties the lookup cache, after Ships are deleted in bulk
+// Precon:  None
+// Postcon: Every slot of the cache will be empty
+void Fleet::clearCache()
+{
+    fill(m_cacheIds, m_cacheIds + CACHE_SIZE, DEFAULT_ID);
+}
+
+// Name:    Fleet::uncache
+// Desc:    Drops the passed id from the lookup cache, before its Ship is removed or deleted
+// Precon:  None
+// Postcon: The cache will not hold the passed id
+void Fleet::uncache(ShipId id)
+{
+    if(m_cacheIds[id & (CACHE_SIZE - 1)] == id)
+    {
+        m_cacheIds[id & (CACHE_SIZE - 1)] = DEFAULT_ID;
+    }
+}
+
+// Name:    Fleet::layoutFind
+// Desc:    Searches the search layout for a Ship with the passed id
+//          While the layout is out of date, searches the tree instead until enough
+//          lookups have happened to pay for rebuilding the layout
+// Precon:  None
+// Postcon: If there is a Ship with the passed id, returns it
+//          Else returns nullptr
+Ship* Fleet::layoutFind(ShipId id) const
+{
+    if(!layoutReady(1))
+    {
+        return findNode(id);
+    }
+    const int size = m_layoutIds.size() - 1;
+    const ShipId* ids = m_layoutIds.data();
+    int index = 1;
+    // Branchless descent, the children of index are 2 * index and 2 * index + 1
+    while(index <= size)
+    {
+        // Fetch the cache line holding this index's descendants 4 levels down, wide ids take up two lines
+        if(16 * index <= size)
+        {
+            __builtin_prefetch(ids + 16 * index);
+#ifdef FLEET_WIDE_IDS
+            __builtin_prefetch(ids + 16 * index + 8);
+#endif
+        }
+        index = 2 * index + (ids[index] < id);
+    }
+    // Undo the right turns taken after the last left turn, landing on the smallest id >= id
+    index >>= __builtin_ffs(~index);
+    return (index != 0 && ids[index] == id ? m_layoutShips[index] : nullptr);
+}
+
+// Name:    Fleet::layoutReady
+// Desc:    Counts reads against an out of date search layout, rebuilding it once
+//          enough have happened to pay for the rebuild
+//          Safe to call from several threads at once while nothing changes the Fleet: the count is
+//          kept atomically, and only one thread rebuilds, while the others search the tree
+// Precon:  reads is the number of lookups about to be made
+// Postcon: Returns true if the layout is up to date and should be searched
+//          Else returns false and the tree should be searched
+bool Fleet::layoutReady(int reads) const
+{
+    if(__atomic_load_n(&m_layoutDirty, __ATOMIC_ACQUIRE))
+    {
+        // Rebuilding costs about as much as a quarter of the layout's size in lookups
+        if(__atomic_add_fetch(&m_readsSinceChange, reads, __ATOMIC_RELAXED) < (m_size + m_tombstones) / 4)
+        {
+            return false;
+        }
+        unique_lock<mutex> guard(layoutLock, try_to_lock);
+        if(!guard.owns_lock())
+        {
+            return false;
+        }
+        // Another thread may have rebuilt it since
+        if(__atomic_load_n(&m_layoutDirty, __ATOMIC_ACQUIRE))
+        {
+            rebuildLayout();
+        }
+    }
+    return true;
+}
+
+// Name:    Fleet::rebuildLayout
+// Desc:    Rebuilds the search layout from the tree
+// Precon:  None
+// Postcon: m_layoutIds and m_layoutShips will hold every Ship in BFS order, starting at index 1
+void Fleet::rebuildLayout() const
+{
+    vector<Ship*> ships;
+    collectShips(m_root, ships);
+    m_layoutIds.assign(ships.size() + 1, 0);
+    m_layoutShips.assign(ships.size() + 1, nullptr);
+    fillLayout(ships, 0, 1);
+    // Publish the layout to reads on other threads only once it is filled
+    __atomic_store_n(&m_readsSinceChange, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&m_layoutDirty, false, __ATOMIC_RELEASE);
+}
+
+// Name:    Fleet::collectShips
+// Desc:    Recursively appends each Ship in the subtree to ships, in order
+// Precon:  None
+// Postcon: ships will end with the subtree's Ships sorted by id
+void Fleet::collectShips(Ship* aShip, vector<Ship*>& ships) const
+{
+    if(aShip != nullptr)
+    {
+        collectShips(aShip->m_left, ships);
+        ships.push_back(aShip);
+        collectShips(aShip->m_right, ships);
+    }
+}
+
+// Name:    Fleet::fillLayout
+// Desc:    Recursively places the sorted Ships into the search layout, in order of the implicit tree rooted at index
+// Precon:  ships must be sorted by id
+//          next is the position in ships of the next Ship to be placed
+// Postcon: Fills the implicit subtree rooted at index
+//          Returns the position in ships of the next Ship to be placed
+int Fleet::fillLayout(const vector<Ship*>& ships, int next, int index) const
+{
+    if(index < (int) m_layoutIds.size())
+    {
+        next = fillLayout(ships, next, 2 * index);
+        m_layoutIds[index] = ships[next]->m_id;
+        m_layoutShips[index] = ships[next];
+        next = fillLayout(ships, next + 1, 2 * index + 1);
+    }
+    return next;
+}
+
+// Name:    SharedFleet::SharedFleet (Writer Constructor)
+// Desc:    Creates the shared memory object name, sized for capacity Ships, replacing any object with that name
+//          The object is unlinked when the writer is destroyed, readers that have it open keep their mapping
+// Precon:  name must be a valid POSIX shared memory name, such as "/fleet"
+// Postcon: If the object could be created, isOpen is true and the SharedFleet holds an empty snapshot
+SharedFleet::SharedFleet(const string& name, int capacity) : m_name(name), m_writer(true), m_bytes(0), m_header(nullptr)
+{
+#ifdef __unix__
+    m_bytes = sizeof(SharedHeader) + 2 * (size_t) max(0, capacity) * sizeof(SharedShip);
+    int file = shm_open(name.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0644);
+    if(file < 0)
+    {
+        return;
+    }
+    void* region = (ftruncate(file, m_bytes) == 0 ? mmap(nullptr, m_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0) : MAP_FAILED);
+    close(file);
+    if(region == MAP_FAILED)
+    {
+        shm_unlink(name.c_str());
+        return;
+    }
+    m_header = new (region) SharedHeader;
+    memcpy(m_header->magic, SHARED_MAGIC, sizeof(SHARED_MAGIC));
+    m_header->capacity = max(0, capacity);
+    m_header->counts[0].store(0, memory_order_relaxed);
+    m_header->counts[1].store(0, memory_order_relaxed);
+    m_header->sequences[0].store(0, memory_order_relaxed);
+    m_header->sequences[1].store(0, memory_order_relaxed);
+    m_header->version.store(0, memory_order_release);
+#endif
+}
+
+// Name:    SharedFleet::SharedFleet (Reader Constructor)
+// Desc:    Opens the shared memory object name read-only
+// Precon:  name must have been created by a writer SharedFleet
+// Postcon: If the object could be opened and holds a SharedFleet, isOpen is true
+SharedFleet::SharedFleet(const string& name) : m_name(name), m_writer(false), m_bytes(0), m_header(nullptr)
+{
+#ifdef __unix__
+    int file = shm_open(name.c_str(), O_RDONLY, 0);
+    if(file < 0)
+    {
+        return;
+    }
+    struct stat info;
+    void* region = MAP_FAILED;
+    if(fstat(file, &info) == 0
+        && (size_t) info.st_size >= sizeof(SharedHeader))
+    {
+        m_bytes = info.st_size;
+        region = mmap(nullptr, m_bytes, PROT_READ, MAP_SHARED, file, 0);
+    }
+    close(file);
+    if(region == MAP_FAILED)
+    {
+        return;
+    }
+    SharedHeader* header = (SharedHeader*) region;
+    // Only use the region if it is a SharedFleet whose slots fit inside it
+    if(memcmp(header->magic, SHARED_MAGIC, sizeof(SHARED_MAGIC)) != 0
+        || header->capacity < 0
+        || sizeof(SharedHeader) + 2 * (size_t) header->capacity * sizeof(SharedShip) > m_bytes)
+    {
+        munmap(region, m_bytes);
+        return;
+    }
+    m_header = header;
+#endif
+}
+
+// Name:    SharedFleet::~SharedFleet (Destructor)
+// Desc:    Unmaps the region, and unlinks its name if this is the writer
+// Precon:  None
+// Postcon: The region will no longer be mapped by this SharedFleet
+SharedFleet::~SharedFleet()
+{
+#ifdef __unix__
+    if(m_header != nullptr)
+    {
+        munmap(m_header, m_bytes);
+        if(m_writer)
+        {
+            shm_unlink(m_name.c_str());
+        }
+    }
+#endif
+}
+
+// Name:    SharedFleet::publish
+// Desc:    Copies the Fleet's Ships in order of id into the slot readers aren't using, then makes it current
+//          Readers never see a half-written snapshot: a read of the slot being filled is retried, while reads
+//          of the current slot go on undisturbed
+// Precon:  This must be the writer
+// Postcon: If the Fleet fits, readers will see its current Ships and returns true
+//          Else the snapshot is left as is and returns false
+bool SharedFleet::publish(const Fleet& fleet)
+{
+    if(m_header == nullptr
+        || !m_writer
+        || fleet.m_size > m_header->capacity)
+    {
+        return false;
+    }
+    const uint64_t version = m_header->version.load(memory_order_relaxed);
+    SharedShip* ships = slot(version + 1);
+    beginWrite(version + 1);
+    int count = 0;
+    // Walk the tree in order without recursion, skipping lazily removed Ships
+    vector<Ship*> path;
+    Ship* aShip = fleet.m_root;
+    while(aShip != nullptr
+        || !path.empty())
+    {
+        while(aShip != nullptr)
+        {
+            path.push_back(aShip);
+            aShip = aShip->m_left;
+        }
+        aShip = path.back();
+        path.pop_back();
+        if(!aShip->m_removed)
+        {
+            ships[count++] = {aShip->m_id, (uint8_t) aShip->m_type, (uint8_t) aShip->m_state};
+        }
+        aShip = aShip->m_right;
+    }
+    m_header->counts[(version + 1) % 2].store(count, memory_order_relaxed);
+    endWrite(version + 1);
+    m_header->version.store(version + 1, memory_order_release);
+    return true;
+}
+
+// Name:    SharedFleet::setState
+// Desc:    Changes the state of a Ship in the current snapshot in place, without publishing the whole Fleet
+//          The writer's Fleet should be changed too, so that the next publish keeps the state
+//          Reads of the current snapshot that overlap the change are retried, as with a publish
+// Precon:  This must be the writer
+// Postcon: If the Ship is in the snapshot, changes its state and returns true
+//          Else returns false
+bool SharedFleet::setState(ShipId id, STATE state)
+{
+    if(m_header == nullptr
+        || !m_writer)
+    {
+        return false;
+    }
+    const uint64_t version = m_header->version.load(memory_order_relaxed);
+    SharedShip* ships = slot(version);
+    int index = search(ships, slotSize(version), id);
+    if(index < 0)
+    {
+        return false;
+    }
+    beginWrite(version);
+    ships[index].state = state;
+    endWrite(version);
+    return true;
+}
+
+// Name:    SharedFleet::findShip
+// Desc:    Searches the current snapshot for a Ship with the passed id
+// Precon:  None
+// Postcon: If there is a Ship with the passed id, returns true
+//          Else returns false
+bool SharedFleet::findShip(ShipId id) const
+{
+    STATE state;
+    return getState(id, state);
+}
+
+// Name:    SharedFleet::getState
+// Desc:    Searches the current snapshot for a Ship with the passed id, reading again if the writer changed it meanwhile
+// Precon:  None
+// Postcon: If there is a Ship with the passed id, sets state to its state and returns true
+//          Else returns false
+bool SharedFleet::getState(ShipId id, STATE& state) const
+{
+    if(m_header == nullptr)
+    {
+        return false;
+    }
+    while(true)
+    {
+        uint64_t version;
+        const uint64_t sequence = beginRead(version);
+        const SharedShip* ships = slot(version);
+        const int index = search(ships, slotSize(version), id);
+        const uint8_t found = (index >= 0 ? ships[index].state : 0);
+        if(endRead(version, sequence))
+        {
+            state = static_cast<STATE>(found);
+            return index >= 0;
+        }
+    }
+}
+
+// Name:    SharedFleet::getSize
+// Desc:    Gets the number of Ships in the current snapshot
+// Precon:  None
+// Postcon: Returns the number of Ships
+int SharedFleet::getSize() const
+{
+    return (m_header != nullptr ? slotSize(m_header->version.load(memory_order_acquire)) : 0);
+}
+
+// Name:    SharedFleet::getVersion
+// Desc:    Gets the number of snapshots published so far
+// Precon:  None
+// Postcon: Returns the version, which changes with every publish
+uint64_t SharedFleet::getVersion() const
+{
+    return (m_header != nullptr ? m_header->version.load(memory_order_acquire) : 0);
+}
+
+// Name:    SharedFleet::slot
+// Desc:    Finds the slot that holds a version's snapshot, by its offset from the start of the region
+// Precon:  The region must be mapped
+// Postcon: Returns the slot's first Ship
+SharedShip* SharedFleet::slot(uint64_t version) const
+{
+    return (SharedShip*) (m_header + 1) + (version % 2) * m_header->capacity;
+}
+
+// Name:    SharedFleet::slotSize
+// Desc:    Gets the number of Ships in a version's slot, never more than the slot holds even if it is being rewritten
+// Precon:  The region must be mapped
+// Postcon: Returns the number of Ships
+int SharedFleet::slotSize(uint64_t version) const
+{
+    return min(max(0, (int) m_header->counts[version % 2].load(memory_order_relaxed)), (int) m_header->capacity);
+}
+
+// Name:    SharedFleet::beginRead
+// Desc:    Starts a read of the current snapshot, waiting while the writer is changing its slot
+// Precon:  The region must be mapped
+// Postcon: Sets version to the current version and returns the even sequence of its slot
+uint64_t SharedFleet::beginRead(uint64_t& version) const
+{
+    while(true)
+    {
+        version = m_header->version.load(memory_order_acquire);
+        const uint64_t sequence = m_header->sequences[version % 2].load(memory_order_acquire);
+        if(sequence % 2 == 0)
+        {
+            return sequence;
+        }
+        this_thread::yield();
+    }
+}
+
+// Name:    SharedFleet::endRead
+// Desc:    Finishes a read started by beginRead, after the slot's Ships have been read
+// Precon:  version and sequence must be as set and returned by beginRead
+// Postcon: Returns true if the writer left the slot alone during the read
+//          Else returns false, and what was read may have been torn
+bool SharedFleet::endRead(uint64_t version, uint64_t sequence) const
+{
+    // Keeps the reads of the slot from moving past the second look at its sequence
+    atomic_thread_fence(memory_order_acquire);
+    return m_header->sequences[version % 2].load(memory_order_relaxed) == sequence;
+}
+
+// Name:    SharedFleet::beginWrite
+// Desc:    Marks a version's slot as being changed, before the writer changes it
+// Precon:  This must be the writer, with the region mapped
+// Postcon: The slot's sequence will be odd
+void SharedFleet::beginWrite(uint64_t version)
+{
+    atomic<uint64_t>& sequence = m_header->sequences[version % 2];
+    sequence.store(sequence.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    // Keeps the writes to the slot from moving ahead of the odd sequence
+    atomic_thread_fence(memory_order_release);
+}
+
+// Name:    SharedFleet::endWrite
+// Desc:    Marks a version's slot as changed, after the writer is done with it
+// Precon:  This must be the writer, and beginWrite must have been called on the slot
+// Postcon: The slot's sequence will be even again, and differ from its value before beginWrite
+void SharedFleet::endWrite(uint64_t version)
+{
+    atomic<uint64_t>& sequence = m_header->sequences[version % 2];
+    sequence.store(sequence.load(memory_order_relaxed) + 1, memory_order_release);
+}
+
+// Name:    SharedFleet::search
+// Desc:    Binary searches Ships sorted by id, without branching on the comparisons
+// Precon:  ships must hold count Ships
+// Postcon: Returns the index of the Ship with the passed id, or -1 if there is none
+int SharedFleet::search(const SharedShip ships[], int count, ShipId id) const
+{
+    if(count == 0)
+    {
+        return -1;
+    }
+    const SharedShip* base = ships;
+    for(int size = count; size > 1; size -= size / 2)
+    {
+        base += (base[size / 2 - 1].id < id) * (size / 2);
+    }
+    return (base->id == id ? base - ships : -1);
+}
+
+// Name:    DenseFleet::DenseFleet (Default Constructor)
+// Desc:    Sizes the presence bits and attribute bytes for every id from MINID to MAXID, or for the first
+//          DENSE_MAX_RANGE of them if there are more, in which case the rest are rejected as out of range
+//          The attribute bytes are padded out to whole words of presence bits, so scans never need a tail
+// Precon:  None
+// Postcon: An empty DenseFleet will be created
+DenseFleet::DenseFleet() : m_range(min<ShipId>(MAXID - MINID + 1, DENSE_MAX_RANGE)), m_size(0)
+{
+    m_present.assign((m_range + 63) / 64, 0);
+    m_attributes.assign(m_present.size() * 64, 0);
+}
+
+// Name:    DenseFleet::clear
+// Desc:    Removes every Ship
+// Precon:  None
+// Postcon: this will be an empty DenseFleet
+void DenseFleet::clear()
+{
+    // Only words with Ships in them have attribute bytes to zero, so a sparse DenseFleet clears quickly
+    for(size_t word = 0; word < m_present.size(); word++)
+    {
+        if(m_present[word] != 0)
+        {
+            fill(m_attributes.begin() + word * 64, m_attributes.begin() + word * 64 + 64, 0);
+            m_present[word] = 0;
+        }
+    }
+    m_size = 0;
+}
+
+// Name:    DenseFleet::insert
+// Desc:    Inserts a Ship by setting its presence bit and attribute byte
+// Precon:  The Ship's id must be within range and cannot already exist in the DenseFleet
+//          Else does nothing
+// Postcon: DenseFleet will contain the new Ship
+void DenseFleet::insert(const Ship& ship)
+{
+    if(inRange(ship.getID()))
+    {
+        const size_t slot = ship.getID() - MINID;
+        if(!(m_attributes[slot] & PRESENT))
+        {
+            m_attributes[slot] = PRESENT | ship.getType() | (ship.getState() == LOST ? LOST_BIT : 0);
+            m_present[slot / 64] |= 1ULL << (slot % 64);
+            m_size++;
+        }
+    }
+}
+
+// Name:    DenseFleet::build
+// Desc:    Replaces the DenseFleet's Ships with the passed Ships
+// Precon:  ships must hold size Ships
+//          Ships whose ids are out of range are skipped, as are repeats of an id after its first
+// Postcon: DenseFleet will contain exactly the valid passed Ships
+void DenseFleet::build(const Ship ships[], int size)
+{
+    clear();
+    for(int i = 0; i < size; i++)
+    {
+        insert(ships[i]);
+    }
+}
+
+// Name:    DenseFleet::remove
+// Desc:    Removes the Ship with the passed id
+// Precon:  There must exist Ship with the passed id
+//          Else does nothing
+// Postcon: The DenseFleet will not contain the Ship with the passed id
+void DenseFleet::remove(ShipId id)
+{
+    if(findShip(id))
+    {
+        const size_t slot = id - MINID;
+        m_attributes[slot] = 0;
+        m_present[slot / 64] &= ~(1ULL << (slot % 64));
+        m_size--;
+    }
+}
+
+// Name:    DenseFleet::listShips
+// Desc:    Outputs every Ship in order of id, as Fleet::listShips does
+// Precon:  None
+// Postcon: Ships written to out
+void DenseFleet::listShips(ostream& out) const
+{
+    exportShips(out, TEXT);
+}
+
+// Name:    DenseFleet::exportShips
+// Desc:    Writes every Ship to out in order of id, in the same formats as Fleet::exportShips
+// Precon:  out should be opened in binary mode for BINARY
+// Postcon: Every Ship will be written to out
+void DenseFleet::exportShips(ostream& out, FORMAT format) const
+{
+    ShipWriter writer(out);
+    if(format == BINARY)
+    {
+        const int size = m_size;
+        writer.write(BINARY_MAGIC, sizeof(BINARY_MAGIC));
+        writer.write((const char*) &size, sizeof(size));
+    }
+    forEach([&](ShipId id, SHIPTYPE type, STATE state)
+    {
+        const Ship ship(id, type, state);
+        Fleet::writeShip(&ship, writer, format);
+    });
+}
+
+// Name:    DenseFleet::setState
+// Desc:    Sets the state of the Ship with the passed id
+// Precon:  Ship with the passed id must be in the DenseFleet
+//          Else does nothing and returns false
+// Postcon: Ship with the passed id will have state state
+//          Returns true
+bool DenseFleet::setState(ShipId id, STATE state)
+{
+    if(!findShip(id))
+    {
+        return false;
+    }
+    uint8_t& attributes = m_attributes[id - MINID];
+    attributes = (attributes & ~LOST_BIT) | (state == LOST ? LOST_BIT : 0);
+    return true;
+}
+
+// Name:    DenseFleet::setStates
+// Desc:    Sets the state of each Ship with an id in ids to the matching state in states
+// Precon:  ids, states and results must all hold count elements
+//          If an id appears more than once, its last state is the one kept
+// Postcon: results[i] will be whether there is a Ship with id ids[i]
+//          Returns the number of states set
+int DenseFleet::setStates(const ShipId ids[], const STATE states[], int count, bool results[])
+{
+    int numSet = 0;
+    for(int i = 0; i < count; i++)
+    {
+        numSet += results[i] = setState(ids[i], states[i]);
+    }
+    return numSet;
+}
+
+// Name:    DenseFleet::matchBytes
+// Desc:    Compares 64 attribute bytes against match after masking them, 32 at a time with AVX2
+// Precon:  bytes must hold 64 bytes
+// Postcon: Returns a mask with bit i set where bytes[i] & mask == match
+uint64_t DenseFleet::matchBytes(const uint8_t bytes[], uint8_t mask, uint8_t match)
+{
+    uint64_t matches = 0;
+#ifdef __AVX2__
+    const __m256i maskBits = _mm256_set1_epi8((char) mask);
+    const __m256i matchBits = _mm256_set1_epi8((char) match);
+    for(int half = 0; half < 2; half++)
+    {
+        const __m256i block = _mm256_and_si256(_mm256_loadu_si256((const __m256i*) (bytes + 32 * half)), maskBits);
+        matches |= (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, matchBits)) << (32 * half);
+    }
+#else
+    for(int i = 0; i < 64; i++)
+    {
+        matches |= (uint64_t) ((bytes[i] & mask) == match) << i;
+    }
+#endif
+    return matches;
+}
+
+// Name:    DenseFleet::removeLost
+// Desc:    Removes all LOST Ships, comparing the attribute bytes of each word of presence bits with matchBytes
+//          Words with no Ships are skipped without reading their attribute bytes
+// Precon:  None
+// Postcon: DenseFleet will not contain any LOST Ships
+void DenseFleet::removeLost()
+{
+    for(size_t word = 0; word < m_present.size(); word++)
+    {
+        if(m_present[word] != 0)
+        {
+            const uint64_t lost = matchBytes(m_attributes.data() + word * 64, PRESENT | LOST_BIT, PRESENT | LOST_BIT);
+            for(uint64_t bits = lost; bits != 0; bits &= bits - 1)
+            {
+                m_attributes[word * 64 + __builtin_ctzll(bits)] = 0;
+            }
+            m_present[word] &= ~lost;
+            m_size -= __builtin_popcountll(lost);
+        }
+    }
+}
+
+// Name:    DenseFleet::countType
+// Desc:    Counts the Ships of the passed type, comparing the attribute bytes of each word of presence bits with matchBytes
+//          Words with no Ships are skipped without reading their attribute bytes
+// Precon:  None
+// Postcon: Returns the number of Ships of type type
+int DenseFleet::countType(SHIPTYPE type) const
+{
+    int count = 0;
+    for(size_t word = 0; word < m_present.size(); word++)
+    {
+        if(m_present[word] != 0)
+        {
+            count += __builtin_popcountll(matchBytes(m_attributes.data() + word * 64, PRESENT | TYPE_BITS, PRESENT | type));
+        }
+    }
+    return count;
+}
+
+// Name:    DenseFleet::memoryUsage
+// Desc:    Adds up the memory the DenseFleet takes up: a byte per Ship, the presence bits,
+//          and the attribute bytes of ids not in the DenseFleet
+// Precon:  None
+// Postcon: Returns the bytes used, by where they go
+MemoryUsage DenseFleet::memoryUsage() const
+{
+    MemoryUsage usage;
+    usage.nodes = m_size;
+    usage.overhead = 0;
+    usage.indexes = sizeof(DenseFleet) + m_present.capacity() * sizeof(uint64_t);
+    usage.fragmentation = m_attributes.capacity() - m_size;
+    return usage;
+}
+
+// Name:    DenseFleet::findShip
+// Desc:    Checks the attribute byte of the passed id
+// Precon:  None
+// Postcon: If there is a Ship with the passed id, returns true
+//          Else returns false
+bool DenseFleet::findShip(ShipId id) const
+{
+    return inRange(id)
+        && (m_attributes[id - MINID] & PRESENT);
+}
+
+// Name:    DenseFleet::findMany
+// Desc:    Searches for every id in ids
+// Precon:  ids and found must both hold count elements
+// Postcon: found[i] will be whether there is a Ship with id ids[i]
+//          Returns the number of ids found
+int DenseFleet::findMany(const ShipId ids[], int count, bool found[]) const
+{
+    int numFound = 0;
+    for(int i = 0; i < count; i++)
+    {
+        numFound += found[i] = findShip(ids[i]);
+    }
+    return numFound;
+}
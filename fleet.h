@@ -12,15 +12,126 @@
 
 #ifndef FLEET_H
 #define FLEET_H
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <limits>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 using namespace std;
 class Grader;
 class Tester;
+class ShipWriter;
+class ShipSlabs;
+class SharedFleet;
+class DenseFleet;
+class HeartbeatWheel;
 enum STATE {ALIVE, LOST};
 enum SHIPTYPE {CARGO, TELESCOPE, COMMUNICATOR, FUELCARRIER, ROBOCARRIER};
 enum COLOR {RED, BLACK, DOUBLEBLACK};
-const int MINID = 10000;
-const int MAXID = 99999;
+enum FORMAT {TEXT, JSONLINES, BINARY};
+// Where a Fleet's Ships are stored: one heap allocation each, slabs, or slabs backed by transparent huge pages
+enum PLACEMENT {HEAP, SLABS, HUGE_SLABS};
+// Which NUMA nodes slabs are placed on: wherever they're first touched, one chosen node, or all nodes in turn
+enum NUMA_POLICY {NUMA_DEFAULT, NUMA_BIND, NUMA_INTERLEAVE};
+// Ship ids: ints by default, or 64 bit integers in builds with FLEET_WIDE_IDS defined
+// Either way, the range of valid ids can be moved at compile time by defining FLEET_MINID and FLEET_MAXID
+#ifdef FLEET_WIDE_IDS
+typedef int64_t ShipId;
+#else
+typedef int ShipId;
+#endif
+#ifdef FLEET_MINID
+const ShipId MINID = FLEET_MINID;
+#elif defined(FLEET_WIDE_IDS)
+const ShipId MINID = 1;
+#else
+const ShipId MINID = 10000;
+#endif
+#ifdef FLEET_MAXID
+const ShipId MAXID = FLEET_MAXID;
+#elif defined(FLEET_WIDE_IDS)
+const ShipId MAXID = numeric_limits<ShipId>::max() - 1;
+#else
+const ShipId MAXID = 99999;
+#endif
+// DEFAULT_ID marks empty slots, and the finger's bounds step one past an id, so the range must stay inside these
+static_assert(MINID > 0 && MINID <= MAXID && MAXID < numeric_limits<ShipId>::max(), "Ship ids must be in [1, the largest ShipId)");
+// Deepest path a finger can hold, enough for any Red-Black Tree of up to 2^31 Ships
+const int FINGER_DEPTH = 64;
+// Entries in the lookup cache, a power of two so an id's slot is its low bits
+const int CACHE_SIZE = 256;
+// Ships per block of an archive, the smallest piece of one that can be decoded on its own
+const int ARCHIVE_BLOCK = 4096;
+// Most ids a DenseFleet holds, counting from MINID, so that wide builds don't size it by the whole id range
+const ShipId DENSE_MAX_RANGE = 1 << 26;
+// Marks a Ship that has no heartbeat deadline
+const uint32_t NO_DEADLINE = numeric_limits<uint32_t>::max();
+// Balancing scheme, chosen at compile time: red-black by default, or AVL in builds with FLEET_AVL defined
+#ifdef FLEET_AVL
+const char BALANCE_NAME[] = "AVL";
+#else
+const char BALANCE_NAME[] = "red-black";
+#endif
+// Whether Ships have room for subtree hashes, only in builds with FLEET_HASHES defined, so that other builds don't pay for them
+// Without them hashing stays off, and getHash, sameShips and diff walk the Fleets instead
+#ifdef FLEET_HASHES
+const bool SUBTREE_HASHES = true;
+#else
+const bool SUBTREE_HASHES = false;
+#endif
+// Whether Ships have room for links to their neighbours, only in builds with FLEET_THREADED defined
+// Without them threading stays off, and first, last, successor and predecessor search the tree instead
+#ifdef FLEET_THREADED
+const bool THREADED_LINKS = true;
+#else
+const bool THREADED_LINKS = false;
+#endif
+// Bytes a Fleet takes up, by where they go
+struct MemoryUsage
+{
+    long long nodes;            // Ships in the Fleet
+    long long overhead;         // Allocator headers and padding around each Ship
+    long long indexes;          // The Fleet itself, with its cache and finger, and the search layout
+    long long fragmentation;    // Lazily removed Ships, and capacity reserved but not used
+    long long total() const {return nodes + overhead + indexes + fragmentation;}
+};
+// Ship allocations across all Fleets, counted by Ship's operator new and delete
+struct AllocationStats
+{
+    long long allocations;
+    long long deallocations;
+    long long liveBytes;
+};
+// Kinds of entry in a Fleet's change stream
+// removeLost is recorded as the removals it made, and build as a clear followed by its insertions
+enum CHANGE {INSERTED, REMOVED, STATE_SET, CLEARED};
+// One entry in a Fleet's change stream, fixed size so that batches can be written to a pipe or socket as is
+struct Change
+{
+    uint64_t sequence;          // Numbers every change recorded by the Fleet, starting at 1
+    ShipId id;
+    uint8_t kind;
+    uint8_t type;
+    uint8_t state;
+};
+// Calls a Fleet's trace records, the *Near variants of each are flagged as near
+// Batches are recorded as one call per id: findMany as findShip, and setStates as setState
+enum TRACE_OP {TRACE_INSERT, TRACE_REMOVE, TRACE_SET_STATE, TRACE_REMOVE_LOST, TRACE_FIND};
+// One call read back from a trace
+struct TraceRecord
+{
+    uint64_t nanos;             // When the call was made, counting from when tracing started
+    ShipId id;
+    TRACE_OP op;
+    SHIPTYPE type;
+    STATE state;
+    bool near;
+};
 #define DEFAULT_ID 0
 #define DEFAULT_TYPE CARGO
 #define DEFAULT_STATE ALIVE
@@ -30,14 +141,27 @@ class Ship
         friend class Grader;
         friend class Tester;
         friend class Fleet;
-        Ship(int id = DEFAULT_ID, SHIPTYPE type = DEFAULT_TYPE, STATE state = DEFAULT_STATE)
+        friend class ShipSlabs;
+        friend class SharedFleet;
+        friend class HeartbeatWheel;
+        Ship(ShipId id = DEFAULT_ID, SHIPTYPE type = DEFAULT_TYPE, STATE state = DEFAULT_STATE)
             : m_id(id), m_type(type), m_state(state)
         {
             m_left = nullptr;
             m_right = nullptr;
             m_color = RED;
+            m_removed = false;
+            m_height = 1;
+            m_timer = NO_DEADLINE;
+#ifdef FLEET_HASHES
+            m_hash = 0;
+#endif
+#ifdef FLEET_THREADED
+            m_prev = nullptr;
+            m_next = nullptr;
+#endif
         }
-        int getID() const {return m_id;}
+        ShipId getID() const {return m_id;}
         STATE getState() const {return m_state;}
         string getStateStr() const
         {
@@ -72,57 +196,479 @@ class Ship
                 default: return "UNKNOWN";
             }
         }
-        Ship* getLeft() const {return m_left;}
-        Ship* getRight() const {return m_right;}
-        void setID(const int id) {m_id = id;}
+        Ship* getLeft() {return m_left;}
+        Ship* getRight() {return m_right;}
+        const Ship* getLeft() const {return m_left;}
+        const Ship* getRight() const {return m_right;}
+        void setID(const ShipId id) {m_id = id;}
         void setState(STATE state) {m_state = state;}
         void setType(SHIPTYPE type) {m_type = type;}
         void setColor(COLOR color) {m_color = color;}
         void setLeft(Ship* left) {m_left = left;}
         void setRight(Ship* right) {m_right = right;}
+        static void* operator new(size_t size);
+        static void operator delete(void* ship, size_t size);
+        static void* operator new(size_t, void* place) {return place;}
+        static void operator delete(void*, void*) {}
+        static AllocationStats getAllocationStats();
     private:
-        int m_id;
-        SHIPTYPE m_type;
-        STATE m_state;
-        COLOR m_color;
+        ShipId m_id;
+        // Type, state, color and the lazy removal flag share one byte as bit fields
+        SHIPTYPE m_type : 3;
+        STATE m_state : 1;
+        COLOR m_color : 2;
+        bool m_removed : 1; // Removed while lazy removal was on, waiting to be compacted away
+        uint8_t m_height;   // Height of its subtree, kept in AVL builds in place of the color
+        uint32_t m_timer;   // Its deadline in the Fleet's heartbeat wheel, or NO_DEADLINE while it has none
+#ifdef FLEET_HASHES
+        uint64_t m_hash;    // Sum of the hashes of the Ships in its subtree, kept while the Fleet is hashing
+#endif
         Ship* m_left;
         Ship* m_right;
+#ifdef FLEET_THREADED
+        Ship* m_prev;       // Ships before and after it in order of id, kept while the Fleet is threaded
+        Ship* m_next;
+#endif
 };
 class Fleet
 {
     public:
         friend class Grader;
         friend class Tester;
+        friend class SharedFleet;
+        friend class DenseFleet;
         Fleet();
         ~Fleet();
         void clear();
         void insert(const Ship& ship);
-        void remove(int id);
-        void dumpTree() const;
-        void listShips() const;
-        bool setState(int id, STATE state);
+        void build(const Ship ships[], int size);
+        void setThreads(int threads);
+        template <class Function>
+        void parallelForEach(Function function) const;
+        template <class T, class Map, class Combine>
+        T parallelReduce(T identity, Map map, Combine combine) const;
+        void remove(ShipId id);
+        void dumpTree(ostream& out = cout) const;
+        void listShips(ostream& out = cout) const;
+        void exportShips(ostream& out, FORMAT format) const;
+        void writeArchive(ostream& out, int blockSize = ARCHIVE_BLOCK) const;
+        bool loadArchive(istream& in, ShipId low = MINID, ShipId high = MAXID);
+        bool setState(ShipId id, STATE state);
+        bool setState(const Ship* ship, STATE state);
+        int setStates(const ShipId ids[], const STATE states[], int count, bool results[]);
         void removeLost();
-        bool findShip(int id) const;
+        void setLazyRemove(bool enabled, double threshold = 0.25);
+        void compact();
+        int getSize() const {return m_size;}
+        string validate() const;
+        MemoryUsage memoryUsage() const;
+        bool findShip(ShipId id) const;
+        const Ship* find(ShipId id) const;
+        int findMany(const ShipId ids[], int count, bool found[]) const;
+        bool findShipNear(ShipId id) const;
+        bool setStateNear(ShipId id, STATE state);
+        void insertNear(const Ship& ship);
+        void setSearchLayout(bool enabled);
+        bool getSearchLayout() const {return m_searchLayout;}
+        void setPlacement(PLACEMENT placement, NUMA_POLICY numa = NUMA_DEFAULT, int node = 0);
+        PLACEMENT getPlacement() const;
+        void setCache(bool enabled);
+        bool getCache() const {return m_cache;}
+        long long getCacheHits() const {return m_cacheHits;}
+        long long getCacheMisses() const {return m_cacheMisses;}
+        void setChangeStream(bool enabled);
+        bool getChangeStream() const {return m_changeStream;}
+        uint64_t getSequence() const {return m_sequence;}
+        int takeChanges(vector<Change>& changes);
+        int applyChanges(const Change changes[], int count);
+        uint64_t snapshot(vector<Change>& changes) const;
+        void restore(const Change changes[], int count, uint64_t sequence);
+        void setHashing(bool enabled);
+        bool getHashing() const {return m_hashing;}
+        uint64_t getHash() const;
+        bool sameShips(const Fleet& other) const;
+        int diff(const Fleet& other, vector<ShipId>& ids) const;
+        void setThreading(bool enabled);
+        bool getThreading() const {return m_threading;}
+        const Ship* first() const;
+        const Ship* last() const;
+        const Ship* successor(const Ship* ship) const;
+        const Ship* predecessor(const Ship* ship) const;
+        void setTrace(ostream* out);
+        bool getTracing() const {return m_trace != nullptr;}
+        static bool readTrace(istream& in, Fleet& fleet, vector<TraceRecord>& records);
+        bool replay(const TraceRecord& record);
+        void setHeartbeats(bool enabled, uint64_t timeout);
+        bool getHeartbeats() const {return m_wheel != nullptr;}
+        bool heartbeat(ShipId id, uint64_t now);
+        bool heartbeat(const Ship* ship, uint64_t now);
+        int advance(uint64_t now, bool removeLost = false);
         Ship* getRoot() const {return m_root;}
+        long long getRotations() const {return m_rotations;}
     private:
         Ship* m_root;
+        int m_size;
+        // Lazy removal flags Ships as removed instead of unlinking them, and
+        // compacts the tree once removed Ships make up more than m_compactThreshold of it
+        bool m_lazyRemove;
+        double m_compactThreshold;
+        int m_tombstones;
+        // Most threads that bulk operations may split their work across
+        int m_threads;
+        // Read-optimized copy of the tree's ids, stored in BFS (Eytzinger) order
+        // Rebuilt lazily from the tree after insertions and removals, by whichever read finds it due
+        // Reads on several threads at once touch m_layoutDirty and m_readsSinceChange atomically,
+        // and rebuild one at a time, so the layout itself is only written while no read is searching it
+        bool m_searchLayout;
+        mutable bool m_layoutDirty;
+        mutable int m_readsSinceChange;
+        // Finger: the path from the root to the last Ship reached by a *Near search, with the
+        // smallest and largest id each Ship's subtree can hold
+        // Searches start from the lowest Ship on the path whose subtree can hold the id
+        mutable Ship* m_fingerPath[FINGER_DEPTH];
+        mutable ShipId m_fingerLow[FINGER_DEPTH];
+        mutable ShipId m_fingerHigh[FINGER_DEPTH];
+        mutable int m_fingerDepth;
+        mutable vector<ShipId> m_layoutIds;
+        mutable vector<Ship*> m_layoutShips;
+        // Lookup cache: a direct-mapped table of recently found Ships in front of the tree
+        // Slot id % CACHE_SIZE holds the last Ship found with an id landing there, or DEFAULT_ID when empty
+        bool m_cache;
+        mutable ShipId m_cacheIds[CACHE_SIZE];
+        mutable Ship* m_cacheShips[CACHE_SIZE];
+        mutable long long m_cacheHits;
+        mutable long long m_cacheMisses;
+        // Slabs holding every Ship, or nullptr when Ships are allocated one at a time on the heap
+        ShipSlabs* m_slabs;
+        // Change stream: each change to the Ships is appended to m_changes until taken, numbered by m_sequence
+        // A replica's m_sequence is the last change it has applied
+        bool m_changeStream;
+        uint64_t m_sequence;
+        vector<Change> m_changes;
+        // Hashing keeps each Ship's m_hash up to date, so that Fleets can be compared by their root's hash
+        // The hash of a subtree is the sum of its Ships' hashes, which doesn't depend on the tree's shape
+        // Never on in builds without SUBTREE_HASHES, where Ships have no m_hash
+        bool m_hashing;
+        // Rotations made so far, to compare balancing schemes
+        long long m_rotations;
+        // Threading keeps every Ship, lazily removed ones included, in a list in order of id through m_prev and m_next,
+        // from m_first to m_last; rotations don't change the order, so only insertions and removals touch the list
+        // Never on in builds without THREADED_LINKS, where Ships have no m_prev and m_next
+        bool m_threading;
+        Ship* m_first;
+        Ship* m_last;
+        // Tracing encodes each traced call into m_traceBuffer, written to m_trace whenever the buffer fills
+        // Times and ids are stored as the difference from the last call's, so the last of each is kept
+        ostream* m_trace;
+        mutable vector<uint8_t> m_traceBuffer;
+        mutable uint64_t m_traceLast;
+        mutable ShipId m_traceId;
+        // Heartbeat deadlines of the ALIVE Ships that have sent one, or nullptr while heartbeats are off
+        HeartbeatWheel* m_wheel;
 
-        void dump(Ship* aShip) const;
+        void dump(Ship* aShip, ShipWriter& out) const;
         // ***************************************************
         // Any private helper functions must be delared here!
         // ***************************************************
-        void deleteShip(Ship* aShip);
+        void deleteShip(Ship* aShip, int splits = 0);
+        void deleteAll();
+        Ship* makeShip(const Ship& ship);
+        void freeShip(Ship* ship);
+        int getSplits(int size) const;
         Ship* recursInsert(Ship*& aShip, Ship* newShip, bool left);
         Ship* insertRebalance(Ship* grandparent, bool outerLeft, bool innerLeft);
-        Ship* recursRemove(Ship*& aShip, int id, bool left);
-        int replaceWithLargest(Ship* aShip);
-        Ship* findLargest(Ship* aShip) const;
+        Ship* recursRemove(Ship*& aShip, ShipId id, bool left);
+        void replaceWithLargest(Ship*& aShip);
         Ship* removeRebalance(Ship* parent, bool left);
-        Ship* getParent(Ship* aShip) const;
         Ship* lRotation(Ship* aShip);
         Ship* rRotation(Ship* aShip);
         void recolor(Ship* aShip);
-        void recursList(Ship* aShip) const;
-        bool recursRemoveLost(Ship* aShip);
+        Ship* avlInsert(Ship* aShip, Ship* newShip);
+        Ship* avlRemove(Ship* aShip, ShipId id);
+        Ship* avlRemoveLargest(Ship* aShip, Ship*& largest);
+        Ship* avlBalance(Ship* aShip);
+        static int heightOf(const Ship* aShip) {return (aShip != nullptr ? aShip->m_height : 0);}
+        static void updateHeight(Ship* aShip) {aShip->m_height = 1 + max(heightOf(aShip->m_left), heightOf(aShip->m_right));}
+        void recursExport(Ship* aShip, ShipWriter& out, FORMAT format) const;
+        static void writeShip(const Ship* aShip, ShipWriter& out, FORMAT format);
+        void rebuild(bool removeLost);
+        int filterShips(Ship* aShip, vector<Ship*>& kept, bool removeLost, int splits);
+        void relink(Ship* ships[], int size);
+        Ship* buildTree(Ship* ships[], int start, int end, int depth, int redDepth, int splits);
+        template <class Function>
+        void recursForEach(Ship* aShip, Function& function, int splits) const;
+        template <class T, class Map, class Combine>
+        void recursReduce(Ship* aShip, T& result, const T& identity, Map& map, Combine& combine, int splits) const;
+        Ship* findNode(ShipId id) const;
+        Ship* findParent(ShipId id) const;
+        Ship* neighbour(ShipId id, bool next) const;
+        void linkNeighbours(Ship* ship, Ship* parent);
+        void unlinkNeighbours(Ship* ship);
+        void joinNeighbours(Ship* prev, Ship* next);
+        void threadShips(Ship* ships[], int size);
+#ifdef FLEET_THREADED
+        static Ship* prevOf(const Ship* ship) {return ship->m_prev;}
+        static Ship* nextOf(const Ship* ship) {return ship->m_next;}
+        static void setPrev(Ship* ship, Ship* prev) {ship->m_prev = prev;}
+        static void setNext(Ship* ship, Ship* next) {ship->m_next = next;}
+#else
+        static Ship* prevOf(const Ship*) {return nullptr;}
+        static Ship* nextOf(const Ship*) {return nullptr;}
+        static void setPrev(Ship*, Ship*) {}
+        static void setNext(Ship*, Ship*) {}
+#endif
+        void trace(TRACE_OP op, ShipId id, SHIPTYPE type = DEFAULT_TYPE, STATE state = DEFAULT_STATE, bool near = false) const {if(m_trace != nullptr) {writeTrace(op, id, type, state, near);}}
+        void writeTrace(TRACE_OP op, ShipId id, SHIPTYPE type, STATE state, bool near) const;
+        void flushTrace() const;
+        Ship* lookup(ShipId id) const;
+        void treeChanged();
+        void verify() const;
+        void clearCache();
+        void uncache(ShipId id);
+        void record(CHANGE kind, const Ship* ship);
+        void changeState(Ship* ship, STATE state);
+        static uint64_t shipHash(const Ship* ship);
+#ifdef FLEET_HASHES
+        static uint64_t subtreeHash(const Ship* aShip) {return (aShip != nullptr ? aShip->m_hash : 0);}
+        static void setSubtreeHash(Ship* aShip, uint64_t hash) {aShip->m_hash = hash;}
+#else
+        static uint64_t subtreeHash(const Ship*) {return 0;}
+        static void setSubtreeHash(Ship*, uint64_t) {}
+#endif
+        uint64_t rehash(Ship* aShip);
+        void addHash(ShipId id, uint64_t delta);
+        uint64_t prefixHash(ShipId id) const;
+        void diffRange(const Ship* aShip, ShipId low, ShipId high, const Fleet& other, vector<ShipId>& ids) const;
+        void collectRange(const Ship* aShip, ShipId low, ShipId high, vector<ShipId>& ids) const;
+        Ship* fingerSeek(ShipId id) const;
+        Ship* layoutFind(ShipId id) const;
+        bool layoutReady(int reads) const;
+        void treeFindMany(const ShipId ids[], int count, bool found[]) const;
+        void treeFindGroup(const ShipId ids[], int size, Ship* ships[]) const;
+        void layoutFindMany(const ShipId ids[], int count, bool found[]) const;
+        void rebuildLayout() const;
+        void collectShips(Ship* aShip, vector<Ship*>& ships) const;
+        int fillLayout(const vector<Ship*>& ships, int next, int index) const;
+};
+
+// One Ship in a SharedFleet, fixed size and free of pointers so that any process can read it wherever it is mapped
+struct SharedShip
+{
+    ShipId id;
+    uint8_t type;
+    uint8_t state;
+};
+// Start of a SharedFleet's region, followed by two slots of capacity SharedShips
+// The current snapshot is in slot version % 2, while the writer fills the other slot
+// Each slot's sequence is odd while the writer changes the slot and even otherwise
+struct SharedHeader
+{
+    char magic[8];
+    int32_t capacity;
+    atomic<int32_t> counts[2];
+    atomic<uint64_t> sequences[2];
+    atomic<uint64_t> version;
+};
+// A read-only copy of a Fleet in POSIX shared memory, sorted by id, that other processes search in place
+// One process creates it and publishes a Fleet to it, and any number of processes open it by name and read it
+// Readers check the sequence of the slot they read before and after each read, and read again if the writer
+// changed that slot in between; a publish into the other slot never makes them read again
+class SharedFleet
+{
+    public:
+        SharedFleet(const string& name, int capacity);
+        SharedFleet(const string& name);
+        ~SharedFleet();
+        bool isOpen() const {return m_header != nullptr;}
+        bool publish(const Fleet& fleet);
+        bool setState(ShipId id, STATE state);
+        bool findShip(ShipId id) const;
+        bool getState(ShipId id, STATE& state) const;
+        int getSize() const;
+        uint64_t getVersion() const;
+        template <class Function>
+        bool forEach(Function function) const;
+    private:
+        string m_name;
+        bool m_writer;
+        size_t m_bytes;
+        SharedHeader* m_header;
+
+        SharedShip* slot(uint64_t version) const;
+        int slotSize(uint64_t version) const;
+        uint64_t beginRead(uint64_t& version) const;
+        bool endRead(uint64_t version, uint64_t sequence) const;
+        void beginWrite(uint64_t version);
+        void endWrite(uint64_t version);
+        int search(const SharedShip ships[], int count, ShipId id) const;
+};
+
+// A Fleet stored by id instead of in a tree: one presence bit and one attribute byte per id in range
+// The 90000 ids of the default range take about 100KB, small enough to stay in L2, so lookups and changes
+// take O(1) and bulk scans run over the attribute bytes 32 at a time with AVX2
+// Best for Fleets that fill a good part of the range, a sparse Fleet still pays a byte for every id
+class DenseFleet
+{
+    public:
+        friend class Tester;
+        DenseFleet();
+        void clear();
+        void insert(const Ship& ship);
+        void build(const Ship ships[], int size);
+        void remove(ShipId id);
+        void listShips(ostream& out = cout) const;
+        void exportShips(ostream& out, FORMAT format) const;
+        bool setState(ShipId id, STATE state);
+        int setStates(const ShipId ids[], const STATE states[], int count, bool results[]);
+        void removeLost();
+        int countType(SHIPTYPE type) const;
+        int getSize() const {return m_size;}
+        MemoryUsage memoryUsage() const;
+        bool findShip(ShipId id) const;
+        int findMany(const ShipId ids[], int count, bool found[]) const;
+        template <class Function>
+        void forEach(Function function) const;
+    private:
+        // Each attribute byte holds the type in its low 3 bits, LOST in bit 3, and PRESENT while the id is in the Fleet
+        static const uint8_t TYPE_BITS = 7;
+        static const uint8_t LOST_BIT = 8;
+        static const uint8_t PRESENT = 128;
+        // Bit id - MINID of m_present is set while the id is in the Fleet, for scanning ids in order
+        vector<uint64_t> m_present;
+        vector<uint8_t> m_attributes;
+        ShipId m_range;
+        int m_size;
+
+        bool inRange(ShipId id) const {return id >= MINID && id - MINID < m_range;}
+        static uint64_t matchBytes(const uint8_t bytes[], uint8_t mask, uint8_t match);
 };
+
+// Name:    DenseFleet::forEach
+// Desc:    Calls function on every Ship in order of id, finding each one by scanning the presence bits a word at a time
+// Precon:  function must take a ShipId, a SHIPTYPE and a STATE
+// Postcon: function will have been called once on each Ship
+template <class Function>
+void DenseFleet::forEach(Function function) const
+{
+    for(size_t word = 0; word < m_present.size(); word++)
+    {
+        for(uint64_t bits = m_present[word]; bits != 0; bits &= bits - 1)
+        {
+            const size_t slot = word * 64 + __builtin_ctzll(bits);
+            const uint8_t attributes = m_attributes[slot];
+            function(MINID + (ShipId) slot, static_cast<SHIPTYPE>(attributes & TYPE_BITS), (attributes & LOST_BIT ? LOST : ALIVE));
+        }
+    }
+}
+
+// Name:    SharedFleet::forEach
+// Desc:    Calls function on every Ship of the current snapshot in order of id, reading it in place
+//          If the writer changes the scanned slot during the scan, the Ships passed may have been torn
+//          and the scan should be run again
+// Precon:  function must take a ShipId, a SHIPTYPE and a STATE
+// Postcon: Returns true if the scan saw one whole snapshot
+//          Else returns false
+template <class Function>
+bool SharedFleet::forEach(Function function) const
+{
+    if(m_header == nullptr)
+    {
+        return true;
+    }
+    uint64_t version;
+    const uint64_t sequence = beginRead(version);
+    const SharedShip* ships = slot(version);
+    const int count = slotSize(version);
+    for(int i = 0; i < count; i++)
+    {
+        function((ShipId) ships[i].id, static_cast<SHIPTYPE>(ships[i].type), static_cast<STATE>(ships[i].state));
+    }
+    return endRead(version, sequence);
+}
+
+// Name:    Fleet::parallelForEach
+// Desc:    Calls function on every Ship, splitting the tree near the root into subtrees
+//          that are visited on up to m_threads threads
+// Precon:  function must take a const Ship& and be safe to call from several threads at once
+// Postcon: function will have been called once on each Ship, in no particular order
+template <class Function>
+void Fleet::parallelForEach(Function function) const
+{
+    recursForEach(m_root, function, getSplits(m_size));
+}
+
+// Name:    Fleet::parallelReduce
+// Desc:    Maps every Ship to a value and combines the values, on up to m_threads threads
+//          Values are always combined in order of id, so the result is the same on any
+//          number of threads as long as combine is associative
+// Precon:  map must take a const Ship& and return a T
+//          combine must take two Ts and return a T, and be associative with identity as its identity
+// Postcon: Returns combine applied over the mapped value of each Ship, in order of id
+template <class T, class Map, class Combine>
+T Fleet::parallelReduce(T identity, Map map, Combine combine) const
+{
+    T result = identity;
+    recursReduce(m_root, result, identity, map, combine, getSplits(m_size));
+    return result;
+}
+
+// Name:    Fleet::recursForEach
+// Desc:    Recursively calls function on each Ship in the subtree
+//          While splits is positive, the left subtree is visited on another thread
+// Precon:  None
+// Postcon: function will have been called on each Ship in the subtree that hasn't been lazily removed
+template <class Function>
+void Fleet::recursForEach(Ship* aShip, Function& function, int splits) const
+{
+    if(aShip != nullptr)
+    {
+        // Visit the left subtree on another thread
+        if(splits > 0)
+        {
+            thread left([&]() {recursForEach(aShip->m_left, function, splits - 1);});
+            recursForEach(aShip->m_right, function, splits - 1);
+            left.join();
+        }
+        else
+        {
+            recursForEach(aShip->m_left, function, 0);
+            recursForEach(aShip->m_right, function, 0);
+        }
+        if(!aShip->m_removed)
+        {
+            function((const Ship&) *aShip);
+        }
+    }
+}
+
+// Name:    Fleet::recursReduce
+// Desc:    Recursively combines the mapped value of each Ship in the subtree onto result, in order of id
+//          While splits is positive, the left subtree is reduced on another thread and combined in afterwards
+// Precon:  None
+// Postcon: result will be combined with the mapped value of each Ship in the subtree that hasn't been lazily removed
+template <class T, class Map, class Combine>
+void Fleet::recursReduce(Ship* aShip, T& result, const T& identity, Map& map, Combine& combine, int splits) const
+{
+    if(aShip != nullptr)
+    {
+        // Reduce the left subtree on another thread, and this Ship and the right subtree here
+        if(splits > 0)
+        {
+            T right = (aShip->m_removed ? identity : map((const Ship&) *aShip));
+            thread left([&]() {recursReduce(aShip->m_left, result, identity, map, combine, splits - 1);});
+            recursReduce(aShip->m_right, right, identity, map, combine, splits - 1);
+            left.join();
+            result = combine(move(result), move(right));
+        }
+        else
+        {
+            recursReduce(aShip->m_left, result, identity, map, combine, 0);
+            if(!aShip->m_removed)
+            {
+                result = combine(move(result), map((const Ship&) *aShip));
+            }
+            recursReduce(aShip->m_right, result, identity, map, combine, 0);
+        }
+    }
+}
 #endif
\ No newline at end of file
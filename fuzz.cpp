@@ -0,0 +1,758 @@
+/**
+ * File:    fuzz.cpp
+ * Project: CMSC 341 Project 2 – The Fleet of Spaceships
+ *
+ * This file contains a differential fuzzing harness for the Fleet class
+ * Random operations run on a Fleet, a DenseFleet and a std::map reference side by side, and any
+ * disagreement is shrunk to a short sequence of operations that still shows it
+ * Build with "make fuzz", or with "make fuzzer" for a libFuzzer binary (needs clang)
+ * Usage:   fuzz.exe [operations] [seed]    Runs random sequences
+ *          fuzz.exe replay <file>          Runs a saved sequence, such as fuzz-failure.bin
+ */
+
+#include "fleet.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+using namespace std;
+
+const char BREAK[] = "*****************************************************************\n";
+// Bytes per operation: the operation, two bytes of id and an argument
+const int OP_SIZE = 4;
+// Ids come from the first ID_RANGE valid ids, plus one below MINID and one above MAXID
+const int ID_RANGE = 4096;
+// Operations between full comparisons of the Fleet against the reference
+const int CHECK_EVERY = 1000;
+// Operations per randomly generated sequence
+const int SEQUENCE_LENGTH = 20000;
+// Ids passed to each findMany and setStates
+const int BATCH_SIZE = 8;
+// Ticks after a heartbeat that its Ship's deadline falls
+const uint64_t HEARTBEAT_TIMEOUT = 4000;
+// File the shrunk failing sequence is saved to
+const char FAILURE_FILE[] = "fuzz-failure.bin";
+
+enum OPCODE {INSERT, INSERT_NEAR, REMOVE, SET_STATE, SET_STATE_NEAR, SET_STATE_HANDLE, FIND, FIND_NEAR,
+    FIND_MANY, SET_STATES, REMOVE_LOST, LAZY_REMOVE, COMPACT, CACHE, SEARCH_LAYOUT, BUILD, CLEAR, PLACE, HASHING, THREADING, ARCHIVE,
+    HEARTBEAT, ADVANCE};
+const char* const OPCODE_NAMES[] = {"insert", "insertNear", "remove", "setState", "setStateNear", "setState(find)",
+    "findShip", "findShipNear", "findMany", "setStates", "removeLost", "setLazyRemove", "compact", "setCache",
+    "setSearchLayout", "build", "clear", "setPlacement", "setHashing", "setThreading", "loadArchive", "heartbeat", "advance"};
+
+// A decoded operation
+struct Op
+{
+    OPCODE code;
+    ShipId id;
+    int arg;
+    SHIPTYPE type;
+    STATE state;
+};
+
+// Contents of a Fleet: each id's type and state
+typedef map<ShipId, pair<SHIPTYPE, STATE>> Reference;
+// Heartbeat deadline of each Ship that has one
+typedef map<ShipId, uint64_t> Deadlines;
+
+// Name:    decode
+// Desc:    Decodes OP_SIZE bytes into an operation
+//          Changes to the tree are weighted to keep the Fleet around 60% of ID_RANGE full, and bulk
+//          operations are rare enough that the Fleet gets big between them
+// Precon:  bytes must hold OP_SIZE bytes
+// Postcon: Returns the operation
+Op decode(const uint8_t bytes[])
+{
+    Op op;
+    const int code = bytes[0] % 64;
+    const int value = (bytes[1] | (bytes[2] << 8)) % (ID_RANGE + 2);
+    op.id = (value == 0 ? MINID - 1 : (value == ID_RANGE + 1 ? MAXID + 1 : MINID + value - 1));
+    op.arg = bytes[3];
+    op.type = static_cast<SHIPTYPE>(op.arg % 5);
+    op.state = static_cast<STATE>((op.arg >> 3) & 1);
+    if(code < 12)       op.code = INSERT;
+    else if(code < 18)  op.code = INSERT_NEAR;
+    else if(code < 30)  op.code = REMOVE;
+    else if(code < 36)  op.code = SET_STATE;
+    else if(code < 40)  op.code = SET_STATE_NEAR;
+    else if(code < 44)  op.code = SET_STATE_HANDLE;
+    else if(code < 48)  op.code = FIND;
+    else if(code < 49)  op.code = HEARTBEAT;
+    else if(code < 50)  op.code = ADVANCE;
+    else if(code < 54)  op.code = FIND_NEAR;
+    else if(code < 56)  op.code = FIND_MANY;
+    else if(code < 58)  op.code = SET_STATES;
+    else if(code < 59)  op.code = REMOVE_LOST;
+    else if(code < 60)  op.code = LAZY_REMOVE;
+    else if(code < 61)  op.code = COMPACT;
+    else if(code < 62)  op.code = CACHE;
+    else if(code < 63)  op.code = SEARCH_LAYOUT;
+    // The last code mostly searches, and only sometimes rebuilds, empties, moves, rehashes, threads or reloads the Fleet
+    else                op.code = (op.arg < 4 ? CLEAR : (op.arg < 16 ? BUILD : (op.arg < 20 ? PLACE : (op.arg < 24 ? HASHING : (op.arg < 28 ? THREADING : (op.arg < 32 ? ARCHIVE : FIND))))));
+    return op;
+}
+
+// Name:    ticks
+// Desc:    Finds how far an advance moves the clock, now and then far enough to pass every deadline
+//          The lowest arguments don't count here, they move the clock to the next deadline instead
+// Precon:  None
+// Postcon: Returns the ticks
+uint64_t ticks(int arg)
+{
+    return (arg >= 250 ? (uint64_t) arg << 30 : arg * 4);
+}
+
+// Name:    describe
+// Desc:    Describes an operation the way it would be called
+// Precon:  None
+// Postcon: Returns the description
+string describe(const Op& op)
+{
+    string text = OPCODE_NAMES[op.code];
+    switch(op.code)
+    {
+        case INSERT: case INSERT_NEAR:
+            return text + "(" + to_string(op.id) + ", type " + to_string(op.type) + ", state " + to_string(op.state) + ")";
+        case SET_STATE: case SET_STATE_NEAR: case SET_STATE_HANDLE:
+            return text + "(" + to_string(op.id) + ", state " + to_string(op.state) + ")";
+        case REMOVE: case FIND: case FIND_NEAR:
+            return text + "(" + to_string(op.id) + ")";
+        case HEARTBEAT:
+            return text + "(" + to_string(op.id) + (op.arg & 4 ? " by handle, " : ", ") + to_string(op.arg % 4) + " ticks on)";
+        case ADVANCE:
+            return text + "(" + (op.arg < 32 ? string("to the next deadline") : to_string(ticks(op.arg)) + " ticks on")
+                + ", removeLost " + to_string(op.arg & 1) + ")";
+        case FIND_MANY: case SET_STATES:
+            return text + "(" + to_string(op.id) + " + k * " + to_string(op.arg + 1) + ")";
+        case LAZY_REMOVE: case CACHE: case SEARCH_LAYOUT: case HASHING: case THREADING:
+            return text + "(" + to_string(op.arg & 1) + ")";
+        case PLACE:
+            return text + "(" + to_string(op.arg % 3) + ")";
+        case BUILD:
+            return text + "(" + to_string(op.arg * 64) + " Ships from " + to_string(op.id) + ")";
+        case ARCHIVE:
+            return text + "(written in blocks of " + to_string(1 + op.id % 64) + ")";
+        default:
+            return text + "()";
+    }
+}
+
+// Name:    present
+// Desc:    Checks whether the reference holds an id
+// Precon:  None
+// Postcon: Returns true if the id is in the reference
+bool present(const Reference& reference, ShipId id)
+{
+    return reference.find(id) != reference.end();
+}
+
+// Name:    compare
+// Desc:    Compares the whole Fleet against the reference and validates the tree
+//          Also steps through the Fleet with successor and predecessor, which follow the list while it is threaded
+// Precon:  None
+// Postcon: Returns an empty string if they agree
+//          Else returns what disagreed
+string compare(const Fleet& fleet, const Reference& reference)
+{
+    string report = fleet.validate();
+    if(!report.empty())
+    {
+        return "validate failed:\n" + report;
+    }
+    if(fleet.getSize() != (int) reference.size())
+    {
+        return "size is " + to_string(fleet.getSize()) + " instead of " + to_string(reference.size()) + "\n";
+    }
+    for(const pair<const ShipId, pair<SHIPTYPE, STATE>>& entry : reference)
+    {
+        const Ship* ship = fleet.find(entry.first);
+        if(ship == nullptr
+            || ship->getType() != entry.second.first
+            || ship->getState() != entry.second.second)
+        {
+            return "Ship " + to_string(entry.first) + " is missing or has the wrong type or state\n";
+        }
+    }
+    Reference::const_iterator expected = reference.begin();
+    for(const Ship* ship = fleet.first(); ship != nullptr; ship = fleet.successor(ship), expected++)
+    {
+        if(expected == reference.end()
+            || ship->getID() != expected->first)
+        {
+            return "successor reached Ship " + to_string(ship->getID()) + " out of order\n";
+        }
+    }
+    Reference::const_reverse_iterator expectedBack = reference.rbegin();
+    for(const Ship* ship = fleet.last(); ship != nullptr; ship = fleet.predecessor(ship), expectedBack++)
+    {
+        if(expectedBack == reference.rend()
+            || ship->getID() != expectedBack->first)
+        {
+            return "predecessor reached Ship " + to_string(ship->getID()) + " out of order\n";
+        }
+    }
+    if(expected != reference.end()
+        || expectedBack != reference.rend())
+    {
+        return "stepping through the Fleet stopped early\n";
+    }
+    return "";
+}
+
+// Name:    compareDense
+// Desc:    Compares the whole DenseFleet against the reference, in order and by type
+// Precon:  None
+// Postcon: Returns an empty string if they agree
+//          Else returns what disagreed
+string compareDense(const DenseFleet& dense, const Reference& reference)
+{
+    if(dense.getSize() != (int) reference.size())
+    {
+        return "DenseFleet size is " + to_string(dense.getSize()) + " instead of " + to_string(reference.size()) + "\n";
+    }
+    string report;
+    int types[5] = {0, 0, 0, 0, 0};
+    Reference::const_iterator expected = reference.begin();
+    dense.forEach([&](ShipId id, SHIPTYPE type, STATE state)
+    {
+        if(report.empty()
+            && (expected == reference.end()
+                || expected->first != id
+                || expected->second != make_pair(type, state)))
+        {
+            report = "DenseFleet reached Ship " + to_string(id) + " out of order or with the wrong type or state\n";
+        }
+        types[type]++;
+        if(expected != reference.end())
+        {
+            expected++;
+        }
+    });
+    for(int type = CARGO; type <= ROBOCARRIER && report.empty(); type++)
+    {
+        if(dense.countType(static_cast<SHIPTYPE>(type)) != types[type])
+        {
+            report = "DenseFleet countType(" + to_string(type) + ") is wrong\n";
+        }
+    }
+    return report;
+}
+
+// Name:    compareDiff
+// Desc:    Compares the ids diff finds between the Fleet and its replica, which is a comparison behind,
+//          against the ids whose entries changed in the reference since then
+// Precon:  The replica must hold what previous holds
+// Postcon: Returns an empty string if they agree
+//          Else returns what disagreed
+string compareDiff(const Fleet& fleet, const Fleet& replica, const Reference& reference, const Reference& previous)
+{
+    vector<ShipId> expected;
+    Reference::const_iterator now = reference.begin();
+    Reference::const_iterator then = previous.begin();
+    while(now != reference.end()
+        || then != previous.end())
+    {
+        if(then == previous.end()
+            || (now != reference.end() && now->first < then->first))
+        {
+            expected.push_back((now++)->first);
+        }
+        else if(now == reference.end()
+            || then->first < now->first)
+        {
+            expected.push_back((then++)->first);
+        }
+        else
+        {
+            if(now->second != then->second)
+            {
+                expected.push_back(now->first);
+            }
+            now++;
+            then++;
+        }
+    }
+    vector<ShipId> found;
+    fleet.diff(replica, found);
+    if(found != expected)
+    {
+        return "diff found " + to_string(found.size()) + " ids instead of " + to_string(expected.size()) + "\n";
+    }
+    return "";
+}
+
+// Name:    runOps
+// Desc:    Runs the operations on a new Fleet and on a reference, comparing their answers after each
+//          operation and their whole contents every CHECK_EVERY operations and at the end
+//          The Fleet's change stream is applied to a replica at each comparison, which must agree as well,
+//          and before it is applied, diff must find exactly the ids changed since the last comparison
+//          A DenseFleet runs the same operations, where it has them, and must agree as well
+//          Nothing is copied per operation, so a run costs about as much as the operations themselves
+// Precon:  data must hold size bytes, a trailing partial operation is ignored
+// Postcon: Returns an empty string if the Fleet always agreed with the reference
+//          Else returns what disagreed and at which operation
+string runOps(const uint8_t data[], size_t size)
+{
+    Fleet fleet;
+    Fleet replica;
+    DenseFleet dense;
+    vector<Change> changes;
+    Reference reference;
+    Reference previous;
+    Deadlines deadlines;
+    uint64_t now = 0;
+    fleet.setChangeStream(true);
+    fleet.setHashing(true);
+    fleet.setThreading(true);
+    fleet.setHeartbeats(true, HEARTBEAT_TIMEOUT);
+    replica.setHashing(true);
+    const int count = size / OP_SIZE;
+    for(int i = 0; i < count; i++)
+    {
+        const Op op = decode(data + i * OP_SIZE);
+        const bool valid = op.id >= MINID && op.id <= MAXID;
+        const bool had = present(reference, op.id);
+        string failure;
+        switch(op.code)
+        {
+            case INSERT: case INSERT_NEAR:
+            {
+                if(op.code == INSERT)
+                {
+                    fleet.insert(Ship(op.id, op.type, op.state));
+                }
+                else
+                {
+                    fleet.insertNear(Ship(op.id, op.type, op.state));
+                }
+                dense.insert(Ship(op.id, op.type, op.state));
+                if(valid && !had)
+                {
+                    reference[op.id] = {op.type, op.state};
+                }
+                break;
+            }
+            case REMOVE:
+            {
+                fleet.remove(op.id);
+                dense.remove(op.id);
+                reference.erase(op.id);
+                deadlines.erase(op.id);
+                break;
+            }
+            case SET_STATE: case SET_STATE_NEAR:
+            {
+                if((op.code == SET_STATE ? fleet.setState(op.id, op.state) : fleet.setStateNear(op.id, op.state)) != had)
+                {
+                    failure = "returned " + to_string(!had);
+                }
+                if(dense.setState(op.id, op.state) != had)
+                {
+                    failure = "DenseFleet returned " + to_string(!had);
+                }
+                if(had)
+                {
+                    reference[op.id].second = op.state;
+                }
+                if(op.state == LOST)
+                {
+                    deadlines.erase(op.id);
+                }
+                break;
+            }
+            case SET_STATE_HANDLE:
+            {
+                const Ship* ship = fleet.find(op.id);
+                if((ship != nullptr) != had
+                    || (ship != nullptr && ship->getID() != op.id))
+                {
+                    failure = "find returned the wrong Ship";
+                }
+                else if(fleet.setState(ship, op.state) != had)
+                {
+                    failure = "setState through the handle returned " + to_string(!had);
+                }
+                dense.setState(op.id, op.state);
+                if(had)
+                {
+                    reference[op.id].second = op.state;
+                }
+                if(op.state == LOST)
+                {
+                    deadlines.erase(op.id);
+                }
+                break;
+            }
+            case FIND: case FIND_NEAR:
+            {
+                if((op.code == FIND ? fleet.findShip(op.id) : fleet.findShipNear(op.id)) != had)
+                {
+                    failure = "returned " + to_string(!had);
+                }
+                if(dense.findShip(op.id) != had)
+                {
+                    failure = "DenseFleet returned " + to_string(!had);
+                }
+                break;
+            }
+            case FIND_MANY: case SET_STATES:
+            {
+                ShipId ids[BATCH_SIZE];
+                STATE states[BATCH_SIZE];
+                bool results[BATCH_SIZE];
+                bool denseResults[BATCH_SIZE];
+                int expected = 0;
+                for(int k = 0; k < BATCH_SIZE; k++)
+                {
+                    ids[k] = op.id + k * (op.arg + 1);
+                    states[k] = static_cast<STATE>(k & 1);
+                    expected += present(reference, ids[k]);
+                }
+                const int found = (op.code == FIND_MANY ? fleet.findMany(ids, BATCH_SIZE, results) : fleet.setStates(ids, states, BATCH_SIZE, results));
+                const int denseFound = (op.code == FIND_MANY ? dense.findMany(ids, BATCH_SIZE, denseResults) : dense.setStates(ids, states, BATCH_SIZE, denseResults));
+                for(int k = 0; k < BATCH_SIZE; k++)
+                {
+                    if(results[k] != present(reference, ids[k]))
+                    {
+                        failure = "got the wrong answer for " + to_string(ids[k]);
+                    }
+                    if(denseResults[k] != results[k])
+                    {
+                        failure = "DenseFleet got the wrong answer for " + to_string(ids[k]);
+                    }
+                    if(op.code == SET_STATES && results[k])
+                    {
+                        reference[ids[k]].second = states[k];
+                        if(states[k] == LOST)
+                        {
+                            deadlines.erase(ids[k]);
+                        }
+                    }
+                }
+                if(found != expected
+                    || denseFound != expected)
+                {
+                    failure = "returned " + to_string(found) + " and " + to_string(denseFound) + " instead of " + to_string(expected);
+                }
+                break;
+            }
+            case REMOVE_LOST:
+            {
+                fleet.removeLost();
+                dense.removeLost();
+                for(Reference::iterator it = reference.begin(); it != reference.end(); )
+                {
+                    it = (it->second.second == LOST ? reference.erase(it) : next(it));
+                }
+                break;
+            }
+            case LAZY_REMOVE:
+            {
+                fleet.setLazyRemove(op.arg & 1, 0.1 + ((op.arg >> 1) % 8) * 0.1);
+                break;
+            }
+            case COMPACT:
+            {
+                fleet.compact();
+                break;
+            }
+            case CACHE:
+            {
+                fleet.setCache(op.arg & 1);
+                break;
+            }
+            case SEARCH_LAYOUT:
+            {
+                fleet.setSearchLayout(op.arg & 1);
+                break;
+            }
+            case BUILD:
+            {
+                // Build from up to 1000 Ships, with every eighth one repeating the id before it
+                const int count = op.arg * 64;
+                vector<Ship> ships(count);
+                reference.clear();
+                deadlines.clear();
+                for(int k = 0; k < count; k++)
+                {
+                    const ShipId id = (k % 8 == 7 ? ships[k - 1].getID() : MINID - 1 + (op.id + k * 37) % (ID_RANGE + 2));
+                    ships[k] = Ship(id, static_cast<SHIPTYPE>(k % 5), static_cast<STATE>(k % 3 == 0));
+                    if(id >= MINID
+                        && id <= MAXID
+                        && !present(reference, id))
+                    {
+                        reference[id] = {ships[k].getType(), ships[k].getState()};
+                    }
+                }
+                fleet.build(ships.data(), count);
+                dense.build(ships.data(), count);
+                break;
+            }
+            case PLACE:
+            {
+                fleet.setPlacement(static_cast<PLACEMENT>(op.arg % 3));
+                break;
+            }
+            case HASHING:
+            {
+                fleet.setHashing(op.arg & 1);
+                break;
+            }
+            case THREADING:
+            {
+                fleet.setThreading(op.arg & 1);
+                break;
+            }
+            case ARCHIVE:
+            {
+                // Write the Fleet out and load it back, which must give the same Ships
+                stringstream archive;
+                fleet.writeArchive(archive, 1 + op.id % 64);
+                if(!fleet.loadArchive(archive))
+                {
+                    failure = "refused its own archive";
+                }
+                deadlines.clear();
+                break;
+            }
+            case CLEAR:
+            {
+                fleet.clear();
+                dense.clear();
+                reference.clear();
+                deadlines.clear();
+                break;
+            }
+            case HEARTBEAT:
+            {
+                now += op.arg % 4;
+                if((op.arg & 4 ? fleet.heartbeat(fleet.find(op.id), now) : fleet.heartbeat(op.id, now)) != had)
+                {
+                    failure = "returned " + to_string(!had);
+                }
+                if(had)
+                {
+                    dense.setState(op.id, ALIVE);
+                    reference[op.id].second = ALIVE;
+                    deadlines[op.id] = now + HEARTBEAT_TIMEOUT;
+                }
+                break;
+            }
+            case ADVANCE:
+            {
+                // Every Ship whose deadline has passed turns LOST, or is removed
+                const bool removeLost = op.arg & 1;
+                if(op.arg >= 32)
+                {
+                    now += ticks(op.arg);
+                }
+                else if(!deadlines.empty())
+                {
+                    now = numeric_limits<uint64_t>::max();
+                    for(const pair<const ShipId, uint64_t>& deadline : deadlines)
+                    {
+                        now = min(now, deadline.second);
+                    }
+                }
+                int expected = 0;
+                for(Deadlines::iterator it = deadlines.begin(); it != deadlines.end(); )
+                {
+                    if(it->second > now)
+                    {
+                        it++;
+                        continue;
+                    }
+                    expected++;
+                    if(removeLost)
+                    {
+                        dense.remove(it->first);
+                        reference.erase(it->first);
+                    }
+                    else
+                    {
+                        dense.setState(it->first, LOST);
+                        reference[it->first].second = LOST;
+                    }
+                    it = deadlines.erase(it);
+                }
+                const int expired = fleet.advance(now, removeLost);
+                if(expired != expected)
+                {
+                    failure = "expired " + to_string(expired) + " Ships instead of " + to_string(expected);
+                }
+                break;
+            }
+        }
+        if(failure.empty()
+            && ((i + 1) % CHECK_EVERY == 0 || i == count - 1))
+        {
+            failure = compare(fleet, reference);
+            if(failure.empty())
+            {
+                failure = compareDense(dense, reference);
+            }
+            if(failure.empty())
+            {
+                failure = compareDiff(fleet, replica, reference, previous);
+            }
+            previous = reference;
+            changes.clear();
+            fleet.takeChanges(changes);
+            if(failure.empty()
+                && (replica.applyChanges(changes.data(), changes.size()) != (int) changes.size()
+                    || replica.getSequence() != fleet.getSequence()))
+            {
+                failure = "the replica skipped a change";
+            }
+            if(failure.empty())
+            {
+                failure = compare(replica, reference);
+                failure = (failure.empty() ? "" : "replica: " + failure);
+            }
+            if(failure.empty()
+                && !fleet.sameShips(replica))
+            {
+                failure = "the replica's hash differs";
+            }
+        }
+        if(!failure.empty())
+        {
+            return "operation " + to_string(i) + ", " + describe(op) + ": " + failure;
+        }
+    }
+    return "";
+}
+
+// Name:    fails
+// Desc:    Runs the operations in a child process, so that a sequence that crashes the Fleet
+//          counts as failing instead of ending the harness
+// Precon:  None
+// Postcon: Returns true if the Fleet disagreed with the reference or crashed
+bool fails(const vector<uint8_t>& ops)
+{
+    cout.flush();
+    pid_t child = fork();
+    // No child process, run the operations here instead
+    if(child < 0)
+    {
+        return !runOps(ops.data(), ops.size()).empty();
+    }
+    if(child == 0)
+    {
+        _exit(runOps(ops.data(), ops.size()).empty() ? 0 : 1);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    return !WIFEXITED(status)
+        || WEXITSTATUS(status) != 0;
+}
+
+// Name:    shrink
+// Desc:    Removes operations from a failing sequence for as long as it keeps failing, trying
+//          smaller and smaller chunks until single operations are tried
+// Precon:  ops must fail
+// Postcon: Returns a sequence that still fails, where removing any one operation makes it pass
+vector<uint8_t> shrink(vector<uint8_t> ops)
+{
+    for(int chunk = ops.size() / OP_SIZE / 2; chunk > 0; chunk /= 2)
+    {
+        bool removed = true;
+        // Keep sweeping at this chunk size until nothing more can be removed
+        while(removed)
+        {
+            removed = false;
+            for(int start = 0; start + chunk <= (int) ops.size() / OP_SIZE; )
+            {
+                vector<uint8_t> smaller(ops.begin(), ops.begin() + start * OP_SIZE);
+                smaller.insert(smaller.end(), ops.begin() + (start + chunk) * OP_SIZE, ops.end());
+                if(fails(smaller))
+                {
+                    ops = smaller;
+                    removed = true;
+                }
+                else
+                {
+                    start += chunk;
+                }
+            }
+        }
+    }
+    return ops;
+}
+
+// Name:    report
+// Desc:    Shrinks a failing sequence, saves it to FAILURE_FILE and lists its operations
+//          The shrunk sequence is then run here to show what disagreed, which may crash
+// Precon:  ops must fail
+// Postcon: The failure is displayed to the user
+void report(const vector<uint8_t>& ops)
+{
+    vector<uint8_t> shrunk = shrink(ops);
+    ofstream(FAILURE_FILE, ios::binary).write((const char*) shrunk.data(), shrunk.size());
+    cout << BREAK << "FAILED after shrinking to " << shrunk.size() / OP_SIZE << " operations (saved to " << FAILURE_FILE << ")\n" << BREAK;
+    for(int i = 0; i < (int) shrunk.size() / OP_SIZE; i++)
+    {
+        cout << i << ": " << describe(decode(shrunk.data() + i * OP_SIZE)) << "\n";
+    }
+    cout << BREAK << flush;
+    cout << runOps(shrunk.data(), shrunk.size());
+}
+
+#ifdef FLEET_LIBFUZZER
+// Name:    LLVMFuzzerTestOneInput
+// Desc:    libFuzzer entry point, runs the input as a sequence of operations
+// Precon:  data must hold size bytes
+// Postcon: Aborts if the Fleet disagrees with the reference
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    string failure = runOps(data, size);
+    if(!failure.empty())
+    {
+        cerr << failure;
+        abort();
+    }
+    return 0;
+}
+#else
+int main(int argc, char* argv[])
+{
+    // Replay a saved sequence
+    if(argc == 3
+        && string(argv[1]) == "replay")
+    {
+        ifstream file(argv[2], ios::binary);
+        vector<uint8_t> ops((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        string failure = runOps(ops.data(), ops.size());
+        cout << (failure.empty() ? "PASSED\n" : failure);
+        return !failure.empty();
+    }
+    const long long total = (argc > 1 ? atoll(argv[1]) : 2000000);
+    mt19937 rng(argc > 2 ? atoi(argv[2]) : 341);
+    cout << BREAK << "Fuzzing " << total << " operations against std::map\n" << BREAK;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<uint8_t> ops(SEQUENCE_LENGTH * OP_SIZE);
+    for(long long done = 0; done < total; done += SEQUENCE_LENGTH)
+    {
+        for(uint8_t& byte : ops)
+        {
+            byte = rng();
+        }
+        if(fails(ops))
+        {
+            report(ops);
+            return 1;
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "PASSED, " << (long long) (total / seconds) << " operations per second\n" << BREAK;
+    return 0;
+}
+#endif
@@ -1,9 +1,24 @@
 #include "fleet.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
 #include <math.h>
+#include <set>
+#include <sstream>
 #include <time.h>
+#include <type_traits>
+#include <unistd.h>
 using namespace std;
 
 const char BREAK[] = "*****************************************************************\n";
+// How far the scaling measured by the time tests may stray from the expected scaling
+// Ships in wide builds are bigger, so more of each larger trial misses the cache and their times vary more
+#ifdef FLEET_WIDE_IDS
+const double TIME_VARIABILITY = .6;
+#else
+const double TIME_VARIABILITY = .4;
+#endif
 
 class Tester{
     public:
@@ -12,20 +27,44 @@ class Tester{
         int getFailCount();
         void result(bool test);
         static bool insertTest(Fleet& fleet, Ship ships[], int size);
-        static bool removeTest(Fleet& fleet, int ids[], int size);
-        static bool setStateTest(Fleet& fleet, int id, STATE state = LOST);
-        static bool removeLostTest(Fleet& fleet, int lostIds[], int size);
-        static bool findShipTest(Fleet& fleet, int ids[], int size, bool answer);
+        static bool fingerTest(Fleet& fleet, ShipId ids[], int size);
+        static bool buildTest(Ship ships[], int size, int threads);
+        static bool removeTest(Fleet& fleet, ShipId ids[], int size);
+        static bool validateTest(Fleet& fleet);
+        static bool setStateTest(Fleet& fleet, ShipId id, STATE state = LOST);
+        static bool setStatesTest(Fleet& fleet, ShipId ids[], STATE states[], int size);
+        static bool removeLostTest(Fleet& fleet, ShipId lostIds[], int size);
+        static bool lazyRemoveTest(Fleet& fleet, ShipId ids[], int size);
+        static bool findShipTest(Fleet& fleet, ShipId ids[], int size, bool answer);
+        static bool handleTest(Fleet& fleet, ShipId ids[], int size);
+        static bool searchLayoutTest(Fleet& fleet, ShipId ids[], int size);
+        static bool findManyTest(Fleet& fleet, ShipId ids[], int size);
+        static bool cacheTest(Fleet& fleet, ShipId ids[], int size);
+        static bool exportTest(Fleet& fleet, ShipId ids[], int size);
+        static bool archiveTest(Fleet& fleet, ShipId ids[], int size);
+        static bool traceTest(Fleet& fleet, ShipId ids[], int size);
+        static bool heartbeatTest(Fleet& fleet, ShipId ids[], int size);
+        static bool memoryTest(Fleet& fleet, ShipId ids[], int size);
+        static bool placementTest(Fleet& fleet, ShipId ids[], int size, PLACEMENT placement, NUMA_POLICY numa, int node = 0);
+        static bool sharedTest(Fleet& fleet, ShipId ids[], int size);
+        static bool sharedPublishTest(int size, int publishes);
+        static bool replicaTest(Fleet& fleet, ShipId ids[], int size);
+        static bool hashTest(Fleet& fleet, ShipId ids[], int size);
+        static bool threadTest(Fleet& fleet, ShipId ids[], int size);
+        static bool denseTest(Fleet& fleet, ShipId ids[], int size);
+        static bool parallelTest(Fleet& fleet, int threads);
         static bool insertTimeTest(int inputSize = 1000, int numTrials = 2, int numRepeats = 50);
         static bool removeTimeTest(int inputSize = 1000, int numTrials = 2, int numRepeats = 50);
         static bool findShipTimeTest(int inputSize = 1000, int numTrials = 2, int numRepeats = 50);
-        static bool inArray(int item, int arr[], int size);
+        static bool inArray(ShipId item, ShipId arr[], int size);
         static Fleet copyFleet(const Fleet& fleet);
     private:
+        static double updateCost(int size);
         int m_testCount;
         int m_failCount;
         static Ship* copyShip(Ship* ship);
         static bool unbalanced(const Fleet& fleet);
+        static bool cacheStale(const Fleet& fleet);
         static int recursBalanced(Ship* ship);
         static bool fleetEqual(const Fleet& lhs, const Fleet& rhs);
         static bool shipEqual(Ship* lhs, Ship* rhs);
@@ -107,12 +146,80 @@ bool Tester::insertTest(Fleet& fleet, Ship ships[], int size)
     return true;
 }
 
+// Name:    fingerTest
+// Desc:    Makes sure that insertNear keeps the Fleet balanced, and that findShipNear and setStateNear
+//          agree with findShip while walking the ids forwards, backwards and at random
+// Precon:  size denotes the size of the passed array
+// Postcon: If the finger operations are correct, returns true
+//          Else returns false
+bool Tester::fingerTest(Fleet& fleet, ShipId ids[], int size)
+{
+    for(int i = 0; i < size; i++)
+    {
+        fleet.insertNear(Ship(ids[i]));
+        // The Ship wasn't inserted or the Fleet became unbalanced, return false
+        if(!fleet.findShip(ids[i])
+            || unbalanced(fleet))
+        {
+            return false;
+        }
+    }
+    // Walk every id in range forwards, then backwards, then at random
+    for(int walk = 0; walk < 3; walk++)
+    {
+        for(int i = 0; i <= MAXID - MINID + 2; i++)
+        {
+            ShipId id = (walk == 0 ? MINID - 1 + i : (walk == 1 ? MAXID + 1 - i : rand() % (MAXID - MINID + 1) + MINID));
+            if(fleet.findShipNear(id) != fleet.findShip(id)
+                || fleet.setStateNear(id, ALIVE) != fleet.findShip(id))
+            {
+                return false;
+            }
+        }
+        // Changing the tree in between should drop the finger, not break it
+        if(size > 0)
+        {
+            fleet.remove(ids[walk % size]);
+            fleet.insertNear(Ship(ids[walk % size]));
+        }
+    }
+    // The finger operations were correct, return true
+    return true;
+}
+
+// Name:    buildTest
+// Desc:    Makes sure that build, on the passed number of threads, gives the same Ships as inserting them one at a time
+// Precon:  size denotes the size of the passed array
+// Postcon: If the built Fleet is balanced and matches the inserted one, returns true
+//          Else returns false
+bool Tester::buildTest(Ship ships[], int size, int threads)
+{
+    Fleet inserted, built;
+    built.setThreads(threads);
+    for(int i = 0; i < size; i++)
+    {
+        inserted.insert(ships[i]);
+    }
+    // Build over some existing Ships, which should be replaced
+    built.insert(Ship(MINID));
+    built.build(ships, size);
+    ostringstream insertedList, builtList;
+    inserted.listShips(insertedList);
+    built.listShips(builtList);
+    bool output = builtList.str() == insertedList.str()
+        && built.getSize() == inserted.getSize()
+        && !unbalanced(built);
+    // Clearing should leave an empty Fleet
+    built.clear();
+    return output && built.getRoot() == nullptr && built.getSize() == 0;
+}
+
 // Name:    removeTest
 // Desc:    Makes sure that remove successfully removes all passed ids
 // Precon:  size denotes the size of the passed array
 // Postcon: If any removal fails, returns false
 //          Else returns true
-bool Tester::removeTest(Fleet& fleet, int ids[], int size)
+bool Tester::removeTest(Fleet& fleet, ShipId ids[], int size)
 {
     // Iterate through the passed ids
     for(int i = 0; i < size; i++)
@@ -145,12 +252,117 @@ bool Tester::removeTest(Fleet& fleet, int ids[], int size)
 }
 
 
+// Name:    Tester::validateTest
+// Desc:    Makes sure that validate accepts the Fleet, then breaks each invariant in turn and
+//          makes sure that validate reports it and accepts the Fleet again once it is undone
+// Precon:  The Fleet must be valid and hold a RED Ship and a left child of the root
+//          In AVL builds, the root's left child must have a child
+// Postcon: If validate catches every broken invariant, returns true
+//          Else returns false
+bool Tester::validateTest(Fleet& fleet)
+{
+    if(!fleet.validate().empty())
+    {
+        return false;
+    }
+    Ship* root = fleet.m_root;
+    Ship* left = root->m_left;
+    // Each check breaks an invariant, looks for its report, then undoes it
+    auto reports = [&](const string& text)
+    {
+        return fleet.validate().find(text) != string::npos;
+    };
+#ifdef FLEET_AVL
+    // A stale height, and subtrees whose heights differ by 2
+    root->m_height++;
+    bool caught = reports("has height");
+    root->m_height--;
+    Ship* grandchild = (left->m_left != nullptr ? left->m_left : left->m_right);
+    if(grandchild == nullptr)
+    {
+        return false;
+    }
+    Ship*& link = (left->m_left == grandchild ? left->m_left : left->m_right);
+    link = nullptr;
+    left->m_height = 1 + max(Fleet::heightOf(left->m_left), Fleet::heightOf(left->m_right));
+    caught = caught && reports("heights differ");
+    link = grandchild;
+    left->m_height = 1 + max(Fleet::heightOf(left->m_left), Fleet::heightOf(left->m_right));
+    root->m_height = 1 + max(Fleet::heightOf(root->m_left), Fleet::heightOf(root->m_right));
+    caught = caught && fleet.validate().find("heights differ") == string::npos;
+#else
+    // RED root
+    root->m_color = RED;
+    bool caught = reports("root");
+    root->m_color = BLACK;
+#endif
+    // Ids out of range and out of order
+    ShipId id = left->m_id;
+    left->m_id = MINID - 1;
+    caught = caught && reports("outside");
+    left->m_id = root->m_id + 1;
+    caught = caught && reports("BST order");
+    left->m_id = id;
+#ifndef FLEET_AVL
+    // A leftover DOUBLEBLACK
+    COLOR color = left->m_color;
+    left->m_color = DOUBLEBLACK;
+    caught = caught && reports("DOUBLEBLACK");
+    left->m_color = color;
+    // Find a RED Ship and its parent, which must be BLACK
+    vector<pair<Ship*, Ship*>> links = {{nullptr, root}};
+    Ship* red = nullptr;
+    Ship* parent = nullptr;
+    for(int i = 0; i < (int) links.size() && red == nullptr; i++)
+    {
+        Ship* ship = links[i].second;
+        if(ship->m_color == RED)
+        {
+            parent = links[i].first;
+            red = ship;
+        }
+        for(Ship* child : {ship->m_left, ship->m_right})
+        {
+            if(child != nullptr)
+            {
+                links.emplace_back(ship, child);
+            }
+        }
+    }
+    if(red == nullptr)
+    {
+        return false;
+    }
+    // A RED Ship under a RED Ship, and a BLACK Ship changing the number of BLACK Ships on its paths
+    parent->m_color = RED;
+    caught = caught && reports("has a RED child");
+    parent->m_color = BLACK;
+    red->m_color = BLACK;
+    caught = caught && reports("BLACK Ships instead of");
+    red->m_color = RED;
+#endif
+    // Counts that don't match the tree, and a Ship linked twice
+    fleet.m_size++;
+    caught = caught && reports("Ships are linked but the size");
+    fleet.m_size--;
+    Ship* leaf = root;
+    while(leaf->m_left != nullptr)
+    {
+        leaf = leaf->m_left;
+    }
+    leaf->m_left = root;
+    caught = caught && reports("linked twice");
+    leaf->m_left = nullptr;
+    // Undoing everything should leave a valid Fleet
+    return caught && fleet.validate().empty();
+}
+
 // Name:    Tester::setStateTest
 // Desc:    Makes sure that setState successfully changes the STATE of the Ship with the passed id
 // Precon:  None
 // Postcon: If setState successfully changes the STATE of the passed Ship id, returns true
 //          Else returns false
-bool Tester::setStateTest(Fleet& fleet, int id, STATE state)
+bool Tester::setStateTest(Fleet& fleet, ShipId id, STATE state)
 {
     // The Ship is in the Fleet, make sure its STATE changes
     if(fleet.findShip(id))
@@ -180,68 +392,1463 @@ bool Tester::setStateTest(Fleet& fleet, int id, STATE state)
     return false;
 }
 
-// Name:    Tester::removeLostTest
-// Desc:    Makes sure that removeLost removes all lost Ships
-// Precon:  lostIds must contain all lost ids in the Fleet
-//          size denotes the size of the passed array
-// Postcon: If every search matches the passed answer, returns true
+// Name:    Tester::setStatesTest
+// Desc:    Makes sure that setStates has the same effect as calling setState on each id in order
+//          Checks both the tree walk and the search layout
+// Precon:  size denotes the size of the passed arrays
+// Postcon: If setStates matches setState, returns true
+//          Else returns false
+bool Tester::setStatesTest(Fleet& fleet, ShipId ids[], STATE states[], int size)
+{
+    bool results[size];
+    for(int layout = 0; layout < 2; layout++)
+    {
+        Fleet batched = copyFleet(fleet);
+        Fleet single = copyFleet(fleet);
+        batched.setSearchLayout(layout == 1);
+        int numSet = batched.setStates(ids, states, size, results);
+        for(int i = 0; i < size; i++)
+        {
+            // The result doesn't match setState, return false
+            if(results[i] != single.setState(ids[i], states[i]))
+            {
+                return false;
+            }
+            numSet -= results[i];
+        }
+        // The Fleets differ or the returned count is wrong, return false
+        if(!fleetEqual(batched, single)
+            || numSet != 0)
+        {
+            return false;
+        }
+    }
+    // setStates matched setState, return true
+    return true;
+}
+
+// Name:    Tester::removeLostTest
+// Desc:    Makes sure that removeLost removes all lost Ships
+// Precon:  lostIds must contain all lost ids in the Fleet
+//          size denotes the size of the passed array
+// Postcon: If every search matches the passed answer, returns true
+//          Else returns false
+bool Tester::removeLostTest(Fleet& fleet, ShipId lostIds[], int size)
+{
+    // No lost ids, no change should occur
+    if(size == 0)
+    {
+        Fleet copy = copyFleet(fleet);
+        fleet.removeLost();
+        // Change occured, return false
+        if(!fleetEqual(fleet, copy))
+        {
+            return false;
+        }
+    }
+    // There are lost ids, check that all are removed
+    else
+    {
+        fleet.removeLost();
+        // Return false if the fleet becomes unbalanced
+        if(unbalanced(fleet))
+        {
+            return false;
+        }
+        // Iterate through the lost ids
+        for(int i = 0; i < size; i++)
+        {
+            // Make sure none of the lost ids are in the Fleet
+            if(fleet.findShip(lostIds[i]))
+            {
+                return false;
+            }
+        }
+    }
+    // All lost ids were successfully removed, return true
+    return true;
+}
+
+// Name:    Tester::lazyRemoveTest
+// Desc:    Makes sure that lazily removed Ships can't be found, that compaction keeps the
+//          number of flagged Ships under the threshold, and that flagged ids can be inserted again
+// Precon:  ids must contain all ids in the Fleet
+//          size denotes the size of the passed array
+// Postcon: If lazy removal behaves correctly, returns true
+//          Else returns false
+bool Tester::lazyRemoveTest(Fleet& fleet, ShipId ids[], int size)
+{
+    const double threshold = .25;
+    fleet.setLazyRemove(true, threshold);
+    // Lazily remove every other Ship
+    for(int i = 0; i < size; i += 2)
+    {
+        fleet.remove(ids[i]);
+        // The Ship can still be found, it can still be changed, or there are too many flagged Ships, return false
+        if(fleet.findShip(ids[i])
+            || fleet.setState(ids[i], LOST)
+            || fleet.m_tombstones > threshold * (fleet.m_size + fleet.m_tombstones)
+            || unbalanced(fleet))
+        {
+            return false;
+        }
+    }
+    // Insert the removed Ships again
+    for(int i = 0; i < size; i += 2)
+    {
+        fleet.insert(Ship(ids[i]));
+    }
+    // Turning lazy removal off should leave no flagged Ships
+    fleet.setLazyRemove(false);
+    if(fleet.m_tombstones != 0
+        || fleet.getSize() != size
+        || unbalanced(fleet))
+    {
+        return false;
+    }
+    // Every Ship should be back
+    for(int i = 0; i < size; i++)
+    {
+        if(!fleet.findShip(ids[i]))
+        {
+            return false;
+        }
+    }
+    // Lazy removal behaved correctly, return true
+    return true;
+}
+
+// Name:    Tester::findShipTest
+// Desc:    Makes sure that findShip successfully finds the passed Ship ids
+// Precon:  If answer is true, ids contains ids in the Fleet
+//          If answer is false, ids contains ids not in the Fleet
+//          size denotes the side of the passed array
+// Postcon: If every search matches the passed answer, returns true
+//          Else returns false
+bool Tester::findShipTest(Fleet& fleet, ShipId ids[], int size, bool answer)
+{
+    // Iterate through the passed ids
+    for(int i = 0; i < size; i++)
+    {
+        // Search for each id, return false if it doesn't return the right answer
+        if(fleet.findShip(ids[i]) != answer)
+        {
+            return false;
+        }
+    }
+    // Every search was successful, return true
+    return true;
+}
+
+// Name:    Tester::handleTest
+// Desc:    Makes sure that handles from find keep pointing to the same Ship while other Ships are removed
+// Precon:  ids contains size ids in the Fleet
+// Postcon: If every surviving handle still refers to its Ship, returns true
+//          Else returns false
+bool Tester::handleTest(Fleet& fleet, ShipId ids[], int size)
+{
+    // Handles are read-only, so that every change goes through the Fleet
+    static_assert(is_same<decltype(fleet.find(MINID)), const Ship*>::value, "find must return a read-only handle");
+    vector<const Ship*> handles(size);
+    for(int i = 0; i < size; i++)
+    {
+        handles[i] = fleet.find(ids[i]);
+        if(handles[i] == nullptr
+            || handles[i]->getID() != ids[i])
+        {
+            return false;
+        }
+    }
+    // Remove every third Ship, through normal removal, lazy removal and removeLost
+    for(int i = 0; i < size; i += 3)
+    {
+        if(i % 2 == 0)
+        {
+            fleet.remove(ids[i]);
+        }
+        else
+        {
+            fleet.setState(handles[i], LOST);
+        }
+        if(unbalanced(fleet))
+        {
+            return false;
+        }
+    }
+    fleet.removeLost();
+    fleet.setLazyRemove(true);
+    fleet.remove(ids[size > 1]);
+    // Every surviving handle should still be the Ship the tree finds for its id
+    for(int i = 0; i < size; i++)
+    {
+        if(i % 3 != 0
+            && i != (size > 1))
+        {
+            if(fleet.find(ids[i]) != handles[i]
+                || handles[i]->getID() != ids[i]
+                || !fleet.setState(handles[i], LOST)
+                || fleet.findNode(ids[i])->m_state != LOST)
+            {
+                return false;
+            }
+        }
+        else if(fleet.find(ids[i]) != nullptr)
+        {
+            return false;
+        }
+    }
+    // Every handle was stable, return true
+    return true;
+}
+
+// Name:    Tester::searchLayoutTest
+// Desc:    Makes sure that lookups through the search layout agree with the tree, before and after the tree changes,
+//          including lookups on several threads at once that find the layout due for a rebuild
+// Precon:  ids contains size ids in the Fleet
+// Postcon: If every lookup agrees with the tree, returns true
+//          Else returns false
+bool Tester::searchLayoutTest(Fleet& fleet, ShipId ids[], int size)
+{
+    fleet.setSearchLayout(true);
+    // Alternate between searching every id in range and removing half of the passed ids
+    for(int round = 0; round < 3; round++)
+    {
+        // Each reader searches every id in range a few times, so one of them rebuilds the layout under the others
+        const Fleet& reader = fleet;
+        atomic<bool> agreed(true);
+        vector<thread> readers;
+        for(int t = 0; t < 4; t++)
+        {
+            readers.emplace_back([&]()
+            {
+                for(int repeat = 0; repeat < 3; repeat++)
+                {
+                    for(ShipId id = MINID - 1; id <= MAXID + 1; id += 7)
+                    {
+                        if(reader.findShip(id) != (reader.findNode(id) != nullptr))
+                        {
+                            agreed = false;
+                        }
+                    }
+                }
+            });
+        }
+        for(thread& t : readers)
+        {
+            t.join();
+        }
+        // A concurrent lookup disagreed with the tree, return false
+        if(!agreed)
+        {
+            return false;
+        }
+        for(ShipId id = MINID - 1; id <= MAXID + 1; id++)
+        {
+            // The layout disagrees with the tree, return false
+            if(fleet.findShip(id) != (fleet.findNode(id) != nullptr))
+            {
+                return false;
+            }
+        }
+        for(int i = round; i < size; i += 2)
+        {
+            fleet.remove(ids[i]);
+        }
+    }
+    // Every lookup agreed, return true
+    return true;
+}
+
+// Name:    Tester::findManyTest
+// Desc:    Makes sure that findMany agrees with findShip, through the tree and through the search layout
+// Precon:  size denotes the size of the passed array
+// Postcon: If every batched search agrees with findShip, returns true
+//          Else returns false
+bool Tester::findManyTest(Fleet& fleet, ShipId ids[], int size)
+{
+    bool found[size];
+    for(int layout = 0; layout < 2; layout++)
+    {
+        fleet.setSearchLayout(layout == 1);
+        // Search twice so that the layout is rebuilt for the second search
+        for(int repeat = 0; repeat < 2; repeat++)
+        {
+            int numFound = fleet.findMany(ids, size, found);
+            for(int i = 0; i < size; i++)
+            {
+                // A batched search disagrees with findShip, return false
+                if(found[i] != fleet.findShip(ids[i]))
+                {
+                    return false;
+                }
+                numFound -= found[i];
+            }
+            // The returned count is wrong, return false
+            if(numFound != 0)
+            {
+                return false;
+            }
+        }
+    }
+    // Every search agreed, return true
+    return true;
+}
+
+// Name:    Tester::cacheTest
+// Desc:    Makes sure that lookups through the cache agree with the tree, and that the cache never
+//          points to a Ship that was removed or now holds another id
+// Precon:  ids contains size ids in the Fleet
+// Postcon: If the cache stays correct, returns true
+//          Else returns false
+bool Tester::cacheTest(Fleet& fleet, ShipId ids[], int size)
+{
+    fleet.setCache(true);
+    // Hammer a few hot ids, which should mostly hit
+    long long lookups = 0;
+    for(int round = 0; round < 50; round++)
+    {
+        for(int i = 0; i < min(size, 8); i++, lookups++)
+        {
+            if(!fleet.findShip(ids[i]))
+            {
+                return false;
+            }
+        }
+    }
+    if(fleet.getCacheHits() + fleet.getCacheMisses() != lookups
+        || (size > 0 && fleet.getCacheHits() == 0))
+    {
+        return false;
+    }
+    // Remove half of the Ships, caching every id first so that removals have stale entries to drop
+    for(int i = 0; i < size; i += 2)
+    {
+        for(int j = 0; j < size; j++)
+        {
+            fleet.findShip(ids[j]);
+        }
+        fleet.remove(ids[i]);
+        if(fleet.findShip(ids[i])
+            || cacheStale(fleet))
+        {
+            return false;
+        }
+    }
+    // Empty slots hold DEFAULT_ID, looking it up must not find whatever the slot last held
+    if(fleet.findShip(DEFAULT_ID)
+        || fleet.find(DEFAULT_ID) != nullptr)
+    {
+        return false;
+    }
+    // setState through the cache should change the Ship in the tree
+    for(int i = 1; i < size; i += 2)
+    {
+        if(!fleet.setState(ids[i], LOST)
+            || fleet.findNode(ids[i])->m_state != LOST)
+        {
+            return false;
+        }
+    }
+    // Lazy removal, then bulk removal and clear
+    fleet.setLazyRemove(true);
+    for(int i = 1; i < size; i += 4)
+    {
+        fleet.remove(ids[i]);
+        if(fleet.findShip(ids[i])
+            || cacheStale(fleet))
+        {
+            return false;
+        }
+    }
+    fleet.removeLost();
+    if(cacheStale(fleet))
+    {
+        return false;
+    }
+    fleet.clear();
+    for(int i = 0; i < size; i++)
+    {
+        if(fleet.findShip(ids[i]))
+        {
+            return false;
+        }
+    }
+    // The cache stayed correct, return true
+    return true;
+}
+
+// Name:    Tester::memoryTest
+// Desc:    Makes sure that memoryUsage accounts for every Ship, lazily removed Ship and the search layout,
+//          and that the allocation counters see every Ship allocated and deallocated
+// Precon:  ids contains size ids in the Fleet
+// Postcon: If the accounting is correct, returns true
+//          Else returns false
+bool Tester::memoryTest(Fleet& fleet, ShipId ids[], int size)
+{
+    // A Ship is at most 16 bytes of id, packed fields and heartbeat timer, then its children,
+    // and only builds that ask for them pay for subtree hashes and threaded links
+    if(sizeof(Ship) > 16 + 2 * sizeof(Ship*) + (SUBTREE_HASHES ? sizeof(uint64_t) : 0) + (THREADED_LINKS ? 2 * sizeof(Ship*) : 0))
+    {
+        return false;
+    }
+    MemoryUsage usage = fleet.memoryUsage();
+    if(usage.nodes != size * (long long) sizeof(Ship)
+        || usage.overhead < 0
+        || usage.indexes < (long long) sizeof(Fleet)
+        || usage.total() != usage.nodes + usage.overhead + usage.indexes + usage.fragmentation)
+    {
+        return false;
+    }
+    // Lazily removed Ships move from nodes to fragmentation
+    AllocationStats before = Ship::getAllocationStats();
+    fleet.setLazyRemove(true, 1);
+    for(int i = 0; i < size; i += 2)
+    {
+        fleet.remove(ids[i]);
+    }
+    MemoryUsage lazy = fleet.memoryUsage();
+    if(lazy.nodes != fleet.getSize() * (long long) sizeof(Ship)
+        || lazy.fragmentation < usage.fragmentation + (size + 1) / 2 * (long long) sizeof(Ship)
+        || Ship::getAllocationStats().deallocations != before.deallocations)
+    {
+        return false;
+    }
+    // Compacting deallocates them, and inserting allocates one Ship each
+    fleet.compact();
+    AllocationStats after = Ship::getAllocationStats();
+    if(after.deallocations - before.deallocations != (size + 1) / 2
+        || after.liveBytes != before.liveBytes - (size + 1) / 2 * (long long) sizeof(Ship))
+    {
+        return false;
+    }
+    for(int i = 0; i < size; i += 2)
+    {
+        fleet.insert(Ship(ids[i]));
+    }
+    if(Ship::getAllocationStats().allocations - after.allocations != (size + 1) / 2)
+    {
+        return false;
+    }
+    // The search layout counts as an index once it is built, and is released when turned off
+    fleet.setSearchLayout(true);
+    fleet.rebuildLayout();
+    if(fleet.memoryUsage().indexes < (long long) sizeof(Fleet) + size * (long long) (sizeof(ShipId) + sizeof(Ship*)))
+    {
+        return false;
+    }
+    fleet.setSearchLayout(false);
+    // The accounting is correct, return true
+    return fleet.memoryUsage().indexes == (long long) sizeof(Fleet);
+}
+
+// Name:    Tester::placementTest
+// Desc:    Moves the Fleet's Ships into the passed storage, then makes sure that every operation that
+//          allocates or deallocates Ships still works there, and that the Ships can be moved back to the heap
+// Precon:  ids contains size ids in the Fleet
+// Postcon: If the Fleet works the same in the passed storage, returns true
+//          Else returns false
+bool Tester::placementTest(Fleet& fleet, ShipId ids[], int size, PLACEMENT placement, NUMA_POLICY numa, int node)
+{
+    fleet.setPlacement(placement, numa, node);
+    if(fleet.getPlacement() != placement
+        || !fleet.validate().empty()
+        || fleet.getSize() != size
+        || (size > 0 && fleet.memoryUsage().overhead != 0))
+    {
+        return false;
+    }
+    // Remove and insert every other Ship, so that inserts reuse freed Ships
+    for(int i = 0; i < size; i += 2)
+    {
+        fleet.remove(ids[i]);
+    }
+    for(int i = 0; i < size; i += 2)
+    {
+        fleet.insertNear(Ship(ids[i], CARGO, (i % 4 == 0 ? LOST : ALIVE)));
+    }
+    if(!findShipTest(fleet, ids, size, true))
+    {
+        return false;
+    }
+    // Bulk deallocation, then bulk allocation
+    fleet.removeLost();
+    vector<Ship> ships(ids, ids + size);
+    fleet.build(ships.data(), size);
+    if(!fleet.validate().empty()
+        || !findShipTest(fleet, ids, size, true))
+    {
+        return false;
+    }
+    // Move back to the heap
+    fleet.setPlacement(HEAP);
+    return fleet.getPlacement() == HEAP
+        && fleet.validate().empty()
+        && findShipTest(fleet, ids, size, true);
+}
+
+// Name:    Tester::sharedTest
+// Desc:    Publishes the Fleet to shared memory, then makes sure a reader mapping of it finds every Ship,
+//          scans them in order, sees states changed in place and sees the next publish
+// Precon:  ids contains size ids in the Fleet
+// Postcon: If the reader sees the same Ships as the Fleet, returns true
+//          Else returns false
+bool Tester::sharedTest(Fleet& fleet, ShipId ids[], int size)
+{
+    const string name = "/fleet-test-" + to_string(getpid());
+    SharedFleet writer(name, size);
+    SharedFleet reader(name);
+    if(!writer.isOpen()
+        || !reader.isOpen()
+        || reader.publish(fleet)
+        || !writer.publish(fleet)
+        || reader.getSize() != size
+        || reader.getVersion() != 1)
+    {
+        return false;
+    }
+    for(int i = 0; i < size; i++)
+    {
+        STATE state;
+        if(!reader.getState(ids[i], state)
+            || state != fleet.find(ids[i])->m_state)
+        {
+            return false;
+        }
+    }
+    if(reader.findShip(MINID - 1)
+        || reader.findShip(MAXID + 1))
+    {
+        return false;
+    }
+    // The scan must see every id in order
+    vector<ShipId> sorted(ids, ids + size);
+    sort(sorted.begin(), sorted.end());
+    vector<ShipId> scanned;
+    if(!reader.forEach([&scanned](ShipId id, SHIPTYPE, STATE) {scanned.push_back(id);})
+        || scanned != sorted)
+    {
+        return false;
+    }
+    // Changes in place are seen at once, and a publish replaces the snapshot
+    if(size > 0)
+    {
+        STATE state;
+        if(!writer.setState(ids[0], LOST)
+            || !reader.getState(ids[0], state)
+            || state != LOST)
+        {
+            return false;
+        }
+        // A scan is only whole if the writer leaves its slot alone, so a change in place
+        // or two publishes tear it, while one publish fills the other slot and doesn't
+        for(int change = 0; change < 3; change++)
+        {
+            bool changed = false;
+            const bool whole = reader.forEach([&](ShipId, SHIPTYPE, STATE)
+            {
+                if(!changed)
+                {
+                    changed = true;
+                    if(change == 0)
+                    {
+                        writer.setState(ids[0], ALIVE);
+                    }
+                    for(int i = 0; i < change; i++)
+                    {
+                        writer.publish(fleet);
+                    }
+                }
+            });
+            if(whole != (change == 1))
+            {
+                return false;
+            }
+        }
+        fleet.remove(ids[0]);
+    }
+    const uint64_t version = reader.getVersion();
+    if(writer.setState(MAXID + 1, LOST)
+        || !writer.publish(fleet)
+        || reader.getVersion() != version + 1
+        || reader.getSize() != fleet.getSize()
+        || (size > 0 && reader.findShip(ids[0])))
+    {
+        return false;
+    }
+    // A Fleet larger than the region is refused and the snapshot is kept
+    // The ids are random, so insert until the Fleet outgrows the region instead of assuming which ids are missing
+    Fleet larger = copyFleet(fleet);
+    for(ShipId id = MAXID; larger.getSize() <= size; id--)
+    {
+        larger.insert(Ship(id));
+    }
+    return !writer.publish(larger)
+        && reader.getVersion() == version + 1;
+}
+
+// Name:    Tester::sharedPublishTest
+// Desc:    Alternately publishes a Fleet of even ids and a Fleet of odd ids from one thread
+//          while another thread scans the snapshot, to make sure no whole scan mixes the two
+// Precon:  size must be positive
+// Postcon: If every scan that reports a whole snapshot saw only one of the Fleets, returns true
+//          Else returns false
+bool Tester::sharedPublishTest(int size, int publishes)
+{
+    const string name = "/fleet-test-publish-" + to_string(getpid());
+    SharedFleet writer(name, size);
+    SharedFleet reader(name);
+    if(!writer.isOpen()
+        || !reader.isOpen())
+    {
+        return false;
+    }
+    Fleet fleets[2];
+    for(int i = 0; i < size; i++)
+    {
+        fleets[0].insert(Ship(MINID + 2 * i));
+        fleets[1].insert(Ship(MINID + 2 * i + 1));
+    }
+    writer.publish(fleets[0]);
+    atomic<bool> done(false);
+    thread publisher([&]()
+    {
+        for(int i = 1; i <= publishes; i++)
+        {
+            writer.publish(fleets[i % 2]);
+        }
+        done = true;
+    });
+    bool consistent = true;
+    int wholeScans = 0;
+    while(!done
+        || wholeScans == 0)
+    {
+        int count = 0;
+        int parity[2] = {0, 0};
+        ShipId last = MINID - 1;
+        bool sorted = true;
+        bool whole = reader.forEach([&](ShipId id, SHIPTYPE, STATE)
+        {
+            parity[(id - MINID) % 2]++;
+            sorted = sorted && id > last;
+            last = id;
+            count++;
+        });
+        if(whole)
+        {
+            wholeScans++;
+            consistent = consistent && sorted && count == size && (parity[0] == 0 || parity[1] == 0);
+        }
+    }
+    publisher.join();
+    return consistent
+        && reader.getVersion() == (uint64_t) publishes + 1;
+}
+
+// Name:    Tester::replicaTest
+// Desc:    Starts a replica from a snapshot of the Fleet, then makes every kind of change to the Fleet
+//          and applies its change stream to the replica in small batches, checking that they match
+//          Also makes sure repeated changes are skipped and a missing change stops the replica
+// Precon:  ids contains size ids in the Fleet
+// Postcon: If the replica ends up the same as the Fleet, returns true
+//          Else returns false
+bool Tester::replicaTest(Fleet& fleet, ShipId ids[], int size)
+{
+    // The replica's tree may be shaped differently, so compare the Ships listed in order
+    auto sameShips = [](const Fleet& lhs, const Fleet& rhs)
+    {
+        ostringstream left, right;
+        lhs.listShips(left);
+        rhs.listShips(right);
+        return left.str() == right.str();
+    };
+    fleet.setChangeStream(true);
+    vector<Change> changes;
+    Fleet replica;
+    const uint64_t start = fleet.snapshot(changes);
+    replica.restore(changes.data(), changes.size(), start);
+    if((int) changes.size() != size
+        || replica.getSequence() != start
+        || !sameShips(fleet, replica))
+    {
+        return false;
+    }
+    // Make every kind of change, with lazy removal on for part of it
+    for(int i = 0; i < size; i += 3)
+    {
+        fleet.setState(ids[i], LOST);
+    }
+    for(int i = 1; i < size; i += 5)
+    {
+        fleet.remove(ids[i]);
+    }
+    fleet.setLazyRemove(true);
+    for(int i = 2; i < size; i += 5)
+    {
+        fleet.remove(ids[i]);
+    }
+    if(size > 2)
+    {
+        fleet.insert(Ship(ids[2], TELESCOPE, ALIVE));
+    }
+    fleet.setLazyRemove(false);
+    fleet.removeLost();
+    fleet.insertNear(Ship(MINID, ROBOCARRIER, LOST));
+    fleet.setStateNear(MINID, ALIVE);
+    fleet.setState(fleet.find(MINID), LOST);
+    STATE states[2] = {ALIVE, LOST};
+    ShipId setIds[2] = {MINID, MAXID};
+    bool results[2];
+    fleet.setStates(setIds, states, 2, results);
+    // A failed change isn't recorded
+    const uint64_t before = fleet.getSequence();
+    fleet.insert(Ship(MINID));
+    fleet.remove(MAXID + 1);
+    fleet.setState(MAXID + 1, LOST);
+    if(fleet.getSequence() != before)
+    {
+        return false;
+    }
+    // Apply in batches of 7, repeating the previous batch's last change
+    changes.clear();
+    fleet.takeChanges(changes);
+    for(int i = 0; i < (int) changes.size(); i += 7)
+    {
+        const int begin = max(0, i - 1);
+        const int count = min((int) changes.size(), i + 7) - begin;
+        if(replica.applyChanges(changes.data() + begin, count) != count)
+        {
+            return false;
+        }
+    }
+    if(replica.getSequence() != fleet.getSequence()
+        || !sameShips(fleet, replica)
+        || !replica.validate().empty())
+    {
+        return false;
+    }
+    // A rebuild is streamed as a clear and its insertions, and a replica missing a change stops before it
+    vector<Ship> ships(ids, ids + size);
+    fleet.build(ships.data(), size);
+    changes.clear();
+    fleet.takeChanges(changes);
+    if((int) changes.size() != size + 1
+        || changes[0].kind != CLEARED
+        || replica.applyChanges(changes.data() + 1, changes.size() - 1) != 0)
+    {
+        return false;
+    }
+    return replica.applyChanges(changes.data(), changes.size()) == (int) changes.size()
+        && sameShips(fleet, replica);
+}
+
+// Name:    Tester::hashTest
+// Desc:    Builds a second Fleet with the same Ships but a different shape, makes sure both hash the same,
+//          then changes some Ships in the first and makes sure diff finds exactly those, with and without hashing
+// Precon:  ids contains size ids in the Fleet
+// Postcon: If the hashes and diffs are right, returns true
+//          Else returns false
+bool Tester::hashTest(Fleet& fleet, ShipId ids[], int size)
+{
+    const uint64_t unhashed = fleet.getHash();
+    fleet.setHashing(true);
+    Fleet other;
+    other.setHashing(true);
+    // Hashing only turns on in builds whose Ships have room for subtree hashes, the rest must work either way
+    if(fleet.getHashing() != SUBTREE_HASHES)
+    {
+        return false;
+    }
+    vector<Ship> ships;
+    for(int i = 0; i < size; i++)
+    {
+        const Ship* ship = fleet.find(ids[i]);
+        ships.push_back(Ship(ship->m_id, ship->m_type, ship->m_state));
+    }
+    other.build(ships.data(), size);
+    vector<ShipId> found;
+    if(fleet.getHash() != unhashed
+        || !fleet.sameShips(other)
+        || fleet.diff(other, found) != 0)
+    {
+        return false;
+    }
+    // Change Ships through each kind of change, remembering which ids now differ
+    vector<ShipId> changed;
+    fleet.setLazyRemove(true, 1);
+    for(int i = 0; i < size; i += 37)
+    {
+        changed.push_back(ids[i]);
+        if(i % 3 == 0)
+        {
+            fleet.remove(ids[i]);
+        }
+        else if(i % 3 == 1)
+        {
+            fleet.setState(ids[i], (ships[i].m_state == LOST ? ALIVE : LOST));
+        }
+        else
+        {
+            fleet.setLazyRemove(false);
+            fleet.remove(ids[i]);
+            fleet.insertNear(Ship(ids[i], static_cast<SHIPTYPE>((ships[i].m_type + 1) % 5), ships[i].m_state));
+            fleet.setLazyRemove(true, 1);
+        }
+    }
+    if(!inArray(MINID, ids, size))
+    {
+        fleet.insert(Ship(MINID));
+        changed.push_back(MINID);
+    }
+    sort(changed.begin(), changed.end());
+    // The same ids must be found with both Fleets hashing, and by walking them when one isn't
+    vector<ShipId> walked;
+    fleet.diff(other, found);
+    other.setHashing(false);
+    other.diff(fleet, walked);
+    return found == changed
+        && walked == changed
+        && fleet.validate().empty()
+        && (size == 0 || !fleet.sameShips(other));
+}
+
+// Name:    Tester::threadTest
+// Desc:    Steps through the Fleet with successor and predecessor, unthreaded and then threaded,
+//          through insertions, lazy and eager removals, compaction, removeLost and a change of placement
+// Precon:  ids contains size ids in the Fleet
+// Postcon: If every step lands on the next Ship and the list stays valid, returns true
+//          Else returns false
+bool Tester::threadTest(Fleet& fleet, ShipId ids[], int size)
+{
+    set<ShipId> expected(ids, ids + size);
+    // Walk forwards from first and backwards from last, both must give exactly the expected ids
+    auto walks = [&]()
+    {
+        vector<ShipId> forwards;
+        vector<ShipId> backwards;
+        for(const Ship* ship = fleet.first(); ship != nullptr && forwards.size() <= expected.size(); ship = fleet.successor(ship))
+        {
+            forwards.push_back(ship->m_id);
+        }
+        for(const Ship* ship = fleet.last(); ship != nullptr && backwards.size() <= expected.size(); ship = fleet.predecessor(ship))
+        {
+            backwards.push_back(ship->m_id);
+        }
+        return forwards == vector<ShipId>(expected.begin(), expected.end())
+            && backwards == vector<ShipId>(expected.rbegin(), expected.rend())
+            && fleet.validate().empty();
+    };
+    ostringstream unthreaded, threaded;
+    fleet.listShips(unthreaded);
+    if(!walks())
+    {
+        return false;
+    }
+    fleet.setThreading(true);
+    fleet.listShips(threaded);
+    // Threading only turns on in builds whose Ships have room for the links, the rest must work either way
+    if(fleet.getThreading() != THREADED_LINKS
+        || !walks()
+        || threaded.str() != unthreaded.str())
+    {
+        return false;
+    }
+    // Insert new ids at both ends and in between, from the root and along the finger
+    for(ShipId id = MINID, count = 0; id <= MAXID && count < 40; id += 2311)
+    {
+        if(expected.count(id) == 0)
+        {
+            if(count++ % 2 == 0)
+            {
+                fleet.insert(Ship(id));
+            }
+            else
+            {
+                fleet.insertNear(Ship(id));
+            }
+            expected.insert(id);
+        }
+    }
+    if(expected.count(MAXID) == 0)
+    {
+        fleet.insertNear(Ship(MAXID, CARGO, LOST));
+        expected.insert(MAXID);
+    }
+    if(!walks())
+    {
+        return false;
+    }
+    // Remove lazily, then eagerly, which compacts the lazily removed Ships away
+    vector<ShipId> present(expected.begin(), expected.end());
+    fleet.setLazyRemove(true, 1);
+    for(int i = 0; i < (int) present.size(); i += 3)
+    {
+        fleet.remove(present[i]);
+        expected.erase(present[i]);
+    }
+    if(!walks())
+    {
+        return false;
+    }
+    fleet.setLazyRemove(false);
+    for(int i = 1; i < (int) present.size(); i += 7)
+    {
+        fleet.remove(present[i]);
+        expected.erase(present[i]);
+    }
+    if(!walks())
+    {
+        return false;
+    }
+    // removeLost and a move to slabs both relink the whole tree
+    fleet.removeLost();
+    for(auto it = expected.begin(); it != expected.end(); )
+    {
+        it = (fleet.findNode(*it) == nullptr ? expected.erase(it) : next(it));
+    }
+    fleet.setPlacement(SLABS);
+    return walks()
+        && (expected.empty() || (fleet.first()->m_id == *expected.begin() && fleet.last()->m_id == *expected.rbegin()));
+}
+
+// Name:    Tester::exportTest
+// Desc:    Makes sure that listShips and exportShips write every Ship, in order, in each format
+// Precon:  ids must contain all ids in the Fleet
+//          size denotes the size of the passed array
+// Postcon: If every format is written correctly, returns true
+//          Else returns false
+bool Tester::exportTest(Fleet& fleet, ShipId ids[], int size)
+{
+    vector<ShipId> sorted(ids, ids + size);
+    sort(sorted.begin(), sorted.end());
+    // Build the expected text and JSON lines from the sorted ids
+    ostringstream text, json;
+    for(int i = 0; i < size; i++)
+    {
+        Ship* ship = fleet.findNode(sorted[i]);
+        text << ship->m_id << ':' << ship->getStateStr() << ':' << ship->getTypeStr() << '\n';
+        json << "{\"id\":" << ship->m_id << ",\"state\":\"" << ship->getStateStr()
+             << "\",\"type\":\"" << ship->getTypeStr() << "\"}\n";
+    }
+    ostringstream listed, exportedJson, exportedBinary;
+    fleet.listShips(listed);
+    fleet.exportShips(exportedJson, JSONLINES);
+    fleet.exportShips(exportedBinary, BINARY);
+    // The text formats differ, return false
+    if(listed.str() != text.str()
+        || exportedJson.str() != json.str())
+    {
+        return false;
+    }
+    // Check the binary header, then each Ship, whose id is 8 bytes wide in wide builds
+    string binary = exportedBinary.str();
+    const size_t record = sizeof(ShipId) + 2;
+    int count;
+    memcpy(&count, binary.data() + 4, sizeof(count));
+    if(binary.size() != 8 + record * size
+        || binary.compare(0, 4, (sizeof(ShipId) == 8 ? "FLT8" : "FLT1")) != 0
+        || count != size)
+    {
+        return false;
+    }
+    for(int i = 0; i < size; i++)
+    {
+        ShipId id;
+        memcpy(&id, binary.data() + 8 + record * i, sizeof(id));
+        Ship* ship = fleet.findNode(sorted[i]);
+        if(id != sorted[i]
+            || binary[8 + record * i + sizeof(ShipId)] != ship->m_type
+            || binary[9 + record * i + sizeof(ShipId)] != ship->m_state)
+        {
+            return false;
+        }
+    }
+    // Every format was correct, return true
+    return true;
+}
+
+// Name:    Tester::archiveTest
+// Desc:    Makes sure that loadArchive reads back exactly what writeArchive wrote, with any block size,
+//          into Fleets with any placement, and for any range of ids, and that broken archives are refused
+// Precon:  ids contains size ids in the Fleet
+// Postcon: If every archive loads back the Ships it should, returns true
+//          Else returns false
+bool Tester::archiveTest(Fleet& fleet, ShipId ids[], int size)
+{
+    ostringstream expected;
+    fleet.exportShips(expected, BINARY);
+    ostringstream archive;
+    fleet.writeArchive(archive);
+    // The archive should be much smaller than the binary export
+    if(size > 0
+        && archive.str().size() * 2 > expected.str().size())
+    {
+        return false;
+    }
+    for(int blockSize : {1, 7, ARCHIVE_BLOCK})
+    {
+        for(PLACEMENT placement : {HEAP, SLABS})
+        {
+            ostringstream blocks;
+            fleet.writeArchive(blocks, blockSize);
+            Fleet loaded;
+            loaded.setPlacement(placement);
+            loaded.setThreading(true);
+            loaded.setHashing(true);
+            loaded.insert(Ship(MINID));
+            istringstream in(blocks.str());
+            ostringstream actual;
+            if(!loaded.loadArchive(in))
+            {
+                return false;
+            }
+            loaded.exportShips(actual, BINARY);
+            if(actual.str() != expected.str()
+                || !loaded.validate().empty()
+                || !loaded.sameShips(fleet))
+            {
+                return false;
+            }
+        }
+    }
+    // Load ranges of ids, a block of 7 at a time so that the ranges start and end inside blocks
+    vector<ShipId> sorted(ids, ids + size);
+    sort(sorted.begin(), sorted.end());
+    ostringstream blocks;
+    fleet.writeArchive(blocks, 7);
+    for(int i = 0; i < size; i += max(1, size / 10))
+    {
+        const ShipId low = sorted[i];
+        const ShipId high = sorted[min(size - 1, i + 20)] + (i % 2);
+        Fleet loaded;
+        istringstream in(blocks.str());
+        if(!loaded.loadArchive(in, low, high)
+            || !loaded.validate().empty()
+            || loaded.getSize() != (int) (upper_bound(sorted.begin(), sorted.end(), high) - lower_bound(sorted.begin(), sorted.end(), low)))
+        {
+            return false;
+        }
+        for(ShipId id = low; id <= high; id++)
+        {
+            if(loaded.findShip(id) != fleet.findShip(id))
+            {
+                return false;
+            }
+        }
+    }
+    // Wrong magic, and the archive cut short anywhere, must be refused and leave the Fleet empty
+    string broken = archive.str();
+    broken[0] = 'X';
+    for(int length : {(int) broken.size(), 3, 20, (int) archive.str().size() - 1})
+    {
+        Fleet loaded;
+        loaded.insert(Ship(MINID));
+        istringstream in(length == (int) broken.size() ? broken : archive.str().substr(0, max(0, length)));
+        if(loaded.loadArchive(in)
+            || loaded.getSize() != 0
+            || !loaded.validate().empty())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Name:    Tester::traceTest
+// Desc:    Traces a mix of every kind of traced call, then makes sure that the trace reads back as the
+//          Ships the Fleet started with and the calls made, in order, and that replaying them ends with the same Ships
+// Precon:  ids contains size ids in the Fleet
+// Postcon: If the trace holds exactly what was done, returns true
+//          Else returns false
+bool Tester::traceTest(Fleet& fleet, ShipId ids[], int size)
+{
+    ostringstream before;
+    fleet.exportShips(before, BINARY);
+    stringstream trace;
+    fleet.setTrace(&trace);
+    if(!fleet.getTracing())
+    {
+        return false;
+    }
+    // Each call made, as the op, id and near flag it should be traced as
+    vector<TraceRecord> expected;
+    auto expect = [&](TRACE_OP op, ShipId id, bool near)
+    {
+        expected.push_back({0, id, op, CARGO, ALIVE, near});
+    };
+    for(int i = 0; i < size; i += 5)
+    {
+        fleet.findShip(ids[i]);
+        expect(TRACE_FIND, ids[i], false);
+        fleet.setState(ids[i], LOST);
+        expect(TRACE_SET_STATE, ids[i], false);
+        fleet.findShipNear(ids[i] + 1);
+        expect(TRACE_FIND, ids[i] + 1, true);
+    }
+    for(int i = 1; i < size; i += 7)
+    {
+        fleet.remove(ids[i]);
+        expect(TRACE_REMOVE, ids[i], false);
+        fleet.setState(fleet.find(ids[i + 1 < size ? i + 1 : 0]), LOST);
+        expect(TRACE_FIND, ids[i + 1 < size ? i + 1 : 0], false);
+        expect(TRACE_SET_STATE, ids[i + 1 < size ? i + 1 : 0], false);
+    }
+    // Ids out of range both ways, and new ids through insert and insertNear
+    for(ShipId id : {MINID - 1, MAXID + 1, MINID, MAXID})
+    {
+        fleet.insert(Ship(id, TELESCOPE, LOST));
+        expect(TRACE_INSERT, id, false);
+        fleet.insertNear(Ship(id + 1, ROBOCARRIER, ALIVE));
+        expect(TRACE_INSERT, id + 1, true);
+        fleet.setStateNear(id, ALIVE);
+        expect(TRACE_SET_STATE, id, true);
+    }
+    const ShipId batch[3] = {MINID, MINID + 1, MAXID};
+    const STATE states[3] = {LOST, ALIVE, LOST};
+    bool results[3];
+    fleet.findMany(batch, 3, results);
+    fleet.setStates(batch, states, 3, results);
+    for(int pass = 0; pass < 2; pass++)
+    {
+        for(ShipId id : batch)
+        {
+            expect(pass == 0 ? TRACE_FIND : TRACE_SET_STATE, id, false);
+        }
+    }
+    fleet.removeLost();
+    expect(TRACE_REMOVE_LOST, DEFAULT_ID, false);
+    fleet.setTrace(nullptr);
+    // Untraced once tracing stops
+    fleet.findShip(MINID);
+    Fleet replayed;
+    vector<TraceRecord> records;
+    ostringstream start, after, end;
+    if(fleet.getTracing()
+        || !Fleet::readTrace(trace, replayed, records)
+        || records.size() != expected.size())
+    {
+        return false;
+    }
+    replayed.exportShips(start, BINARY);
+    // insertNear calls that fall back on insert are traced by insert, so inserts may or may not be near
+    for(int i = 0; i < (int) records.size(); i++)
+    {
+        if(records[i].op != expected[i].op
+            || records[i].id != expected[i].id
+            || (records[i].near != expected[i].near && records[i].op != TRACE_INSERT)
+            || (i > 0 && records[i].nanos < records[i - 1].nanos))
+        {
+            return false;
+        }
+        replayed.replay(records[i]);
+    }
+    fleet.exportShips(after, BINARY);
+    replayed.exportShips(end, BINARY);
+    if(start.str() != before.str()
+        || end.str() != after.str()
+        || !replayed.validate().empty())
+    {
+        return false;
+    }
+    // A trace cut short reads back the calls before the cut
+    const string whole = trace.str();
+    istringstream cut(whole.substr(0, whole.size() - 1));
+    Fleet partial;
+    return !Fleet::readTrace(cut, partial, records)
+        && records.size() + 1 == expected.size();
+}
+
+// Name:    Tester::heartbeatTest
+// Desc:    Sends heartbeats at staggered times and advances the wheel one tick at a time, checking that each
+//          Ship turns LOST exactly at its deadline, then that heartbeats revive Ships, that setting a Ship LOST,
+//          removing it or moving it to slabs is handled, and that expired Ships can be removed
+// Precon:  ids contains size ids in the Fleet
+// Postcon: If Ships expire exactly when they should, returns true
+//          Else returns false
+bool Tester::heartbeatTest(Fleet& fleet, ShipId ids[], int size)
+{
+    const uint64_t timeout = 10;
+    // Refused while heartbeats are off, and for ids not in the Fleet
+    if(fleet.getHeartbeats()
+        || (size > 0 && fleet.heartbeat(ids[0], 0))
+        || fleet.advance(timeout) != 0)
+    {
+        return false;
+    }
+    fleet.setHeartbeats(true, timeout);
+    if(!fleet.getHeartbeats()
+        || fleet.heartbeat(MAXID + 1, 0))
+    {
+        return false;
+    }
+    // Ship i beats at time i % 8, except every ninth Ship, which never beats and so never expires
+    int beating = 0;
+    for(int i = 0; i < size; i++)
+    {
+        fleet.setState(ids[i], ALIVE);
+        if(i % 9 != 8)
+        {
+            beating++;
+            if(!fleet.heartbeat(ids[i], i % 8))
+            {
+                return false;
+            }
+        }
+    }
+    int expired = fleet.advance(timeout - 1);
+    for(uint64_t now = timeout; now < timeout + 8 && expired >= 0; now++)
+    {
+        expired += fleet.advance(now);
+        for(int i = 0; i < size; i++)
+        {
+            const bool due = i % 9 != 8 && timeout + i % 8 <= now;
+            if(fleet.find(ids[i])->getState() != (due ? LOST : ALIVE))
+            {
+                return false;
+            }
+        }
+    }
+    if(expired != beating
+        || !fleet.validate().empty())
+    {
+        return false;
+    }
+    // Even Ships beat again, half of them through handles, and are ALIVE, but the first is then set LOST
+    // and the third removed, dropping their deadlines
+    int revived = 0;
+    for(int i = 0; i < size; i += 2)
+    {
+        if(i % 9 != 8)
+        {
+            revived++;
+            if(!(i % 4 == 0 ? fleet.heartbeat(fleet.find(ids[i]), 20) : fleet.heartbeat(ids[i], 20))
+                || fleet.find(ids[i])->getState() != ALIVE)
+            {
+                return false;
+            }
+        }
+    }
+    if(size > 2)
+    {
+        const Ship* removed = fleet.find(ids[2]);
+        fleet.setState(ids[0], LOST);
+        fleet.setLazyRemove(true, 1);
+        fleet.remove(ids[2]);
+        revived -= 2;
+        // The lazily removed Ship's handle is refused
+        if(fleet.heartbeat(removed, 20))
+        {
+            return false;
+        }
+    }
+    if(fleet.heartbeat((const Ship*) nullptr, 20))
+    {
+        return false;
+    }
+    fleet.setPlacement(SLABS);
+    const int before = fleet.getSize();
+    if(!fleet.validate().empty()
+        || fleet.advance(19 + timeout) != 0
+        || fleet.advance(uint64_t(1) << 40, true) != revived
+        || fleet.getSize() != before - revived
+        || (size > 4 && fleet.findShip(ids[4]))
+        || !fleet.validate().empty())
+    {
+        return false;
+    }
+    // A deadline far ahead, set while a nearer one keeps the wheel's time back, moves down through the levels
+    // of the wheel before it is due
+    const uint64_t far = uint64_t(1) << 50;
+    if(size > 3
+        && (!fleet.heartbeat(ids[3], uint64_t(1) << 40)
+        || !fleet.heartbeat(ids[1], far + 12345)
+        || fleet.advance(far + 12345 + timeout - 1) != 1
+        || fleet.find(ids[1])->getState() != ALIVE
+        || fleet.advance(far + 12345 + timeout) != 1
+        || fleet.find(ids[1])->getState() != LOST))
+    {
+        return false;
+    }
+    // Turning heartbeats off drops every deadline
+    if(size > 1)
+    {
+        fleet.heartbeat(ids[1], far + 12345 + timeout);
+    }
+    fleet.setHeartbeats(false, timeout);
+    return fleet.advance(far * 2) == 0
+        && fleet.validate().empty()
+        && (size <= 1 || fleet.find(ids[1])->getState() == ALIVE);
+}
+
+// Name:    Tester::denseTest
+// Desc:    Builds a DenseFleet with the Fleet's Ships and puts both through the same changes,
+//          checking after each that they hold the same Ships and write them out the same way
+// Precon:  ids contains size ids in the Fleet
+// Postcon: If the DenseFleet always matches the Fleet, returns true
 //          Else returns false
-bool Tester::removeLostTest(Fleet& fleet, int lostIds[], int size)
+bool Tester::denseTest(Fleet& fleet, ShipId ids[], int size)
 {
-    // No lost ids, no change should occur
-    if(size == 0)
+    vector<Ship> ships;
+    for(int i = 0; i < size; i++)
     {
-        Fleet copy = copyFleet(fleet);
-        fleet.removeLost();
-        // Change occured, return false
-        if(!fleetEqual(fleet, copy))
-        {
-            return false;
-        }
+        const Ship* ship = fleet.find(ids[i]);
+        ships.push_back(Ship(ship->m_id, ship->m_type, ship->m_state));
     }
-    // There are lost ids, check that all are removed
-    else
+    DenseFleet dense;
+    dense.build(ships.data(), (int) ships.size());
+    // Same Ships in the same order, the same counts and the same output in every format
+    auto matches = [&]()
     {
-        fleet.removeLost();
-        // Return false if the fleet becomes unbalanced
-        if(unbalanced(fleet))
+        vector<ShipId> order;
+        int types[5] = {0, 0, 0, 0, 0};
+        dense.forEach([&](ShipId id, SHIPTYPE type, STATE)
+        {
+            order.push_back(id);
+            types[type]++;
+        });
+        if(!is_sorted(order.begin(), order.end())
+            || (int) order.size() != fleet.getSize()
+            || dense.getSize() != fleet.getSize()
+            || dense.memoryUsage().nodes != dense.getSize())
         {
             return false;
         }
-        // Iterate through the lost ids
-        for(int i = 0; i < size; i++)
+        for(int type = CARGO; type <= ROBOCARRIER; type++)
         {
-            // Make sure none of the lost ids are in the Fleet
-            if(fleet.findShip(lostIds[i]))
+            if(dense.countType((SHIPTYPE) type) != types[type])
+            {
+                return false;
+            }
+        }
+        for(FORMAT format : {TEXT, JSONLINES, BINARY})
+        {
+            ostringstream fromFleet, fromDense;
+            fleet.exportShips(fromFleet, format);
+            dense.exportShips(fromDense, format);
+            if(fromFleet.str() != fromDense.str())
+            {
+                return false;
+            }
+        }
+        for(ShipId id : order)
+        {
+            if(!fleet.findShip(id))
             {
                 return false;
             }
         }
+        return !dense.findShip(MINID - 1)
+            && !dense.findShip(MAXID + 1);
+    };
+    if(!matches())
+    {
+        return false;
     }
-    // All lost ids were successfully removed, return true
-    return true;
+    // Mark every third Ship LOST and every fifth ALIVE, then remove the LOST ones
+    for(int i = 0; i < size; i++)
+    {
+        if(i % 3 == 0 || i % 5 == 0)
+        {
+            const STATE state = (i % 3 == 0 ? LOST : ALIVE);
+            if(dense.setState(ids[i], state) != fleet.setState(ids[i], state))
+            {
+                return false;
+            }
+        }
+    }
+    if(!matches())
+    {
+        return false;
+    }
+    fleet.removeLost();
+    dense.removeLost();
+    if(!matches())
+    {
+        return false;
+    }
+    // Remove some Ships, including ones already gone, and insert new ones at both ends of the range
+    for(int i = 0; i < size; i += 4)
+    {
+        fleet.remove(ids[i]);
+        dense.remove(ids[i]);
+    }
+    for(ShipId id : {MINID, MINID + 1, MAXID - 1, MAXID})
+    {
+        if(!fleet.findShip(id))
+        {
+            fleet.insert(Ship(id, TELESCOPE, LOST));
+            dense.insert(Ship(id, TELESCOPE, LOST));
+        }
+    }
+    if(!matches()
+        || !dense.findShip(MINID)
+        || !dense.findShip(MAXID))
+    {
+        return false;
+    }
+    // Inserting an id already there changes nothing
+    dense.insert(Ship(MAXID, CARGO, ALIVE));
+    if(!matches())
+    {
+        return false;
+    }
+    dense.clear();
+    return dense.getSize() == 0
+        && dense.countType(TELESCOPE) == 0
+        && !dense.findShip(MINID);
 }
 
-// Name:    Tester::findShipTest
-// Desc:    Makes sure that findShip successfully finds the passed Ship ids
-// Precon:  If answer is true, ids contains ids in the Fleet
-//          If answer is false, ids contains ids not in the Fleet
-//          size denotes the side of the passed array
-// Postcon: If every search matches the passed answer, returns true
+// Name:    Tester::parallelTest
+// Desc:    Makes sure that parallelForEach visits every Ship once and that parallelReduce
+//          matches a serial walk, including for a reduction that depends on order
+// Precon:  None
+// Postcon: If the parallel results match the serial ones, returns true
 //          Else returns false
-bool Tester::findShipTest(Fleet& fleet, int ids[], int size, bool answer)
+bool Tester::parallelTest(Fleet& fleet, int threads)
 {
-    // Iterate through the passed ids
-    for(int i = 0; i < size; i++)
+    fleet.setThreads(threads);
+    vector<Ship*> ships;
+    fleet.collectShips(fleet.m_root, ships);
+    // Count the types and states, and sum the ids, serially
+    array<int, 7> expectedCounts = {};
+    long long expectedSum = 0;
+    vector<ShipId> expectedIds;
+    for(Ship* ship : ships)
     {
-        // Search for each id, return false if it doesn't return the right answer
-        if(fleet.findShip(ids[i]) != answer)
-        {
-            return false;
-        }
+        expectedCounts[ship->m_type]++;
+        expectedCounts[5 + ship->m_state]++;
+        expectedSum += ship->m_id;
+        expectedIds.push_back(ship->m_id);
     }
-    // Every search was successful, return true
-    return true;
+    atomic<long long> sum(0);
+    fleet.parallelForEach([&sum](const Ship& ship) {sum += ship.getID();});
+    array<int, 7> counts = fleet.parallelReduce(array<int, 7>(),
+        [](const Ship& ship)
+        {
+            array<int, 7> count = {};
+            count[ship.getType()]++;
+            count[5 + ship.getState()]++;
+            return count;
+        },
+        [](array<int, 7> lhs, const array<int, 7>& rhs)
+        {
+            for(int i = 0; i < 7; i++)
+            {
+                lhs[i] += rhs[i];
+            }
+            return lhs;
+        });
+    // Appending ids only gives a sorted list if the values are combined in order
+    vector<ShipId> ids = fleet.parallelReduce(vector<ShipId>(),
+        [](const Ship& ship) {return vector<ShipId>(1, ship.getID());},
+        [](vector<ShipId> lhs, const vector<ShipId>& rhs)
+        {
+            lhs.insert(lhs.end(), rhs.begin(), rhs.end());
+            return lhs;
+        });
+    return sum == expectedSum
+        && counts == expectedCounts
+        && ids == expectedIds;
 }
 
 // Name:    Tester::insertTimeTest
@@ -254,22 +1861,22 @@ bool Tester::findShipTest(Fleet& fleet, int ids[], int size, bool answer)
 bool Tester::insertTimeTest(int inputSize, int numTrials, int numRepeats)
 {
     const int inputScaling = 2;
-    const double allowedVariability = .4;
+    const double allowedVariability = TIME_VARIABILITY;
     double expectedTimeScaling[numTrials - 1];
     // Fill expectedTimeScaling with the expected time scaling between trials
     for(int i = 0; i < numTrials - 1; i++)
     {
-        // Summation from (j = 1) to (j = inputSize) of log2(j)
+        // Summation from (j = 1) to (j = inputSize) of updateCost(j)
         int summationBefore = 0;
         for(int j = 1; j <= inputSize * pow(inputScaling, i); j++)
         {
-            summationBefore += log2(j);
+            summationBefore += updateCost(j);
         }
-        // Summation from (j = 1) to (j = inputSize * inputScaling) of log2(j)
+        // Summation from (j = 1) to (j = inputSize * inputScaling) of updateCost(j)
         int summationAfter = summationBefore;
         for(int j = inputSize * pow(inputScaling, i) + 1; j <= inputSize * pow(inputScaling, i + 1); j++)
         {
-            summationAfter += log2(j);
+            summationAfter += updateCost(j);
         }
         // Divide the summations in order to find the scaling
         expectedTimeScaling[i] = ((double) summationAfter) / summationBefore;
@@ -284,7 +1891,7 @@ bool Tester::insertTimeTest(int inputSize, int numTrials, int numRepeats)
         for(int j = 0; j < numRepeats; j++)
         {
             Fleet fleet;
-            int ids[inputSize];
+            ShipId ids[inputSize];
             Ship ships[inputSize];
             // Create enough Ships for inputSize insertions
             for(int k = 0; k < inputSize; k++)
@@ -319,7 +1926,7 @@ bool Tester::insertTimeTest(int inputSize, int numTrials, int numRepeats)
     {
         // Output the comparison of the trials to the user
         cout << "\n\tExpected Scaling from " << inputSize / pow(inputScaling, numTrials - i) << " to " << inputSize / pow(inputScaling, numTrials - i - 1)
-             << ": " << expectedTimeScaling[i] << " ± .4, Actual Scaling: " << timeDiff[i + 1] / timeDiff[i];
+             << ": " << expectedTimeScaling[i] << " ± " << allowedVariability << ", Actual Scaling: " << timeDiff[i + 1] / timeDiff[i];
         // Output false if the actual timeScaling between any trials wasn't within the range expectedTimeScaling ± allowedVariability
         if(timeDiff[i + 1] / timeDiff[i] > expectedTimeScaling[i] + allowedVariability
             || timeDiff[i + 1] / timeDiff[i] < expectedTimeScaling[i] - allowedVariability)
@@ -331,6 +1938,20 @@ bool Tester::insertTimeTest(int inputSize, int numTrials, int numRepeats)
     return output;
 }
 
+// Name:    Tester::updateCost
+// Desc:    Relative time an insertion or removal takes on a Fleet of size Ships, used to predict how the time tests scale
+//          FLEET_VERIFY builds validate the whole Fleet after each one, which outweighs the log2(size) walk down the tree
+// Precon:  size must be positive
+// Postcon: Returns the cost of one insertion or removal
+double Tester::updateCost(int size)
+{
+#ifdef FLEET_VERIFY
+    return size;
+#else
+    return log2(size);
+#endif
+}
+
 // Name:    Tester::removeTimeTest
 // Desc:    Makes sure that the time taken for remove scales correctly with the size of the Fleet
 // Precon:  inputSize should be a large positive number
@@ -341,22 +1962,22 @@ bool Tester::insertTimeTest(int inputSize, int numTrials, int numRepeats)
 bool Tester::removeTimeTest(int inputSize, int numTrials, int numRepeats)
 {
     const int inputScaling = 2;
-    const double allowedVariability = .4;
+    const double allowedVariability = TIME_VARIABILITY;
     double expectedTimeScaling[numTrials - 1];
     // Fill expectedTimeScaling with the expected time scaling between trials
     for(int i = 0; i < numTrials - 1; i++)
     {
-        // Summation from (j = inputSize) to (j = inputSize * inputScaling) of log2(j)
+        // Summation from (j = inputSize) to (j = inputSize * inputScaling) of updateCost(j)
         int summationBefore = 0;
         for(int j = inputSize * pow(inputScaling, i); j <= inputSize * pow(inputScaling, i) * 2; j++)
         {
-            summationBefore += log2(j);
+            summationBefore += updateCost(j);
         }
-        // Summation from (j = inputSize * inputScaling) to (j = inputSize * inputScaling ^ 2) of log2(j)
+        // Summation from (j = inputSize * inputScaling) to (j = inputSize * inputScaling ^ 2) of updateCost(j)
         int summationAfter = 0;
         for(int j = inputSize * pow(inputScaling, i + 1); j <= inputSize * pow(inputScaling, i + 1) * 2; j++)
         {
-            summationAfter += log2(j);
+            summationAfter += updateCost(j);
         }
         // Divide the summations in order to find the scaling
         expectedTimeScaling[i] = ((double) summationAfter) / summationBefore;
@@ -371,7 +1992,7 @@ bool Tester::removeTimeTest(int inputSize, int numTrials, int numRepeats)
         for(int j = 0; j < numRepeats; j++)
         {
             Fleet fleet;
-            int ids[2 * inputSize];
+            ShipId ids[2 * inputSize];
             // Create and insert enough Ships for inputSize removals
             for(int k = 0; k < 2 * inputSize; k++)
             {
@@ -405,7 +2026,7 @@ bool Tester::removeTimeTest(int inputSize, int numTrials, int numRepeats)
     {
         // Output the comparison of the trials to the user
         cout << "\n\tExpected Scaling from " << inputSize / pow(inputScaling, numTrials - i) << " to " << inputSize / pow(inputScaling, numTrials - i - 1)
-             << ": " << expectedTimeScaling[i] << " ± .4, Actual Scaling: " << timeDiff[i + 1] / timeDiff[i];
+             << ": " << expectedTimeScaling[i] << " ± " << allowedVariability << ", Actual Scaling: " << timeDiff[i + 1] / timeDiff[i];
         // Output false if the actual timeScaling between any trials wasn't within the range expectedTimeScaling ± allowedVariability
         if(timeDiff[i + 1] / timeDiff[i] > expectedTimeScaling[i] + allowedVariability
             || timeDiff[i + 1] / timeDiff[i] < expectedTimeScaling[i] - allowedVariability)
@@ -427,7 +2048,7 @@ bool Tester::removeTimeTest(int inputSize, int numTrials, int numRepeats)
 bool Tester::findShipTimeTest(int inputSize, int numTrials, int numRepeats)
 {
     const int inputScaling = 2;
-    const double allowedVariability = .4;
+    const double allowedVariability = TIME_VARIABILITY;
     double expectedTimeScaling[numTrials - 1];
     // Fill expectedTimeScaling with the expected time scaling between trials
     for(int i = 0; i < numTrials - 1; i++)
@@ -457,7 +2078,7 @@ bool Tester::findShipTimeTest(int inputSize, int numTrials, int numRepeats)
         for(int j = 0; j < numRepeats; j++)
         {
             Fleet fleet;
-            int ids[inputSize];
+            ShipId ids[inputSize];
             // Create and insert enough Ships for inputSize searches
             for(int k = 0; k < inputSize; k++)
             {
@@ -491,7 +2112,7 @@ bool Tester::findShipTimeTest(int inputSize, int numTrials, int numRepeats)
     {
         // Output the comparison of the trials to the user
         cout << "\n\tExpected Scaling from " << inputSize / pow(inputScaling, numTrials - i) << " to " << inputSize / pow(inputScaling, numTrials - i - 1)
-             << ": " << expectedTimeScaling[i] << " ± .4, Actual Scaling: " << timeDiff[i + 1] / timeDiff[i];
+             << ": " << expectedTimeScaling[i] << " ± " << allowedVariability << ", Actual Scaling: " << timeDiff[i + 1] / timeDiff[i];
         // Output false if the actual timeScaling between any trials wasn't within the range expectedTimeScaling ± allowedVariability
         if(timeDiff[i + 1] / timeDiff[i] > expectedTimeScaling[i] + allowedVariability
             || timeDiff[i + 1] / timeDiff[i] < expectedTimeScaling[i] - allowedVariability)
@@ -504,11 +2125,11 @@ bool Tester::findShipTimeTest(int inputSize, int numTrials, int numRepeats)
 }
 
 // Name:    Tester::inArray
-// Desc:    Checks whether the passed int is in the array of ints
+// Desc:    Checks whether the passed id is in the array of ids
 // Precon:  size denotes the size of the passed array
-// Postcon: If the int is found in the array, returns true
+// Postcon: If the id is found in the array, returns true
 //          Else returns false
-bool Tester::inArray(int item, int arr[], int size)
+bool Tester::inArray(ShipId item, ShipId arr[], int size)
 {
     // Iterate through the passed array
     for(int i = 0; i < size; i++)
@@ -531,6 +2152,8 @@ Fleet Tester::copyFleet(const Fleet& fleet)
 {
     Fleet copy;
     copy.m_root = copyShip(fleet.m_root);
+    copy.m_size = fleet.m_size;
+    copy.m_tombstones = fleet.m_tombstones;
     return copy;
 }
 
@@ -550,6 +2173,8 @@ Ship* Tester::copyShip(Ship* ship)
     {
         Ship* copy = new Ship(ship->m_id, ship->m_type, ship->m_state);
         copy->m_color = ship->m_color;
+        copy->m_removed = ship->m_removed;
+        copy->m_height = ship->m_height;
         copy->m_left = copyShip(ship->m_left);
         copy->m_right = copyShip(ship->m_right);
         return copy;
@@ -557,7 +2182,7 @@ Ship* Tester::copyShip(Ship* ship)
 }
 
 // Name:    Tester::unbalanced
-// Desc:    Checks if a passed Fleet is a BST and a Red-Black Tree
+// Desc:    Checks if a passed Fleet is a BST and a Red-Black Tree, or an AVL tree in AVL builds
 // Precon:  None
 // Postcon: If the Fleet is a valid Red-Black Tree, returns false
 //          Else returns true
@@ -566,11 +2191,32 @@ bool Tester::unbalanced(const Fleet& fleet)
     return recursBalanced(fleet.m_root) < 0;
 }
 
+// Name:    Tester::cacheStale
+// Desc:    Checks every entry of the Fleet's lookup cache against the tree
+// Precon:  None
+// Postcon: If an entry points to a Ship the tree wouldn't return for its id, returns true
+//          Else returns false
+bool Tester::cacheStale(const Fleet& fleet)
+{
+    for(int slot = 0; slot < CACHE_SIZE; slot++)
+    {
+        const ShipId id = fleet.m_cacheIds[slot];
+        if(id != DEFAULT_ID
+            && (fleet.findNode(id) != fleet.m_cacheShips[slot]
+                || fleet.m_cacheShips[slot]->m_id != id
+                || fleet.m_cacheShips[slot]->m_removed))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 // Name:    Tester::recursBalanced
-// Desc:    Recursively checks if each subtree is a valid Red-Black subtree
+// Desc:    Recursively checks if each subtree is a valid Red-Black subtree, or a valid AVL subtree in AVL builds
 // Precon:  None
 // Postcon: If finding imbalance, returns -1
-//          Else returns the number of BLACK Ships in path to null
+//          Else returns the number of BLACK Ships in path to null, or in AVL builds the subtree's height
 int Tester::recursBalanced(Ship* ship)
 {
     // Base case, null leaf found, return 0
@@ -578,6 +2224,27 @@ int Tester::recursBalanced(Ship* ship)
     {
         return 0;
     }
+#ifdef FLEET_AVL
+    // Check that the subtree is a balanced AVL subtree
+    else
+    {
+        int left = recursBalanced(ship->m_left), right = recursBalanced(ship->m_right);
+        // An unbalance is found, return -1
+        if(left < 0                                     // If there is an unbalance on the left
+            || right < 0                                // or an unbalance on the right
+            || abs(left - right) > 1                    // or the heights of the subtrees differ by more than 1
+            || ship->m_height != 1 + max(left, right)   // or the Ship's height is out of date
+            || (ship->m_left != nullptr                 // or the left child is greater or equal to the Ship
+            && ship->m_left->m_id >= ship->m_id)
+            || (ship->m_right != nullptr                // or the right child is less or equal to the Ship
+            && ship->m_right->m_id <= ship->m_id))
+        {
+            return -1;
+        }
+        // No unbalance, return the subtree's height
+        return 1 + max(left, right);
+    }
+#else
     // Check that the subtree is balanced
     else
     {
@@ -610,6 +2277,7 @@ int Tester::recursBalanced(Ship* ship)
             return left;
         }
     }
+#endif
 }
 
 // Name:    Tester::fleetEqual
@@ -666,7 +2334,7 @@ int main()
     // Creating a standard Fleet to be used in tests
     Fleet normal;
     const int normalSize = 500;
-    int normalIds[normalSize];
+    ShipId normalIds[normalSize];
     for(int i = 0; i < normalSize; i++)
     {
         do
@@ -680,7 +2348,7 @@ int main()
     cout << BREAK << "Testing insert(Ship&)\n" << BREAK << endl;
     {   cout << "Normal: Inserting " << normalSize << " Ships into an empty Fleet (This includes edge cases like inserting at the root)";
         Fleet copy;
-        int ids[normalSize];
+        ShipId ids[normalSize];
         Ship ships[normalSize];
         for(int i = 0; i < normalSize; i++)
         {
@@ -701,7 +2369,7 @@ int main()
     {   cout << "Edge: Inserting a BLACK Ship";
         Fleet copy = Tester::copyFleet(normal);
         Ship ships[1] = {Ship(rand() % (MAXID - MINID + 1) + MINID, static_cast<SHIPTYPE>(rand() % 5), ALIVE)};
-        ships[1].setColor(BLACK);
+        ships[0].setColor(BLACK);
         test.result(Tester::insertTest(copy, ships, 1));
     }
     {   cout << "Error: Inserting Ships with already existing ids";
@@ -722,6 +2390,46 @@ int main()
         test.result(Tester::insertTimeTest());
     }
 
+    cout << BREAK << "Testing insertNear(Ship&), findShipNear(int) and setStateNear(int, STATE)\n" << BREAK << endl;
+    {   cout << "Normal: Inserting 5000 ids in increasing order, then " << normalSize << " at random";
+        Fleet copy;
+        const int size = 5000 + normalSize;
+        ShipId ids[size];
+        for(int i = 0; i < size; i++)
+        {
+            ids[i] = (i < 5000 ? MINID + 2 * i : normalIds[i - 5000]);
+        }
+        test.result(Tester::fingerTest(copy, ids, size));
+    }
+    {   cout << "Normal: Inserting 5000 ids in decreasing order";
+        Fleet copy;
+        ShipId ids[5000];
+        for(int i = 0; i < 5000; i++)
+        {
+            ids[i] = MAXID - 3 * i;
+        }
+        test.result(Tester::fingerTest(copy, ids, 5000));
+    }
+    {   cout << "Edge: Finger searches in an empty Fleet";
+        Fleet copy;
+        test.result(Tester::fingerTest(copy, {}, 0));
+    }
+
+    cout << BREAK << "Testing build(Ship[], int)\n" << BREAK << endl;
+    {   cout << "Normal: Building a Fleet of 20000 Ships, with repeats and out of range ids, on 1 and 4 threads";
+        const int size = 20000;
+        vector<Ship> ships(size);
+        for(int i = 0; i < size; i++)
+        {
+            ships[i] = Ship(MINID - 1 + (ShipId) (rand() % ((uint64_t) MAXID - MINID + 3)), static_cast<SHIPTYPE>(rand() % 5), static_cast<STATE>(rand() % 2));
+        }
+        test.result(Tester::buildTest(ships.data(), size, 1) && Tester::buildTest(ships.data(), size, 4));
+    }
+    {   cout << "Edge: Building a Fleet of 1 Ship and of 0 Ships";
+        Ship ships[1] = {Ship(MAXID)};
+        test.result(Tester::buildTest(ships, 1, 4) && Tester::buildTest(ships, 0, 4));
+    }
+
     cout << BREAK << "Testing remove(int)\n" << BREAK << endl;
     {   cout << "Normal: Removing all Ships from a Fleet of " << normalSize << " (This includes edge cases like removing the root)";
         Fleet copy = Tester::copyFleet(normal);
@@ -729,12 +2437,12 @@ int main()
     }
     {   cout << "Error: Removing from an empty Fleet";
         Fleet copy;
-        int ids[1] = {rand() % (MAXID - MINID + 1) + MINID};
+        ShipId ids[1] = {rand() % (MAXID - MINID + 1) + MINID};
         test.result(Tester::removeTest(copy, ids, 1));
     }
     {   cout << "Error: Removing a nonexisting id";
         Fleet copy = Tester::copyFleet(normal);
-        int ids[1];
+        ShipId ids[1];
         do
         {
             ids[0] = rand() % (MAXID - MINID + 1) + MINID;
@@ -744,13 +2452,23 @@ int main()
     }
     {   cout << "Error: Removing ids below MINID and above MAXID";
         Fleet copy = Tester::copyFleet(normal);
-        int ids[2] = {MINID - 1, MAXID + 1};
+        ShipId ids[2] = {MINID - 1, MAXID + 1};
         test.result(Tester::removeTest(copy, ids, 2));
     }
     {   cout << "Testing time complexity:";
         test.result(Tester::removeTimeTest());
     }
 
+    cout << BREAK << "Testing validate()\n" << BREAK << endl;
+    {   cout << "Normal: Breaking each invariant of a Fleet of " << normalSize;
+        Fleet copy = Tester::copyFleet(normal);
+        test.result(Tester::validateTest(copy));
+    }
+    {   cout << "Edge: Validating an empty Fleet";
+        Fleet copy;
+        test.result(copy.validate().empty());
+    }
+
     cout << BREAK << "Testing setState(int, STATE)\n" << BREAK << endl;
     {   cout << "Normal: Losing a Ship in a Fleet of " << normalSize;
         Fleet copy = Tester::copyFleet(normal);
@@ -762,7 +2480,7 @@ int main()
     }
     {   cout << "Error: Losing a Ship with a nonexisting id";
         Fleet copy = Tester::copyFleet(normal);
-        int id;
+        ShipId id;
         do
         {
             id = rand() % (MAXID - MINID + 1) + MINID;
@@ -775,6 +2493,36 @@ int main()
         test.result(Tester::setStateTest(copy, MINID - 1) && Tester::setStateTest(copy, MAXID + 1));
     }
 
+    cout << BREAK << "Testing setStates(int[], STATE[], int, bool[])\n" << BREAK << endl;
+    {   cout << "Normal: Losing and reviving an unsorted batch of Ships, with repeats and nonexisting ids, in a Fleet of " << normalSize;
+        const int size = normalSize + 10;
+        ShipId ids[size];
+        STATE states[size];
+        for(int i = 0; i < size; i++)
+        {
+            ids[i] = (i < normalSize ? normalIds[i] : (i % 2 == 0 ? normalIds[i - normalSize] : MINID - 1 + (ShipId) (rand() % ((uint64_t) MAXID - MINID + 3))));
+            states[i] = static_cast<STATE>(rand() % 2);
+        }
+        test.result(Tester::setStatesTest(normal, ids, states, size));
+    }
+    {   cout << "Edge: Losing a sorted batch of Ships";
+        ShipId ids[normalSize];
+        STATE states[normalSize];
+        for(int i = 0; i < normalSize; i++)
+        {
+            ids[i] = normalIds[i];
+            states[i] = LOST;
+        }
+        sort(ids, ids + normalSize);
+        test.result(Tester::setStatesTest(normal, ids, states, normalSize));
+    }
+    {   cout << "Edge: Losing a batch of Ships in an empty Fleet";
+        Fleet empty;
+        ShipId ids[2] = {normalIds[0], normalIds[1]};
+        STATE states[2] = {LOST, LOST};
+        test.result(Tester::setStatesTest(empty, ids, states, 2));
+    }
+
     cout << BREAK << "Testing removeLost()\n" << BREAK << endl;
     {   cout << "Normal: " << normalSize / 2 << " lost Ships in a Fleet of " << normalSize;
         Fleet copy = Tester::copyFleet(normal);
@@ -792,6 +2540,24 @@ int main()
         }
         test.result(Tester::removeLostTest(copy, normalIds, normalSize));
     }
+    {   cout << "Normal: Half of the Ships lost in a Fleet of 20000, removed on 4 threads";
+        const int size = 20000;
+        vector<Ship> ships(size);
+        vector<ShipId> lostIds;
+        for(int i = 0; i < size; i++)
+        {
+            ships[i] = Ship(MINID + 4 * i, static_cast<SHIPTYPE>(rand() % 5), static_cast<STATE>(rand() % 2));
+            if(ships[i].getState() == LOST)
+            {
+                lostIds.push_back(ships[i].getID());
+            }
+        }
+        Fleet large;
+        large.setThreads(4);
+        large.build(ships.data(), size);
+        test.result(Tester::removeLostTest(large, lostIds.data(), lostIds.size())
+            && large.getSize() == size - (int) lostIds.size());
+    }
     {   cout << "Edge: 0 lost Ships";
         Fleet copy = Tester::copyFleet(normal);
         test.result(Tester::removeLostTest(copy, normalIds, 0));
@@ -801,6 +2567,16 @@ int main()
         test.result(Tester::removeLostTest(copy, {}, 0));
     }
 
+    cout << BREAK << "Testing setLazyRemove(bool, double)\n" << BREAK << endl;
+    {   cout << "Normal: Lazily removing and reinserting half of the Ships in a Fleet of " << normalSize;
+        Fleet copy = Tester::copyFleet(normal);
+        test.result(Tester::lazyRemoveTest(copy, normalIds, normalSize));
+    }
+    {   cout << "Edge: Lazy removal in an empty Fleet";
+        Fleet copy;
+        test.result(Tester::lazyRemoveTest(copy, {}, 0));
+    }
+
     cout << BREAK << "Testing findShip(int)\n" << BREAK << endl;
     {   cout << "Normal: Finding all Ships in a Fleet of " << normalSize;
         Fleet copy = Tester::copyFleet(normal);
@@ -808,7 +2584,7 @@ int main()
     }
     {   cout << "Normal: Finding a Ship with a nonexisting id";
         Fleet copy = Tester::copyFleet(normal);
-        int ids[1];
+        ShipId ids[1];
         do
         {
             ids[0] = rand() % (MAXID - MINID + 1) + MINID;
@@ -818,18 +2594,218 @@ int main()
     }
     {   cout << "Edge: Finding a Ship in an empty Fleet";
         Fleet copy;
-        int ids[1] = {rand() % (MAXID - MINID + 1) + MINID};
+        ShipId ids[1] = {rand() % (MAXID - MINID + 1) + MINID};
         test.result(Tester::findShipTest(copy, ids, 1, false));
     }
     {   cout << "Edge: Finding Ships whose ids are below MINID and above MAXID";
         Fleet copy = Tester::copyFleet(normal);
-        int ids[2] = {MINID - 1, MAXID + 1};
+        ShipId ids[2] = {MINID - 1, MAXID + 1};
         test.result(Tester::findShipTest(copy, ids, 2, false));
     }
     {   cout << "Testing time complexity:";
         test.result(Tester::findShipTimeTest());
     }
 
+    cout << BREAK << "Testing find(int) and setState(Ship*, STATE)\n" << BREAK << endl;
+    {   cout << "Normal: Keeping handles to the Ships of a Fleet of " << normalSize << " while removing a third of them";
+        Fleet copy = Tester::copyFleet(normal);
+        test.result(Tester::handleTest(copy, normalIds, normalSize));
+    }
+    {   cout << "Edge: Finding a nonexisting id and changing a null handle";
+        Fleet copy = Tester::copyFleet(normal);
+        test.result(copy.find(MAXID + 1) == nullptr && !copy.setState(nullptr, LOST));
+    }
+
+    cout << BREAK << "Testing setSearchLayout(bool)\n" << BREAK << endl;
+    {   cout << "Normal: Searching every id in range through the layout of a Fleet of " << normalSize << " while removing Ships";
+        Fleet copy = Tester::copyFleet(normal);
+        test.result(Tester::searchLayoutTest(copy, normalIds, normalSize));
+    }
+    {   cout << "Edge: Searching every id in range through the layout of an empty Fleet";
+        Fleet copy;
+        test.result(Tester::searchLayoutTest(copy, {}, 0));
+    }
+
+    cout << BREAK << "Testing findMany(int[], int, bool[])\n" << BREAK << endl;
+    {   cout << "Normal: Finding a mix of existing and nonexisting ids in a Fleet of " << normalSize;
+        Fleet copy = Tester::copyFleet(normal);
+        const int size = 2 * normalSize + 3;
+        ShipId ids[size];
+        for(int i = 0; i < size; i++)
+        {
+            ids[i] = (i % 2 == 0 ? normalIds[(i / 2) % normalSize] : rand() % (MAXID - MINID + 1) + MINID);
+        }
+        test.result(Tester::findManyTest(copy, ids, size));
+    }
+    {   cout << "Edge: Finding ids below MINID and above MAXID, and in an empty Fleet";
+        Fleet copy = Tester::copyFleet(normal);
+        Fleet empty;
+        ShipId ids[3] = {MINID - 1, MAXID + 1, normalIds[0]};
+        test.result(Tester::findManyTest(copy, ids, 3) && Tester::findManyTest(empty, ids, 3));
+    }
+
+    cout << BREAK << "Testing memoryUsage() and Ship::getAllocationStats()\n" << BREAK << endl;
+    {   cout << "Normal: Accounting for the memory of a Fleet of " << normalSize << " while lazily removing half of it";
+        Fleet copy = Tester::copyFleet(normal);
+        test.result(Tester::memoryTest(copy, normalIds, normalSize));
+    }
+    {   cout << "Edge: Accounting for the memory of an empty Fleet";
+        Fleet copy;
+        test.result(Tester::memoryTest(copy, {}, 0));
+    }
+
+    cout << BREAK << "Testing setPlacement(PLACEMENT, NUMA_POLICY, int)\n" << BREAK << endl;
+    {   cout << "Normal: Storing a Fleet of " << normalSize << " in slabs";
+        Fleet copy = Tester::copyFleet(normal);
+        test.result(Tester::placementTest(copy, normalIds, normalSize, SLABS, NUMA_DEFAULT));
+    }
+    {   cout << "Normal: Storing a Fleet of " << normalSize << " in huge page slabs bound to NUMA node 0";
+        Fleet copy = Tester::copyFleet(normal);
+        test.result(Tester::placementTest(copy, normalIds, normalSize, HUGE_SLABS, NUMA_BIND));
+    }
+    {   cout << "Normal: Storing a Fleet of " << normalSize << " in slabs interleaved across NUMA nodes";
+        Fleet copy = Tester::copyFleet(normal);
+        test.result(Tester::placementTest(copy, normalIds, normalSize, SLABS, NUMA_INTERLEAVE));
+    }
+    {   cout << "Edge: Storing an empty Fleet in slabs";
+        Fleet copy;
+        test.result(Tester::placementTest(copy, {}, 0, SLABS, NUMA_DEFAULT));
+    }
+    {   cout << "Error: Storing a Fleet of " << normalSize << " in slabs bound to NUMA nodes that don't exist";
+        Fleet copy = Tester::copyFleet(normal);
+        test.result(Tester::placementTest(copy, normalIds, normalSize, SLABS, NUMA_BIND, 64)
+            && Tester::placementTest(copy, normalIds, normalSize, SLABS, NUMA_BIND, 1 << 20)
+            && Tester::placementTest(copy, normalIds, normalSize, SLABS, NUMA_BIND, -1));
+    }
+
+    cout << BREAK << "Testing SharedFleet\n" << BREAK << endl;
+    {   cout << "Normal: Publishing a Fleet of " << normalSize << " to shared memory and reading it from a second mapping";
+        Fleet copy = Tester::copyFleet(normal);
+        test.result(Tester::sharedTest(copy, normalIds, normalSize));
+    }
+    {   cout << "Normal: Scanning a shared Fleet of 1000 while 2000 snapshots are published";
+        test.result(Tester::sharedPublishTest(1000, 2000));
+    }
+    {   cout << "Edge: Publishing an empty Fleet to shared memory";
+        Fleet copy;
+        test.result(Tester::sharedTest(copy, {}, 0));
+    }
+
+    cout << BREAK << "Testing the change stream and replicas\n" << BREAK << endl;
+    {   cout << "Normal: Replicating every kind of change to a Fleet of " << normalSize;
+        Fleet copy = Tester::copyFleet(normal);
+        test.result(Tester::replicaTest(copy, normalIds, normalSize));
+    }
+    {   cout << "Edge: Replicating changes to an empty Fleet";
+        Fleet copy;
+        test.result(Tester::replicaTest(copy, {}, 0));
+    }
+
+    cout << BREAK << "Testing setHashing(bool), sameShips(const Fleet&) and diff(const Fleet&, vector<ShipId>&)\n" << BREAK << endl;
+    {   cout << "Normal: Comparing a Fleet of " << normalSize << " against a rebuilt copy, before and after changing some Ships";
+        Fleet copy = Tester::copyFleet(normal);
+        test.result(Tester::hashTest(copy, normalIds, normalSize));
+    }
+    {   cout << "Edge: Comparing empty Fleets";
+        Fleet copy;
+        test.result(Tester::hashTest(copy, {}, 0));
+    }
+
+    cout << BREAK << "Testing setThreading(bool), first(), last(), successor(const Ship*) and predecessor(const Ship*)\n" << BREAK << endl;
+    {   cout << "Normal: Stepping through a Fleet of " << normalSize << " while Ships are inserted and removed";
+        Fleet copy = Tester::copyFleet(normal);
+        test.result(Tester::threadTest(copy, normalIds, normalSize));
+    }
+    {   cout << "Edge: Stepping through an empty Fleet";
+        Fleet copy;
+        test.result(Tester::threadTest(copy, {}, 0));
+    }
+
+    cout << BREAK << "Testing DenseFleet\n" << BREAK << endl;
+    {   cout << "Normal: Matching a DenseFleet against a Fleet of " << normalSize << " as Ships are changed, removed and inserted";
+        Fleet copy = Tester::copyFleet(normal);
+        test.result(Tester::denseTest(copy, normalIds, normalSize));
+    }
+    {   cout << "Edge: Matching a DenseFleet against an empty Fleet";
+        Fleet copy;
+        test.result(Tester::denseTest(copy, {}, 0));
+    }
+
+    cout << BREAK << "Testing setCache(bool)\n" << BREAK << endl;
+    {   cout << "Normal: Finding, changing and removing Ships through the cache of a Fleet of " << normalSize;
+        Fleet copy = Tester::copyFleet(normal);
+        test.result(Tester::cacheTest(copy, normalIds, normalSize));
+    }
+    {   cout << "Edge: Using the cache of an empty Fleet";
+        Fleet copy;
+        test.result(Tester::cacheTest(copy, {}, 0));
+    }
+
+    cout << BREAK << "Testing listShips(ostream&) and exportShips(ostream&, FORMAT)\n" << BREAK << endl;
+    {   cout << "Normal: Exporting a Fleet of " << normalSize << " with some Ships lost";
+        Fleet copy = Tester::copyFleet(normal);
+        for(int i = 0; i < normalSize; i += 3)
+        {
+            copy.setState(normalIds[i], LOST);
+        }
+        test.result(Tester::exportTest(copy, normalIds, normalSize));
+    }
+    {   cout << "Edge: Exporting an empty Fleet";
+        Fleet copy;
+        test.result(Tester::exportTest(copy, {}, 0));
+    }
+
+    cout << BREAK << "Testing writeArchive(ostream&, int) and loadArchive(istream&, ShipId, ShipId)\n" << BREAK << endl;
+    {   cout << "Normal: Archiving a Fleet of " << normalSize << " and loading it back whole and by ranges of ids";
+        Fleet copy = Tester::copyFleet(normal);
+        for(int i = 0; i < normalSize; i += 3)
+        {
+            copy.setState(normalIds[i], LOST);
+        }
+        test.result(Tester::archiveTest(copy, normalIds, normalSize));
+    }
+    {   cout << "Edge: Archiving an empty Fleet";
+        Fleet copy;
+        test.result(Tester::archiveTest(copy, {}, 0));
+    }
+
+    cout << BREAK << "Testing setTrace(ostream*), readTrace(istream&, Fleet&, vector<TraceRecord>&) and replay(const TraceRecord&)\n" << BREAK << endl;
+    {   cout << "Normal: Tracing calls of every kind on a Fleet of " << normalSize << " and replaying them on the Ships it started with";
+        Fleet copy = Tester::copyFleet(normal);
+        test.result(Tester::traceTest(copy, normalIds, normalSize));
+    }
+    {   cout << "Edge: Tracing calls on an empty Fleet";
+        Fleet copy;
+        test.result(Tester::traceTest(copy, {}, 0));
+    }
+
+    cout << BREAK << "Testing setHeartbeats(bool, uint64_t), heartbeat(ShipId, uint64_t), heartbeat(Ship*, uint64_t) and advance(uint64_t, bool)\n" << BREAK << endl;
+    {   cout << "Normal: Expiring the Ships of a Fleet of " << normalSize << " by their heartbeats, one tick at a time";
+        Fleet copy = Tester::copyFleet(normal);
+        test.result(Tester::heartbeatTest(copy, normalIds, normalSize));
+    }
+    {   cout << "Edge: Heartbeats on an empty Fleet";
+        Fleet copy;
+        test.result(Tester::heartbeatTest(copy, {}, 0));
+    }
+
+    cout << BREAK << "Testing parallelForEach(Function) and parallelReduce(T, Map, Combine)\n" << BREAK << endl;
+    {   cout << "Normal: Counting types and states in a Fleet of 20000 on 1 and 4 threads";
+        const int size = 20000;
+        vector<Ship> ships(size);
+        for(int i = 0; i < size; i++)
+        {
+            ships[i] = Ship(rand() % (MAXID - MINID + 1) + MINID, static_cast<SHIPTYPE>(rand() % 5), static_cast<STATE>(rand() % 2));
+        }
+        Fleet large;
+        large.build(ships.data(), size);
+        test.result(Tester::parallelTest(large, 1) && Tester::parallelTest(large, 4));
+    }
+    {   cout << "Edge: Counting types and states in an empty Fleet";
+        Fleet copy;
+        test.result(Tester::parallelTest(copy, 4));
+    }
+
     cout << BREAK << "Number of tests: " << test.getTestCount()
          << "\nNumber of tests failed: " << test.getFailCount()
          << endl << BREAK;
@@ -0,0 +1,239 @@
+/**
+ * File:    replay.cpp
+ * Project: CMSC 341 Project 2 – The Fleet of Spaceships
+ *
+ * This file contains a tool that replays traces recorded with Fleet::setTrace
+ * The trace's calls are made on a Fleet loaded with the Ships the trace started from, back to back or
+ * at the pace they were recorded, and the throughput and latency of each kind of call are reported
+ * Build with "make replay.exe", or "make replayavl.exe" to replay on the AVL build
+ * Usage:   replay.exe <trace> [paced] [layout] [cache] [slabs] [threading]
+ *              Replays a trace, optionally paced and with any of the Fleet's options turned on
+ *          replay.exe record <trace> [calls] [seed]
+ *              Records a sample trace of a read-heavy workload on a Fleet built from 50000 random Ships
+ */
+
+#include "fleet.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+const char BREAK[] = "*****************************************************************\n";
+const char* const OP_NAMES[] = {"insert", "remove", "setState", "removeLost", "findShip"};
+const int NUM_OPS = sizeof(OP_NAMES) / sizeof(OP_NAMES[0]);
+// Ships in the Fleet a sample trace starts from
+const int SAMPLE_SIZE = 50000;
+// Calls in a sample trace, unless told otherwise
+const int SAMPLE_CALLS = 2000000;
+// Paced replay sleeps while the next call is further off than this, and spins once it is closer
+const uint64_t SPIN_NANOS = 200000;
+
+// Name:    nanosNow
+// Desc:    Reads the clock calls are timed by
+// Precon:  None
+// Postcon: Returns the time in nanoseconds since an arbitrary starting point
+uint64_t nanosNow()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Name:    percentile
+// Desc:    Picks the value below which fraction of the sorted values fall
+// Precon:  values must be sorted and not empty
+// Postcon: Returns the value
+uint64_t percentile(const vector<uint64_t>& values, double fraction)
+{
+    return values[min(values.size() - 1, (size_t) (fraction * values.size()))];
+}
+
+// Name:    report
+// Desc:    Writes a row of the latency table: how many values there were, their mean, and their percentiles
+// Precon:  values must be sorted
+// Postcon: The row is written to cout
+void report(const string& name, const vector<uint64_t>& values)
+{
+    if(values.empty())
+    {
+        return;
+    }
+    uint64_t total = 0;
+    for(uint64_t value : values)
+    {
+        total += value;
+    }
+    cout << name << "\t" << values.size() << "\t" << total / values.size() << "\t" << percentile(values, .5)
+         << "\t" << percentile(values, .9) << "\t" << percentile(values, .99) << "\t" << percentile(values, .999)
+         << "\t" << values.back() << "\n";
+}
+
+// Name:    record
+// Desc:    Records a sample trace: a Fleet of SAMPLE_SIZE random Ships, then mostly lookups, some state changes,
+//          insertions and removals, and every so often a removeLost
+// Precon:  None
+// Postcon: The trace is written to path
+//          Returns 0, or 1 if path can't be written
+int record(const string& path, int calls, unsigned seed)
+{
+    ofstream out(path, ios::binary);
+    if(!out)
+    {
+        cout << "Can't write " << path << "\n";
+        return 1;
+    }
+    mt19937 gen(seed);
+    uniform_int_distribution<ShipId> ids(MINID, min<ShipId>(MAXID, MINID + 2 * SAMPLE_SIZE - 1));
+    vector<Ship> ships(SAMPLE_SIZE);
+    for(Ship& ship : ships)
+    {
+        ship = Ship(ids(gen), static_cast<SHIPTYPE>(gen() % 5), ALIVE);
+    }
+    Fleet fleet;
+    fleet.build(ships.data(), ships.size());
+    const int startSize = fleet.getSize();
+    fleet.setTrace(&out);
+    for(int i = 0; i < calls; i++)
+    {
+        const int roll = gen() % 1000;
+        const ShipId id = ids(gen);
+        if(roll < 800)
+        {
+            fleet.findShip(id);
+        }
+        else if(roll < 900)
+        {
+            fleet.setState(id, (gen() % 8 == 0 ? LOST : ALIVE));
+        }
+        else if(roll < 950)
+        {
+            fleet.insert(Ship(id, static_cast<SHIPTYPE>(gen() % 5), ALIVE));
+        }
+        else if(roll < 999)
+        {
+            fleet.remove(id);
+        }
+        else
+        {
+            fleet.removeLost();
+        }
+    }
+    fleet.setTrace(nullptr);
+    cout << "Recorded " << calls << " calls on a Fleet starting with " << startSize << " Ships to " << path << " (" << out.tellp() << " bytes)\n";
+    return 0;
+}
+
+// Name:    replay
+// Desc:    Replays a trace and reports the throughput, and the latency of each kind of call in nanoseconds
+//          Paced, each call waits until as long after the first as it was recorded, and how late the
+//          calls start is reported as well
+// Precon:  None
+// Postcon: Results are written to cout
+//          Returns 0, or 1 if the trace can't be read
+int replay(const string& path, bool paced, bool layout, bool cache, bool slabs, bool threading)
+{
+    ifstream in(path, ios::binary);
+    Fleet fleet;
+    if(slabs)
+    {
+        fleet.setPlacement(SLABS);
+    }
+    fleet.setSearchLayout(layout);
+    fleet.setCache(cache);
+    fleet.setThreading(threading);
+    vector<TraceRecord> records;
+    if(!in
+        || !Fleet::readTrace(in, fleet, records))
+    {
+        cout << "Can't read " << path << (records.empty() ? "" : ", replaying the calls before it was cut short") << "\n";
+        if(records.empty())
+        {
+            return 1;
+        }
+    }
+    const int startSize = fleet.getSize();
+    vector<uint64_t> latencies[NUM_OPS];
+    vector<uint64_t> late;
+    late.reserve(paced ? records.size() : 0);
+    long long found = 0;
+    const uint64_t start = nanosNow();
+    for(const TraceRecord& record : records)
+    {
+        uint64_t before = nanosNow();
+        if(paced)
+        {
+            const uint64_t due = start + record.nanos - records[0].nanos;
+            if(due > before + SPIN_NANOS)
+            {
+                this_thread::sleep_for(chrono::nanoseconds(due - before - SPIN_NANOS));
+            }
+            while((before = nanosNow()) < due)
+            {
+            }
+            late.push_back(before - due);
+        }
+        const bool result = fleet.replay(record);
+        found += result && (record.op == TRACE_FIND || record.op == TRACE_SET_STATE);
+        latencies[record.op].push_back(nanosNow() - before);
+    }
+    const double elapsed = (nanosNow() - start) / 1e9;
+    cout << BREAK << "Replayed " << records.size() << " calls from " << path << " on the " << BALANCE_NAME << " build, starting from " << startSize << " Ships"
+         << (paced ? ", paced" : ", at full speed") << (layout ? ", search layout" : "") << (cache ? ", cache" : "")
+         << (slabs ? ", slabs" : "") << (fleet.getThreading() ? ", threaded" : (threading ? ", no threading in this build" : "")) << "\n" << BREAK;
+    cout << "Recorded over " << (records.empty() ? 0 : (records.back().nanos - records[0].nanos) / 1e6) << " ms, replayed in "
+         << elapsed * 1e3 << " ms: " << records.size() / max(elapsed, 1e-9) << " calls per second\n";
+    cout << found << " findShip and setState calls found their Ship, and the Fleet ended with " << fleet.getSize() << " Ships\n";
+    cout << "call\tcount\tmean\tp50\tp90\tp99\tp99.9\tmax (ns)\n";
+    vector<uint64_t> all;
+    for(int op = 0; op < NUM_OPS; op++)
+    {
+        sort(latencies[op].begin(), latencies[op].end());
+        report(OP_NAMES[op], latencies[op]);
+        all.insert(all.end(), latencies[op].begin(), latencies[op].end());
+    }
+    sort(all.begin(), all.end());
+    report("all", all);
+    if(paced)
+    {
+        sort(late.begin(), late.end());
+        report("late", late);
+    }
+    cout << BREAK;
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 2)
+    {
+        cout << "Usage: replay.exe <trace> [paced] [layout] [cache] [slabs] [threading]\n"
+             << "       replay.exe record <trace> [calls] [seed]\n";
+        return 1;
+    }
+    if(string(argv[1]) == "record")
+    {
+        if(argc < 3)
+        {
+            cout << "Usage: replay.exe record <trace> [calls] [seed]\n";
+            return 1;
+        }
+        return record(argv[2], (argc > 3 ? atoi(argv[3]) : SAMPLE_CALLS), (argc > 4 ? atoi(argv[4]) : 341));
+    }
+    bool options[5] = {false, false, false, false, false};
+    const string names[5] = {"paced", "layout", "cache", "slabs", "threading"};
+    for(int i = 2; i < argc; i++)
+    {
+        const int option = find(names, names + 5, string(argv[i])) - names;
+        if(option == 5)
+        {
+            cout << "Unknown option " << argv[i] << "\n";
+            return 1;
+        }
+        options[option] = true;
+    }
+    return replay(argv[1], options[0], options[1], options[2], options[3], options[4]);
+}